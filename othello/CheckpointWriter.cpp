@@ -0,0 +1,414 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "CheckpointWriter.h"
+
+namespace
+{
+	//------------------------------------------------------------------
+	/**
+	 * ファイルの内容をディスクに反映させる
+	 *
+	 * @param  pFile  書き込み用に開いたファイル
+	 *
+	 * @return        成否
+	 */
+	//------------------------------------------------------------------
+	bool SyncFile(FILE *pFile)
+	{
+		if (fflush(pFile) != 0)
+			return (false);
+
+#ifdef _WIN32
+		return (_commit(_fileno(pFile)) == 0);
+#else
+		return (fsync(fileno(pFile)) == 0);
+#endif
+	}
+
+	//------------------------------------------------------------------
+	/**
+	 * ファイルを書いてディスクに反映させる
+	 *
+	 * @param  path  書き込み先
+	 * @param  data  書き込む内容
+	 *
+	 * @return       成否(失敗したら書きかけのファイルは消す)
+	 */
+	//------------------------------------------------------------------
+	bool WriteSyncedFile(const std::string &path, const std::vector<char> &data)
+	{
+		FILE	*pFile	= fopen(path.c_str(), "wb");
+
+		if (pFile == NULL)
+			return (false);
+
+		const bool	written	= (data.empty() || (fwrite(&data[0], 1, data.size(), pFile) == data.size()))
+							&& SyncFile(pFile);
+
+		if ((fclose(pFile) != 0)
+		||  !written)
+		{
+			remove(path.c_str());
+			return (false);
+		}
+
+		return (true);
+	}
+
+	//------------------------------------------------------------------
+	/**
+	 * ファイルの読み込み
+	 *
+	 * @param  path  読み込むファイル
+	 * @param  data  内容の受取先
+	 *
+	 * @return       成否(ファイルがなければ false)
+	 */
+	//------------------------------------------------------------------
+	bool LoadFile(const std::string &path, std::vector<char> &data)
+	{
+		FILE	*pFile	= fopen(path.c_str(), "rb");
+		char	buffer[4096];
+		size_t	size;
+
+		if (pFile == NULL)
+			return (false);
+
+		data.clear();
+		while ((size = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+			data.insert(data.end(), buffer, buffer + size);
+
+		const bool	result	= (ferror(pFile) == 0);
+
+		fclose(pFile);
+
+		return (result);
+	}
+
+	//------------------------------------------------------------------
+	/**
+	 * 名前の変更(変更先があれば置き換える)
+	 *
+	 * @param  from  変更元
+	 * @param  to    変更先
+	 *
+	 * @return       成否
+	 */
+	//------------------------------------------------------------------
+	bool RenameFile(const std::string &from, const std::string &to)
+	{
+#ifdef _WIN32
+		return (MoveFileExA(from.c_str(),
+							to.c_str(),
+							MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0);
+#else
+		return (rename(from.c_str(), to.c_str()) == 0);
+#endif
+	}
+
+	//------------------------------------------------------------------
+	/**
+	 * ディレクトリの変更(名前の変更)をディスクに反映させる
+	 * -Windows は MOVEFILE_WRITE_THROUGH で済ませているので何もしない
+	 *
+	 * @param  path  ディレクトリ内のファイル
+	 */
+	//------------------------------------------------------------------
+	void SyncDirectory(const std::string &path)
+	{
+#ifndef _WIN32
+		const std::string::size_type	slash	= path.find_last_of('/');
+		const std::string				dir		= (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+		const int						fd		= open(dir.c_str(), O_RDONLY);
+
+		if (fd >= 0)
+		{
+			fsync(fd);
+			close(fd);
+		}
+#endif
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * コンストラクタ
+ */
+//----------------------------------------------------------------------
+CheckpointWriter::CheckpointWriter() :
+	m_Keep(1),
+	m_TrainingState(false),
+	m_Pending(false),
+	m_Busy(false),
+	m_Result(true),
+	m_Quit(false),
+	m_WriteCount(0),
+	m_SkipCount(0)
+{
+}
+
+//----------------------------------------------------------------------
+/**
+ * デストラクタ
+ * -写してある値は書き込んでから終わる
+ */
+//----------------------------------------------------------------------
+CheckpointWriter::~CheckpointWriter()
+{
+	Clear();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 準備
+ * -書き込み用のスレッドを起こす
+ *
+ * @param  net            保存するネット
+ * @param  pPath          保存先
+ * @param  keep           残すチェックポイントの数(1 なら保存先だけ)
+ * @param  trainingState  学習状態も保存する(net は学習用)
+ *
+ * @return                成否
+ */
+//----------------------------------------------------------------------
+bool CheckpointWriter::Setup(NeuralNet   &net,
+							 const char  *pPath,
+							 unsigned int keep,
+							 bool         trainingState)
+{
+	Clear();
+
+	if ((pPath == NULL)
+	||  (net.GetParamNum() == 0)
+	||  (trainingState && (net.GetMode() != NeuralNet::Mode::TrainingMode)))
+		return (false);
+
+	m_Snapshot.Clone(net,
+					 trainingState ? NeuralNet::Mode::TrainingMode : NeuralNet::Mode::InferenceMode);
+
+	m_Path			= pPath;
+	m_Keep			= (keep > 0) ? keep : 1;
+	m_TrainingState	= trainingState;
+	m_Extra.clear();
+	m_Pending		= false;
+	m_Busy			= false;
+	m_Result		= true;
+	m_Quit			= false;
+	m_WriteCount	= 0;
+	m_SkipCount		= 0;
+
+	m_Thread	= std::thread(&CheckpointWriter::Run, this);
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後始末
+ * -写してある値を書き込んでからスレッドを止める
+ */
+//----------------------------------------------------------------------
+void CheckpointWriter::Clear(void)
+{
+	if (!m_Thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex>	lock(m_Mutex);
+
+		m_Quit	= true;
+	}
+	m_Request.notify_all();
+	m_Thread.join();
+}
+
+//----------------------------------------------------------------------
+/**
+ * チェックポイントの書き込み
+ * -値を複製に写したら戻る(写すのは平坦な領域の複写と RReLU のアルファだけ)
+ * -まだ書き始めていなければ新しい値で置き換える
+ *
+ * @param  net   保存するネット(Setup と同じ構成)
+ * @param  wait  書き込み中なら終わるのを待つ
+ *
+ * @return       写したか(書き込み中で写さなかった・構成が違えば false)
+ */
+//----------------------------------------------------------------------
+bool CheckpointWriter::Write(const NeuralNet &net, bool wait)
+{
+	return (Write(net, std::vector<char>(), wait));
+}
+
+//----------------------------------------------------------------------
+/**
+ * チェックポイントの書き込み(呼び出し側の状態付き)
+ * -学習状態を付けるならモーメント・速度も平坦な領域をまとめて写す
+ *
+ * @param  net    保存するネット(Setup と同じ構成)
+ * @param  extra  学習状態の後ろに付けるデータ(学習状態を付けなければ使わない)
+ * @param  wait   書き込み中なら終わるのを待つ
+ *
+ * @return        写したか(書き込み中で写さなかった・構成が違えば false)
+ */
+//----------------------------------------------------------------------
+bool CheckpointWriter::Write(const NeuralNet         &net,
+							 const std::vector<char> &extra,
+							 bool                    wait)
+{
+	{
+		std::unique_lock<std::mutex>	lock(m_Mutex);
+
+		if (!m_Thread.joinable())
+			return (false);
+
+		if (wait)
+		{
+			m_Done.wait(lock, [this] {return (!m_Busy);});
+		}
+		else if (m_Busy)
+		{
+			++m_SkipCount;
+			return (false);
+		}
+
+		if (!m_Snapshot.CopyParam(net)
+		||  (m_TrainingState && !m_Snapshot.CopyTrainingState(net)))
+			return (false);
+
+		m_Extra		= extra;
+		m_Pending	= true;
+	}
+	m_Request.notify_all();
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 書き込みの完了待ち
+ *
+ * @return  最後の書き込みの成否
+ */
+//----------------------------------------------------------------------
+bool CheckpointWriter::Flush(void)
+{
+	std::unique_lock<std::mutex>	lock(m_Mutex);
+
+	m_Done.wait(lock, [this] {return (!m_Pending && !m_Busy);});
+
+	return (m_Result);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 書き込み用のスレッド
+ */
+//----------------------------------------------------------------------
+void CheckpointWriter::Run(void)
+{
+	std::vector<char>	data;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex>	lock(m_Mutex);
+
+			m_Request.wait(lock, [this] {return (m_Pending || m_Quit);});
+
+			// 終了指示の前に写した値は書いておく.
+			if (!m_Pending)
+				break;
+
+			m_Pending	= false;
+			m_Busy		= true;
+		}
+
+		// 書き込み中は Write が複製を書き換えない.
+		data.clear();
+		m_Snapshot.Save(data);
+		if (m_TrainingState)
+		{
+			m_Snapshot.SaveTrainingState(data);
+			data.insert(data.end(), m_Extra.begin(), m_Extra.end());
+		}
+
+		const bool	result	= WriteData(m_Path, data, m_Keep);
+
+		{
+			std::lock_guard<std::mutex>	lock(m_Mutex);
+
+			m_Busy		= false;
+			m_Result	= result;
+			++m_WriteCount;
+		}
+		m_Done.notify_all();
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * ファイルへの書き込み
+ * -path.tmp に書いてディスクに反映させ, 古いものをずらしてから path に置き換える
+ * -保存先は path.1 に複写する(名前を変えないので, どこで落ちても保存先は残る)
+ *
+ * @param  path  保存先
+ * @param  data  保存形式のデータ
+ * @param  keep  残す数(保存先と path.1 ～ path.(keep-1))
+ *
+ * @return       成否(失敗しても保存先は前の内容のまま)
+ */
+//----------------------------------------------------------------------
+bool CheckpointWriter::WriteData(const std::string       &path,
+								 const std::vector<char> &data,
+								 unsigned int            keep)
+{
+	const std::string	temp	= path + ".tmp";
+
+	if (!WriteSyncedFile(temp, data))
+		return (false);
+
+	if (keep > 1)
+	{
+		std::vector<char>	previous;
+
+		// 古いものから 1 つずつずらす(まだなければ失敗してよい).
+		for (unsigned int k = keep - 1; k > 1; --k)
+			RenameFile(path + "." + std::to_string(k - 1), path + "." + std::to_string(k));
+
+		// 保存先も一時ファイルを経由して複写する(まだなければ何もしない).
+		if (LoadFile(path, previous))
+		{
+			const std::string	first	= path + ".1";
+
+			if (WriteSyncedFile(first + ".tmp", previous)
+			&&  !RenameFile(first + ".tmp", first))
+				remove((first + ".tmp").c_str());
+		}
+	}
+
+	if (!RenameFile(temp, path))
+	{
+		remove(temp.c_str());
+		return (false);
+	}
+
+	SyncDirectory(path);
+
+	return (true);
+}
@@ -0,0 +1,75 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#ifndef CHECKPOINT_WRITER_H_
+#define CHECKPOINT_WRITER_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NeuralNet.h"
+
+//----------------------------------------------------------------------
+/// ネットの保存(チェックポイント)
+// -Write は値を手元の複製に写すだけで戻り, 保存形式への変換と書き込みは専用のスレッドで行う
+// -一時ファイルに書いてディスクに反映させてから名前を変えるので, 途中で落ちても
+//  保存先が壊れたファイルになることはない
+// -keep 個残す: path.1 を path.2 ... とずらし, 保存先を path.1 に複写してから置き換える
+//  (保存先は名前を変えずに置き換えるだけなので, どこで落ちても前か今回の内容が残る)
+// -trainingState なら学習状態(NeuralNet::SaveTrainingState)と, Write に渡した
+//  呼び出し側の状態(抽出・学習率の調整など)を後ろに付ける
+class CheckpointWriter
+{
+  private:
+	NeuralNet					m_Snapshot;		// 書き込む値の複製(学習状態を付けなければ推論専用)
+	std::vector<char>			m_Extra;		// 後ろに付ける呼び出し側の状態
+	std::string					m_Path;
+	unsigned int				m_Keep;
+	bool						m_TrainingState;
+
+	std::thread					m_Thread;
+	std::mutex					m_Mutex;
+	std::condition_variable		m_Request;		// 書き込みの指示・終了指示
+	std::condition_variable		m_Done;			// 書き込みの完了
+	bool						m_Pending;		// 複製を写して, まだ書き始めていない
+	bool						m_Busy;			// 複製を書き込み中
+	bool						m_Result;		// 最後の書き込みの成否
+	bool						m_Quit;
+	unsigned int				m_WriteCount;
+	unsigned int				m_SkipCount;
+
+	void Run(void);
+
+  public:
+	CheckpointWriter();
+	~CheckpointWriter();
+
+	bool   Setup(NeuralNet   &net,
+				 const char  *pPath,
+				 unsigned int keep,
+				 bool         trainingState = false);
+	void   Clear(void);
+
+	// 書き込み中なら何もせず false(wait なら終わるのを待ってから写す).
+	bool   Write(const NeuralNet &net, bool wait = false);
+	bool   Write(const NeuralNet       &net,
+				 const std::vector<char> &extra,
+				 bool                    wait = false);
+	// 書き込みが終わるのを待ち, 最後の書き込みの成否を返す.
+	bool   Flush(void);
+
+	// 書き込んだ回数・書き込み中で見送った回数(Flush の後に読むこと).
+	unsigned int GetWriteCount(void) const {return (m_WriteCount);}
+	unsigned int GetSkipCount( void) const {return (m_SkipCount);}
+
+	static bool WriteData(const std::string       &path,
+						  const std::vector<char> &data,
+						  unsigned int            keep);
+};
+
+#endif /* CHECKPOINT_WRITER_H_ */
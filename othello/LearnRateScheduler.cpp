@@ -0,0 +1,265 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "LearnRateScheduler.h"
+
+namespace
+{
+	// 保存データの先頭(ReplaySampler の次の番号).
+	const unsigned int	SCHEDULER_STATE	= 0x80000002UL;
+
+	template <typename T>
+	void WriteData(std::vector<char> &data, const T &value)
+	{
+		const char	*pChar	= (const char *)&value;
+
+		data.insert(data.end(), pChar, pChar + sizeof(value));
+	}
+
+	template <typename T>
+	bool ReadData(const std::vector<char> &data, unsigned int &index, T &value)
+	{
+		if (index + sizeof(value) > data.size())
+			return (false);
+
+		memcpy(&value, &data[index], sizeof(value));
+		index	+= sizeof(value);
+
+		return (true);
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * コンストラクタ
+ */
+//----------------------------------------------------------------------
+LearnRateScheduler::LearnRateScheduler() :
+	m_Schedule(ConstantSchedule),
+	m_BaseRatio(0.001),
+	m_MinRatio(0.0),
+	m_LearnRatio(0.001),
+	m_WarmupStep(0),
+	m_Step(0),
+	m_Epoch(0),
+	m_StepEpoch(10),
+	m_StepFactor(0.1),
+	m_TotalStep(0),
+	m_Patience(5),
+	m_PlateauFactor(0.1),
+	m_Threshold(1.0e-3),
+	m_BestLoss(HUGE_VAL),
+	m_BadEpoch(0),
+	m_PlateauScale(1.0)
+{
+}
+
+//----------------------------------------------------------------------
+/**
+ * 準備
+ * -更新回数と誤差の履歴は初めからにする(各方式の設定は残す)
+ *
+ * @param  schedule   調整方法
+ * @param  baseRatio  基準の学習率
+ */
+//----------------------------------------------------------------------
+void LearnRateScheduler::Setup(Schedule schedule, double baseRatio)
+{
+	m_Schedule		= schedule;
+	m_BaseRatio		= baseRatio;
+	m_LearnRatio	= baseRatio;
+	m_Step			= 0;
+	m_Epoch			= 0;
+	m_BestLoss		= HUGE_VAL;
+	m_BadEpoch		= 0;
+	m_PlateauScale	= 1.0;
+
+	m_LossHistory.clear();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 段階の設定
+ *
+ * @param  stepEpoch  減衰させる間隔(EndEpoch の回数)
+ * @param  factor     1 回の減衰の倍率
+ */
+//----------------------------------------------------------------------
+void LearnRateScheduler::SetStep(unsigned int stepEpoch, double factor)
+{
+	m_StepEpoch		= std::max(stepEpoch, 1U);
+	m_StepFactor	= factor;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 停滞の設定
+ *
+ * @param  patience   改善しなくても待つ回数(EndEpoch の回数)
+ * @param  factor     1 回の減衰の倍率
+ * @param  threshold  最良の誤差からこの割合以上下がれば改善とみなす
+ */
+//----------------------------------------------------------------------
+void LearnRateScheduler::SetPlateau(unsigned int patience, double factor, double threshold)
+{
+	m_Patience		= std::max(patience, 1U);
+	m_PlateauFactor	= factor;
+	m_Threshold		= threshold;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 1 回の更新に使う学習率
+ *
+ * @return  学習率
+ */
+//----------------------------------------------------------------------
+double LearnRateScheduler::Step(void)
+{
+	double	ratio	= m_BaseRatio;
+
+	++m_Step;
+
+	switch (m_Schedule)
+	{
+	case StepSchedule:
+		ratio	*= pow(m_StepFactor, (double)(m_Epoch / m_StepEpoch));
+		break;
+
+	case CosineSchedule:
+		if ((m_TotalStep > 0) && (m_Step > m_WarmupStep))
+		{
+			const double	pi	= 3.14159265358979323846;
+			const double	t	= std::min((double)(m_Step - m_WarmupStep) / m_TotalStep, 1.0);
+
+			ratio	= m_MinRatio + (m_BaseRatio - m_MinRatio) * 0.5 * (1.0 + cos(pi * t));
+		}
+		break;
+
+	case PlateauSchedule:
+		ratio	*= m_PlateauScale;
+		break;
+
+	default:
+		break;
+	}
+
+	ratio	= std::max(ratio, m_MinRatio);
+
+	if (m_Step <= m_WarmupStep)
+		ratio	*= (double)m_Step / m_WarmupStep;
+
+	m_LearnRatio	= ratio;
+
+	return (ratio);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 局面数分の学習の終わり
+ * -段階と停滞はここで減衰させる(次の Step から反映する)
+ *
+ * @param  loss  誤差(回ごとに同じ尺度にすること)
+ */
+//----------------------------------------------------------------------
+void LearnRateScheduler::EndEpoch(double loss)
+{
+	++m_Epoch;
+	m_LossHistory.push_back(loss);
+
+	if (m_Schedule != PlateauSchedule)
+		return;
+
+	if (loss < m_BestLoss * (1.0 - m_Threshold))
+	{
+		m_BestLoss	= loss;
+		m_BadEpoch	= 0;
+	}
+	else if (++m_BadEpoch >= m_Patience)
+	{
+		// 待つ回数は数え直す(下限は Step で抑える).
+		m_PlateauScale	*= m_PlateauFactor;
+		m_BadEpoch		=  0;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 状態の保存
+ * -配列の後ろに付け足す
+ *
+ * @param  data  バイナリ配列
+ */
+//----------------------------------------------------------------------
+void LearnRateScheduler::Save(std::vector<char> &data) const
+{
+	WriteData(data, SCHEDULER_STATE);
+	WriteData(data, m_Step);
+	WriteData(data, m_Epoch);
+	WriteData(data, m_LearnRatio);
+	WriteData(data, m_BestLoss);
+	WriteData(data, m_BadEpoch);
+	WriteData(data, m_PlateauScale);
+	WriteData(data, (unsigned int)m_LossHistory.size());
+
+	for (unsigned int i = 0; i < m_LossHistory.size(); ++i)
+		WriteData(data, m_LossHistory[i]);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 状態の読み込み
+ * -Setup の後に呼ぶ(方式と各設定はそのまま)
+ *
+ * @param  data   バイナリ配列
+ * @param  index  読む位置(状態が付いていれば後ろに進める)
+ *
+ * @return        戻したか
+ */
+//----------------------------------------------------------------------
+bool LearnRateScheduler::Load(const std::vector<char> &data, unsigned int &index)
+{
+	unsigned int	position	= index;
+	unsigned int	tag			= 0;
+	unsigned int	step;
+	unsigned int	epoch;
+	double			learnRatio;
+	double			bestLoss;
+	unsigned int	badEpoch;
+	double			plateauScale;
+	unsigned int	historyNum;
+
+	if (!ReadData(data, position, tag)
+	||  (tag != SCHEDULER_STATE)
+	||  !ReadData(data, position, step)
+	||  !ReadData(data, position, epoch)
+	||  !ReadData(data, position, learnRatio)
+	||  !ReadData(data, position, bestLoss)
+	||  !ReadData(data, position, badEpoch)
+	||  !ReadData(data, position, plateauScale)
+	||  !ReadData(data, position, historyNum)
+	||  (position + sizeof(double) * historyNum > data.size()))
+		return (false);
+
+	std::vector<double>	history(historyNum);
+
+	for (unsigned int i = 0; i < historyNum; ++i)
+		ReadData(data, position, history[i]);
+
+	index			= position;
+	m_Step			= step;
+	m_Epoch			= epoch;
+	m_LearnRatio	= learnRatio;
+	m_BestLoss		= bestLoss;
+	m_BadEpoch		= badEpoch;
+	m_PlateauScale	= plateauScale;
+	m_LossHistory.swap(history);
+
+	return (true);
+}
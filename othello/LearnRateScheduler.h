@@ -0,0 +1,82 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#ifndef LEARN_RATE_SCHEDULER_H_
+#define LEARN_RATE_SCHEDULER_H_
+
+#include <vector>
+
+//----------------------------------------------------------------------
+/// 学習率の調整
+// -更新ごとに Step で学習率を受け取り, Learn / LearnAdam に渡す
+// -局面数分を学習するごとに EndEpoch で誤差を伝える(誤差の履歴で減衰させる)
+// -ウォームアップ: 最初の warmupStep 回は基準の学習率まで直線的に上げる
+// -段階: stepEpoch 回ごとに factor 倍する
+// -コサイン: ウォームアップ後の totalStep 回で最小値までコサインで下げる
+// -停滞: 誤差が patience 回続けて下がらなければ factor 倍する
+class LearnRateScheduler
+{
+  public:
+	typedef enum Schedule
+	{
+		ConstantSchedule,		// 一定
+		StepSchedule,			// 段階
+		CosineSchedule,			// コサイン
+		PlateauSchedule,		// 停滞で減衰
+	} Schedule;
+
+  private:
+	Schedule				m_Schedule;
+	double					m_BaseRatio;		// 基準の学習率
+	double					m_MinRatio;			// 下限
+	double					m_LearnRatio;		// 最後に返した学習率
+	unsigned int			m_WarmupStep;
+	unsigned int			m_Step;				// 更新回数
+	unsigned int			m_Epoch;			// EndEpoch の回数
+
+	// 段階.
+	unsigned int			m_StepEpoch;
+	double					m_StepFactor;
+
+	// コサイン.
+	unsigned int			m_TotalStep;
+
+	// 停滞.
+	unsigned int			m_Patience;
+	double					m_PlateauFactor;
+	double					m_Threshold;		// 改善とみなす誤差の減少率
+	double					m_BestLoss;
+	unsigned int			m_BadEpoch;
+	double					m_PlateauScale;
+
+	std::vector<double>		m_LossHistory;
+
+  public:
+	LearnRateScheduler();
+	~LearnRateScheduler() {}
+
+	void   Setup(Schedule schedule, double baseRatio);
+	void   SetWarmup(unsigned int warmupStep) {m_WarmupStep = warmupStep;}
+	void   SetMinRatio(double minRatio) {m_MinRatio = minRatio;}
+	void   SetStep(unsigned int stepEpoch, double factor);
+	void   SetCosine(unsigned int totalStep) {m_TotalStep = totalStep;}
+	void   SetPlateau(unsigned int patience, double factor, double threshold);
+
+	double Step(void);
+	void   EndEpoch(double loss);
+
+	// 更新回数・減衰の進み具合・誤差の履歴を保存する(方式と各設定は含まない).
+	void   Save(std::vector<char> &data) const;
+	bool   Load(const std::vector<char> &data, unsigned int &index);
+
+	Schedule     GetSchedule(void) const {return (m_Schedule);}
+	double       GetLearnRatio(void) const {return (m_LearnRatio);}
+	unsigned int GetStep(void) const {return (m_Step);}
+	unsigned int GetEpoch(void) const {return (m_Epoch);}
+	// EndEpoch で伝えた誤差の履歴.
+	const std::vector<double>& GetLossHistory(void) const {return (m_LossHistory);}
+};
+
+#endif /* LEARN_RATE_SCHEDULER_H_ */
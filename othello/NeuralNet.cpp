@@ -3,9 +3,198 @@
  * $Id: NeuralNet.cpp 2720 2018-01-02 21:21:06+09:00 nowatari $
  * ======================================================================= */
 
+#include <algorithm>
 #include <random>
+#include <sstream>
+#include <string>
+#include <stdint.h>
+#include <string.h>
 
 #include "NeuralNet.h"
+#include "NeuralNetKernel.h"
+
+// 畳み込みを行列積で計算するフィルタ数 x チャンネル数の下限.
+static const unsigned int	CONV_GEMM_THRESHOLD	= 4;
+
+// 学習する値の平坦な領域で各層の先頭をそろえるバイト数.
+static const unsigned int	PARAM_ALIGN			= 64;
+
+//----------------------------------------------------------------------
+/**
+ * 配列の解放(容量ごと手放す)
+ *
+ * @param array 解放する配列
+ */
+//----------------------------------------------------------------------
+template <typename T>
+static void ReleaseArray(std::vector<T> &array)
+{
+	std::vector<T>().swap(array);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 値の移し替え(移し先がなければ何もせず, 移し元がなければ 0 にする)
+ *
+ * @param pTo   移し先
+ * @param pFrom 移し元
+ * @param num   要素数
+ */
+//----------------------------------------------------------------------
+template <typename T>
+static void MoveArray(T *pTo, const T *pFrom, unsigned int num)
+{
+	if ((pTo == NULL) || (pTo == pFrom))
+		return ;
+
+	if (pFrom != NULL)
+		memcpy(pTo, pFrom, sizeof(T) * num);
+	else
+		memset(pTo, 0, sizeof(T) * num);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 動作モードの設定
+ * -NeuralNet に追加する前なら学習する値を自身の領域に持ち直す
+ *
+ * @param mode 動作モード
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Layer::SetMode(Mode mode)
+{
+	m_Mode	= mode;
+
+	if (!m_LocalParam.empty())
+		ReserveLocalParam();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 学習する値の参照先の設定
+ * -今の値・状態を新しい領域に複写し, 自身の領域は解放する
+ *
+ * @param pParam          値
+ * @param pDeltaParam     差分(推論専用なら NULL)
+ * @param pMomentParam    Adam のモーメント(推論専用なら NULL)
+ * @param pVelocityParam  Adam の速度(推論専用なら NULL)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Layer::BindParam(Real *pParam,
+								 Real *pDeltaParam,
+								 Real *pMomentParam,
+								 Real *pVelocityParam)
+{
+	MoveArray(pParam,         m_pParam,         m_ParamNum);
+	MoveArray(pDeltaParam,    m_pDeltaParam,    m_ParamNum);
+	MoveArray(pMomentParam,   m_pMomentParam,   m_ParamNum);
+	MoveArray(pVelocityParam, m_pVelocityParam, m_ParamNum);
+
+	m_pParam			= pParam;
+	m_pDeltaParam		= pDeltaParam;
+	m_pMomentParam		= pMomentParam;
+	m_pVelocityParam	= pVelocityParam;
+
+	ReleaseArray(m_LocalParam);
+	UpdateParamView();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 学習する値の確保(生成時)
+ *
+ * @param paramNum 学習する値の数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Layer::ReserveParam(unsigned int paramNum)
+{
+	m_ParamNum	= paramNum;
+
+	ReserveLocalParam();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 自身の領域への学習する値の確保
+ * -学習用なら差分・Adam の状態も同じ領域に並べる
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Layer::ReserveLocalParam(void)
+{
+	const bool			training	= (m_Mode == Mode::TrainingMode);
+	std::vector<Real>	local(m_ParamNum * (training ? 4 : 1), 0);
+	Real				*pLocal		= &local[0];
+
+	if (training)
+	{
+		BindParam(pLocal,
+				  pLocal + m_ParamNum,
+				  pLocal + m_ParamNum * 2,
+				  pLocal + m_ParamNum * 3);
+	}
+	else
+		BindParam(pLocal, NULL, NULL, NULL);
+
+	m_LocalParam.swap(local);
+}
+
+//----------------------------------------------------------------------
+/**
+ * まとめて適用する活性化の取得
+ *
+ * @param  activation 活性化の種類とパラメータの受取
+ * @param  batchNum   まとめて計算する件数(微分値の領域を確保する)
+ *
+ * @return            まとめて適用するものがあるか
+ */
+//----------------------------------------------------------------------
+bool NeuralNet::Layer::GetActivation(Activation<Real> &activation,
+									 unsigned int     batchNum) const
+{
+	activation.type		= ActivationNone;
+	activation.alpha	= 0;
+	activation.pAlpha	= NULL;
+	activation.pMask	= NULL;
+	activation.softMax	= m_SoftMax;
+	activation.accuracy	= m_Accuracy;
+
+	if (m_pActivation != NULL)
+	{
+		m_pActivation->ReserveMask(batchNum);
+		m_pActivation->GetActivation(activation);
+		activation.pMask	= m_pActivation->MaskData();
+	}
+
+	return ((m_pActivation != NULL) || m_SoftMax);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化の後方出力
+ * -まとめて適用した活性化の微分値を出力差分にかける
+ *  (Soft-Max は損失側で差分を求めているのでそのまま)
+ *
+ * @param  pDelta   出力差分値配列
+ * @param  batchNum まとめて計算する件数
+ *
+ * @return          活性化前の出力差分値配列
+ */
+//----------------------------------------------------------------------
+const NeuralNet::Real *NeuralNet::Layer::FusedDelta(const Real   *pDelta,
+													unsigned int batchNum)
+{
+	Activation<Real>	activation;
+
+	if (!GetActivation(activation, batchNum) || (activation.type == ActivationNone))
+		return (pDelta);
+
+	// 縮めない(件数を戻しても再確保しない).
+	if (m_FusedDelta.size() < m_OutputNum * batchNum)
+		m_FusedDelta.resize(m_OutputNum * batchNum);
+	MultiplyMask(&m_FusedDelta[0], pDelta, activation.pMask, m_OutputNum * batchNum);
+
+	return (&m_FusedDelta[0]);
+}
 
 //----------------------------------------------------------------------
 /**
@@ -17,172 +206,307 @@
 //----------------------------------------------------------------------
 NeuralNet::AffineLayer::AffineLayer(unsigned int inputNum,
 									unsigned int outputNum) :
-Layer(inputNum, outputNum, LayerType::Affine)
+Layer(inputNum, outputNum, LayerType::Affine),
+m_pInput(NULL),
+m_Sparse(false),
+m_pActive(NULL)
 {
-	std::random_device			rd;
-	std::mt19937				mt(rd());
-	std::normal_distribution<>	dist(0.0, 1.0);
-
-	m_Input.resize( inputNum);
-	
-	m_Weight.resize(outputNum * inputNum);
-	m_Bias.resize(  outputNum);
-
-	m_MomentWeight.resize(  outputNum * inputNum);
-	m_VelocityWeight.resize(outputNum * inputNum);
+	std::random_device				rd;
+	std::mt19937					mt(rd());
+	std::normal_distribution<Real>	dist(0, 1);
 
-	m_MomentBias.resize(  outputNum);
-	m_VelocityBias.resize(outputNum);
-	
-	m_DeltaWeight.resize(outputNum * inputNum);
-	m_DeltaBias.resize(  outputNum);
+	// 重み, バイアスの順に並べる(学習用の状態は SetMode で確保する).
+	ReserveParam(outputNum * inputNum + outputNum);
 	
 	for (unsigned int o = 0; o < outputNum; ++o)
 	{
 		for (unsigned int i = 0; i < inputNum; ++i)
-		{
-			WeightAt(        i, o)	= dist(mt);
-			MomentWeightAt(  i, o)	= 0.0;
-			VelocityWeightAt(i, o)	= 0.0;
-			DeltaWeightAt(   i, o)	= 0.0;
-		}
+			WeightAt(i, o)	= dist(mt);
 
-		BiasAt(        o)	= dist(mt);
-		MomentBiasAt(  o)	= 0.0;
-		VelocityBiasAt(o)	= 0.0;
-		DeltaBiasAt(   o)	= 0.0;
+		BiasAt(o)	= dist(mt);
 	}
 }
 
+//----------------------------------------------------------------------
+/**
+ * 重み・バイアスの位置の設定
+ * -学習する値の領域を重み(入力数 x 出力数), バイアス(出力数)に分ける
+ */
+//----------------------------------------------------------------------
+void NeuralNet::AffineLayer::UpdateParamView(void)
+{
+	const unsigned int	weightNum	= m_InputNum * m_OutputNum;
+
+	m_pWeight			= m_pParam;
+	m_pBias				= m_pParam + weightNum;
+	m_pDeltaWeight		= m_pDeltaParam;
+	m_pDeltaBias		= (m_pDeltaParam != NULL) ? m_pDeltaParam + weightNum : NULL;
+	m_pMomentWeight		= m_pMomentParam;
+	m_pMomentBias		= (m_pMomentParam != NULL) ? m_pMomentParam + weightNum : NULL;
+	m_pVelocityWeight	= m_pVelocityParam;
+	m_pVelocityBias		= (m_pVelocityParam != NULL) ? m_pVelocityParam + weightNum : NULL;
+}
+
 //----------------------------------------------------------------------
 /**
  * 前方出力
  *
- * @param  input  入力値配列
- * @param  output 出力値受取配列
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::AffineLayer::Forward(const std::vector<double> &input,
-									 std::vector<double>       &output)
+void NeuralNet::AffineLayer::Forward(const Real *pInput,
+									 Real       *pOutput)
 {
-	if (input.size() != m_InputNum)
-		return;
-	
-	output.resize(m_OutputNum);
-
-	// 学習用に入力値の値を保存.
-	for (unsigned int i = 0; i < m_InputNum; ++i)
-		InputAt(i)	= input[i];
-	
-	for (unsigned int o = 0; o < m_OutputNum; ++o)
-	{
-		output[o]	= 0.0;
-		
-		for (unsigned int i = 0; i < m_Input.size(); ++i)
-			output[o]	+= input[i] * WeightAt(i, o);
-
-		output[o]	= output[o] + BiasAt(o);
-	}
+	// 学習用に入力値を参照しておく.
+	m_pInput	= pInput;
+	m_Sparse	= false;
+
+	Activation<Real>	activation;
+	const bool			fused	= GetActivation(activation);
+
+	AffineForward(pOutput,
+				  pInput,
+				  m_pWeight,
+				  m_pBias,
+				  m_InputNum,
+				  m_OutputNum,
+				  fused ? &activation : NULL);
 }
 
 //----------------------------------------------------------------------
 /**
  * 後方出力
  *
- * @param  delta  出力差分値配列
- * @param  output 出力値受取配列
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::AffineLayer::Backward(const std::vector<double> &delta,
-									  std::vector<double>       &output)
+void NeuralNet::AffineLayer::Backward(const Real *pDelta,
+									  Real       *pOutput)
 {
-	if (delta.size() != m_OutputNum)
-		return;
-	
-	output.resize(m_InputNum);
-	
-	for (unsigned int i = 0; i < m_InputNum; ++i)
-	{
-		output[i]	= 0.0;
-		
-		for (unsigned int o = 0; o < m_OutputNum; ++o)
-		{
-			output[i]	+= delta[o] * WeightAt(i, o);
+	const Real	*pPreDelta	= FusedDelta(pDelta);
 
-			DeltaWeightAt(i, o)	+= delta[o] * InputAt(i);
-		}
+	// 疎入力は先頭層なので入力差分は不要(0 を返す).
+	if (m_Sparse)
+	{
+		std::fill(pOutput, pOutput + m_InputNum, (Real)0);
+
+		AffineBackwardSparse(m_pDeltaWeight,
+							 m_pDeltaBias,
+							 pPreDelta,
+							 m_pActive->data(),
+							 m_pActive->size(),
+							 m_OutputNum);
+		return;
 	}
 
-	for (unsigned int o = 0; o < m_OutputNum; ++o)
-		DeltaBiasAt(o)	+= delta[o];
+	AffineBackward(pOutput,
+				   m_pDeltaWeight,
+				   m_pDeltaBias,
+				   pPreDelta,
+				   m_pInput,
+				   m_pWeight,
+				   m_InputNum,
+				   m_OutputNum);
 }
 
 //----------------------------------------------------------------------
 /**
- * 学習
+ * 前方出力(0/1 疎入力)
+ * -値が 1 の入力の重み行だけを足す. 後方出力も該当行だけを更新する
  *
- * @param learnRatio 学習率
+ * @param  active  値が 1 の入力番号の配列
+ * @param  pOutput 出力値受取配列
+ *
+ * @return         成否
  */
 //----------------------------------------------------------------------
-void NeuralNet::AffineLayer::Learn(double learnRatio)
+bool NeuralNet::AffineLayer::ForwardSparse(const std::vector<unsigned int> &active,
+										   Real                            *pOutput)
 {
-	for (unsigned int o = 0; o < m_OutputNum; ++o)
+	for (unsigned int a = 0; a < active.size(); ++a)
 	{
-		for (unsigned int i = 0; i < m_InputNum; ++i)
-		{
-			WeightAt(i, o)		+= learnRatio * DeltaWeightAt(i, o);
-			DeltaWeightAt(i, o)	=  0.0;
-		}
-		
-		BiasAt(o)		+= learnRatio * DeltaBiasAt(o);
-		DeltaBiasAt(o)	=  0.0;
+		if (active[a] >= m_InputNum)
+			return (false);
 	}
+
+	m_Sparse	= true;
+	m_pActive	= &active;
+
+	Activation<Real>	activation;
+	const bool			fused	= GetActivation(activation);
+
+	AffineForwardSparse(pOutput,
+						active.data(),
+						active.size(),
+						m_pWeight,
+						m_pBias,
+						m_OutputNum,
+						fused ? &activation : NULL);
+
+	return (true);
 }
 
 //----------------------------------------------------------------------
 /**
- * Adam学習
+ * 前方出力(N 件)
+ * -重みを N 件で使い回す行列積で計算する
  *
- * @param alpha    係数更新率
- * @param beta1    モーメント更新率
- * @param beta2    速度更新率
- * @param epsilon  誤差値
+ * @param  pInput   入力値配列(batchNum x 入力数)
+ * @param  pOutput  出力値受取配列(batchNum x 出力数)
+ * @param  batchNum 件数
  */
 //----------------------------------------------------------------------
-void NeuralNet::AffineLayer::LearnAdam(double alpha,
-									   double beta1,
-									   double beta2,
-									   double epsilon)
+void NeuralNet::AffineLayer::ForwardBatch(const Real   *pInput,
+										  Real         *pOutput,
+										  unsigned int batchNum)
 {
-	for (unsigned int o = 0; o < m_OutputNum; ++o)
-	{
-		for (unsigned int i = 0; i < m_InputNum; ++i)
-		{
-			MomentWeightAt(i, o)	= beta1 * MomentWeightAt(i, o)
-									+ (1.0-beta1) * DeltaWeightAt(i, o);
-			VelocityWeightAt(i, o)	= beta2 * VelocityWeightAt(i, o)
-									+ (1.0-beta2)
-									* pow(DeltaWeightAt(i, o), 2);
-			
-			const double	m	= MomentWeightAt(  i, o) / (1.0-beta1);
-			const double	v	= VelocityWeightAt(i, o) / (1.0-beta2);
-			
-			WeightAt(i, o)		+= alpha * m / (sqrt(v) + epsilon);
-			DeltaWeightAt(i, o)	=  0.0;
-		}
+	// 学習用に入力値を参照しておく.
+	m_pInput	= pInput;
+	m_Sparse	= false;
+
+	Activation<Real>	activation;
+	const bool			fused	= GetActivation(activation, batchNum);
+
+	AffineForwardBatch(pOutput,
+					   pInput,
+					   m_pWeight,
+					   m_pBias,
+					   m_InputNum,
+					   m_OutputNum,
+					   batchNum,
+					   fused ? &activation : NULL);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後方出力(N 件)
+ *
+ * @param  pDelta   出力差分値配列(batchNum x 出力数)
+ * @param  pOutput  出力値受取配列(batchNum x 入力数)
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::AffineLayer::BackwardBatch(const Real   *pDelta,
+										   Real         *pOutput,
+										   unsigned int batchNum)
+{
+	AffineBackwardBatch(pOutput,
+						m_pDeltaWeight,
+						m_pDeltaBias,
+						FusedDelta(pDelta, batchNum),
+						m_pInput,
+						m_pWeight,
+						m_InputNum,
+						m_OutputNum,
+						batchNum);
+}
 
-		MomentBiasAt(o)		= beta1 * MomentBiasAt(o)
-							+ (1.0-beta1) * DeltaBiasAt(o);
-		VelocityBiasAt(o)	= beta2 * VelocityBiasAt(o)
-							+ (1.0-beta2)
-							* pow(DeltaBiasAt(o), 2);
-		
-		const double	m	= MomentBiasAt(  o) / (1.0-beta1);
-		const double	v	= VelocityBiasAt(o) / (1.0-beta2);
+//----------------------------------------------------------------------
+/**
+ * 推論専用の前方出力
+ * -層の状態を書き換えない(複数スレッドから同時に呼べる)
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pWork   作業領域(GetWorkNum() 要素)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::AffineLayer::Evaluate(const Real *pInput,
+									  Real       *pOutput,
+									  Real       *pWork) const
+{
+	Activation<Real>	activation;
+	const bool			fused	= GetActivation(activation);
+
+	// 微分値は残さない.
+	activation.pMask	= NULL;
+
+	AffineForward(pOutput,
+				  pInput,
+				  m_pWeight,
+				  m_pBias,
+				  m_InputNum,
+				  m_OutputNum,
+				  fused ? &activation : NULL);
+}
 
-		BiasAt(o)		+= alpha * m / (sqrt(v) + epsilon);
-		DeltaBiasAt(o)	=  0.0;
+//----------------------------------------------------------------------
+/**
+ * 推論専用の前方出力(0/1 疎入力)
+ *
+ * @param  active  値が 1 の入力番号の配列
+ * @param  pOutput 出力値受取配列
+ *
+ * @return         成否
+ */
+//----------------------------------------------------------------------
+bool NeuralNet::AffineLayer::EvaluateSparse(const std::vector<unsigned int> &active,
+											Real                            *pOutput) const
+{
+	for (unsigned int a = 0; a < active.size(); ++a)
+	{
+		if (active[a] >= m_InputNum)
+			return (false);
 	}
+
+	Activation<Real>	activation;
+	const bool			fused	= GetActivation(activation);
+
+	activation.pMask	= NULL;
+
+	AffineForwardSparse(pOutput,
+						active.data(),
+						active.size(),
+						m_pWeight,
+						m_pBias,
+						m_OutputNum,
+						fused ? &activation : NULL);
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化前出力の作成(0/1 疎入力)
+ *
+ * @param  pAccumulator 出力値受取配列(出力数)
+ * @param  active       値が 1 の入力番号の配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::AffineLayer::ResetAccumulator(Real                            *pAccumulator,
+											  const std::vector<unsigned int> &active) const
+{
+	AffineForwardSparse(pAccumulator,
+						active.data(),
+						active.size(),
+						m_pWeight,
+						m_pBias,
+						m_OutputNum,
+						NULL);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化前出力の差分更新(0/1 疎入力)
+ *
+ * @param  pAccumulator 更新する出力値配列(出力数)
+ * @param  added        0 から 1 になった入力番号の配列
+ * @param  removed      1 から 0 になった入力番号の配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::AffineLayer::UpdateAccumulator(Real                            *pAccumulator,
+											   const std::vector<unsigned int> &added,
+											   const std::vector<unsigned int> &removed) const
+{
+	AffineUpdateSparse(pAccumulator,
+					   added.data(),
+					   added.size(),
+					   removed.data(),
+					   removed.size(),
+					   m_pWeight,
+					   m_OutputNum);
 }
 
 //----------------------------------------------------------------------
@@ -202,41 +526,135 @@ Layer(inputNum, inputNum, type)
 //----------------------------------------------------------------------
 /**
  * 前方出力
+ * -配列全体を活性化の種類ごとの関数で計算し, 微分値もまとめて書く
+ *  (推論専用なら微分値を残さない)
  *
- * @param  input  入力値配列
- * @param  output 出力値受取配列
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::ActivateLayer::Forward(const std::vector<double> &input,
-									   std::vector<double>       &output)
+void NeuralNet::ActivateLayer::Forward(const Real *pInput,
+									   Real       *pOutput)
 {
-	if (input.size() != m_InputNum)
-		return;
-	
-	output.resize(m_OutputNum);
-	
-	for (unsigned int o = 0; o < m_OutputNum; ++o)
-		output[o]	= ForwardFunc(input[o], o);
+	Activation<Real>	activation;
+
+	GetActivation(activation);
+	activation.pMask	= MaskData();
+	activation.softMax	= false;
+	activation.accuracy	= m_Accuracy;
+
+	Activate(pOutput, pInput, m_OutputNum, activation);
 }
 
 //----------------------------------------------------------------------
 /**
  * 後方出力
  *
- * @param  delta  出力差分値配列
- * @param  output 出力値受取配列
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::ActivateLayer::Backward(const std::vector<double> &delta,
-										std::vector<double>       &output)
+void NeuralNet::ActivateLayer::Backward(const Real *pDelta,
+										Real       *pOutput)
 {
-	if (delta.size() != m_OutputNum)
-		return;
+	MultiplyMask(pOutput, pDelta, &m_Mask[0], m_OutputNum);
+}
 
-	output.resize(m_InputNum);
-	
-	for (unsigned int o = 0; o < m_OutputNum; ++o)
-		output[o]	= BackwardFunc(delta[o], o);
+//----------------------------------------------------------------------
+/**
+ * 前方出力(N 件)
+ *
+ * @param  pInput   入力値配列(batchNum x 入力数)
+ * @param  pOutput  出力値受取配列(batchNum x 出力数)
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ActivateLayer::ForwardBatch(const Real   *pInput,
+											Real         *pOutput,
+											unsigned int batchNum)
+{
+	Activation<Real>	activation;
+
+	ReserveMask(batchNum);
+	GetActivation(activation);
+	activation.pMask	= MaskData();
+	activation.softMax	= false;
+	activation.accuracy	= m_Accuracy;
+
+	ActivateBatch(pOutput, pInput, m_OutputNum, batchNum, activation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後方出力(N 件)
+ *
+ * @param  pDelta   出力差分値配列(batchNum x 出力数)
+ * @param  pOutput  出力値受取配列(batchNum x 入力数)
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ActivateLayer::BackwardBatch(const Real   *pDelta,
+											 Real         *pOutput,
+											 unsigned int batchNum)
+{
+	MultiplyMask(pOutput, pDelta, &m_Mask[0], m_OutputNum * batchNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 推論専用の前方出力
+ * -層の状態を書き換えない(複数スレッドから同時に呼べる)
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pWork   作業領域(GetWorkNum() 要素)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ActivateLayer::Evaluate(const Real *pInput,
+										Real       *pOutput,
+										Real       *pWork) const
+{
+	Activation<Real>	activation;
+
+	GetActivation(activation);
+	activation.pMask	= NULL;
+	activation.softMax	= false;
+	activation.accuracy	= m_Accuracy;
+
+	Activate(pOutput, pInput, m_OutputNum, activation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 微分値の領域の確保
+ * -推論専用なら持たない. 縮めない(件数を戻しても再確保しない)
+ *
+ * @param batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ActivateLayer::ReserveMask(unsigned int batchNum)
+{
+	if ((m_Mode == Mode::TrainingMode)
+	&&  (m_Mask.size() < m_InputNum * batchNum))
+		m_Mask.resize(m_InputNum * batchNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 動作モードの設定
+ * -推論専用なら後方出力用の微分値を持たない
+ *
+ * @param mode 動作モード
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ActivateLayer::SetMode(Mode mode)
+{
+	Layer::SetMode(mode);
+
+	if (mode == Mode::TrainingMode)
+		m_Mask.assign(m_InputNum, 0);
+	else
+		ReleaseArray(m_Mask);
 }
 
 //----------------------------------------------------------------------
@@ -247,7 +665,8 @@ void NeuralNet::ActivateLayer::Backward(const std::vector<double> &delta,
  */
 //----------------------------------------------------------------------
 NeuralNet::RReLULayer::RReLULayer(unsigned int inputNum) :
-ReLULayer(inputNum, LayerType::RReLU)
+ReLULayer(inputNum, LayerType::RReLU),
+m_Random(std::random_device()())
 {
 	m_Alpha.resize(inputNum);
 
@@ -265,7 +684,7 @@ ReLULayer(inputNum, LayerType::RReLU)
 void NeuralNet::RReLULayer::Learn(double learnRatio)
 {
 	for (unsigned int i = 0; i < m_InputNum; ++i)
-		SetAlpha(i, 0.5 * (GetAlpha(i) + GetRandomAlpha()));
+		SetAlpha(i, (GetAlpha(i) + GetRandomAlpha()) / 2);
 }
 
 //----------------------------------------------------------------------
@@ -274,84 +693,106 @@ void NeuralNet::RReLULayer::Learn(double learnRatio)
  *
  */
 //----------------------------------------------------------------------
-double NeuralNet::RReLULayer::GetRandomAlpha(void)
+NeuralNet::Real NeuralNet::RReLULayer::GetRandomAlpha(void)
 {
-	std::random_device					rd;
-	std::mt19937						mt(rd());
-	std::uniform_real_distribution<>	dist(0.0, 0.1);
+	std::uniform_real_distribution<Real>	dist(0, (Real)0.1);
 
-	return (dist(mt));
+	return (dist(m_Random));
 }
 
 //----------------------------------------------------------------------
 /**
  * 前方出力
  * -出力の総和を１に調整する
- * @param  input  入力値配列
- * @param  output 出力値受取配列
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::SoftMaxLayer::Forward(const std::vector<double> &input,
-									  std::vector<double>       &output)
+void NeuralNet::SoftMaxLayer::Forward(const Real *pInput,
+									  Real       *pOutput)
 {
-	double	total		= 0.0;
-	double	maxValue;
-
-	if (input.size() != m_InputNum)
-		return;
-
-	output.resize(m_OutputNum);
-
-	// オーバーフロー対策に最大値で引く.
-	maxValue	= input[0];
-	for (unsigned int i = 1; i < m_InputNum; ++i)
-	{
-		if (input[i] > maxValue)
-			maxValue	= input[i];
-	}
-
-	for (unsigned int o = 0; o < m_OutputNum; ++o)
-	{
-		output[o]	=  exp(input[o]-maxValue);
-		total		+= output[o];
-	}
+	Evaluate(pInput, pOutput, NULL);
+}
 
-	// 総和で割る
-	for (unsigned int o = 0; o < m_OutputNum; ++o)
-		output[o]	/= total;
+//----------------------------------------------------------------------
+/**
+ * 推論専用の前方出力
+ * -出力の総和を１に調整する(状態を持たないので Forward と同じ)
+ *  オーバーフロー対策に最大値で引いてから指数を取る
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pWork   作業領域(GetWorkNum() 要素)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::SoftMaxLayer::Evaluate(const Real *pInput,
+									   Real       *pOutput,
+									   Real       *pWork) const
+{
+	// LayerType::SoftMax と区別する.
+	::SoftMax(pOutput, pInput, m_OutputNum, m_Accuracy);
 }
 
 //----------------------------------------------------------------------
 /**
  * 後方出力
  *
- * @param  delta  出力差分値配列
- * @param  output 出力値受取配列
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::SoftMaxLayer::Backward(const std::vector<double> &delta,
-									   std::vector<double>       &output)
+void NeuralNet::SoftMaxLayer::Backward(const Real *pDelta,
+									   Real       *pOutput)
 {
-	if (delta.size() != m_OutputNum)
-		return;
-
-	output.resize(m_InputNum);
-	
 	for (unsigned int o = 0; o < m_OutputNum; ++o)
-		output[o]	= delta[o];
+		pOutput[o]	= pDelta[o];
 }
 
 //----------------------------------------------------------------------
 /**
- * コンストラクタ
+ * 前方出力(N 件)
+ * -1 件(行)ごとに総和を１に調整する
  *
- * @param width      入力の横幅
- * @param height     入力の高さ
- * @param channel    入力のチャンネル数
- * @param filterSize フィルタのサイズ
- * @param filterNum  フィルタの数
- * @param stride     フィルタのストライド
- * @param padding    フィルタのパディング
+ * @param  pInput   入力値配列(batchNum x 入力数)
+ * @param  pOutput  出力値受取配列(batchNum x 出力数)
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::SoftMaxLayer::ForwardBatch(const Real   *pInput,
+										   Real         *pOutput,
+										   unsigned int batchNum)
+{
+	for (unsigned int b = 0; b < batchNum; ++b)
+		Forward(pInput + b*m_InputNum, pOutput + b*m_OutputNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後方出力(N 件)
+ *
+ * @param  pDelta   出力差分値配列(batchNum x 出力数)
+ * @param  pOutput  出力値受取配列(batchNum x 入力数)
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::SoftMaxLayer::BackwardBatch(const Real   *pDelta,
+											Real         *pOutput,
+											unsigned int batchNum)
+{
+	std::copy(pDelta, pDelta + m_OutputNum * batchNum, pOutput);
+}
+
+//----------------------------------------------------------------------
+/**
+ * コンストラクタ
+ *
+ * @param width      入力の横幅
+ * @param height     入力の高さ
+ * @param channel    入力のチャンネル数
+ * @param filterSize フィルタのサイズ
+ * @param filterNum  フィルタの数
+ * @param stride     フィルタのストライド
+ * @param padding    フィルタのパディング
  * @param type       レイヤータイプ
  */
 //----------------------------------------------------------------------
@@ -371,24 +812,14 @@ FilterLayer(width,
 			padding,
 			LayerType::Convolution)
 {
-	std::random_device			rd;
-	std::mt19937				mt(rd());
-	std::normal_distribution<>	dist(0.0, 1.0);
+	std::random_device				rd;
+	std::mt19937					mt(rd());
+	std::normal_distribution<Real>	dist(0, 1);
 
-	m_Input.resize(m_InputNum);
+	m_pInput	= NULL;
 	
-	// フィルタバッファ
-	m_Filter.resize(channel*filterNum*filterSize*filterSize);
-	m_Bias.resize(  channel*filterNum);
-
-	m_MomentFilter.resize(  channel*filterNum*filterSize*filterSize);
-	m_VelocityFilter.resize(channel*filterNum*filterSize*filterSize);
-
-	m_MomentBias.resize(  channel*filterNum);
-	m_VelocityBias.resize(channel*filterNum);
-
-	m_DeltaFilter.resize(channel*filterNum*filterSize*filterSize);
-	m_DeltaBias.resize(  channel*filterNum);
+	// フィルタ, バイアスの順に並べる(学習用の状態は SetMode で確保する)
+	ReserveParam(channel*filterNum*filterSize*filterSize + channel*filterNum);
 
 	for (unsigned int c = 0; c < channel; ++c)
 	{
@@ -397,37 +828,282 @@ FilterLayer(width,
 			for (unsigned int x = 0; x < filterSize; ++x)
 			{
 				for (unsigned int y = 0; y < filterSize; ++y)
-				{
-					FilterAt(        x, y, f, c)	= pow(dist(mt), 2);
-					MomentFilterAt(  x, y, f, c)	= 0.0;
-					VelocityFilterAt(x, y, f, c)	= 0.0;
-					DeltaFilterAt(   x, y, f, c)	= 0.0;
-				}
+					FilterAt(x, y, f, c)	= (Real)pow(dist(mt), 2);
 			}
-			BiasAt(f, c)			= pow(dist(mt), 2);
-			MomentBiasAt(f, c)		= 0.0;
-			VelocityBiasAt(f, c)	= 0.0;
-			DeltaBiasAt(f, c)		= 0.0;
+			BiasAt(f, c)	= (Real)pow(dist(mt), 2);
 		}
 	}
+
+	m_WinogradValid	= false;
+
+	// 3x3, ストライド1 は Winograd, それ以外でフィルタ数 x チャンネル数が
+	// 大きいときは行列積で計算する.
+	if ((filterSize == 3) && (stride == 1))
+		SetEngine(WinogradEngine);
+	else if (filterNum*channel >= CONV_GEMM_THRESHOLD)
+		SetEngine(GemmEngine);
+	else
+		SetEngine(DirectEngine);
 }
 
 //----------------------------------------------------------------------
 /**
- * 前方出力
+ * 動作モードの設定
+ * -差分・Adam の状態は NeuralNet が平坦な領域に確保する
  *
- * @param  input  入力値配列
- * @param  output 出力値受取配列
+ * @param mode 動作モード
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::SetMode(Mode mode)
+{
+	Layer::SetMode(mode);
+
+	// 計算方式ごとの作業領域も作り直す.
+	SetEngine(m_Engine);
+}
+
+//----------------------------------------------------------------------
+/**
+ * フィルタ・バイアスの位置の設定
+ * -学習する値の領域をフィルタ(フィルタ数 x チャンネル数 x F x F),
+ *  バイアス(フィルタ数 x チャンネル数)に分ける
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::UpdateParamView(void)
+{
+	const unsigned int	filterNum	= m_Channel*m_FilterNum*m_FilterSize*m_FilterSize;
+
+	m_pFilter			= m_pParam;
+	m_pBias				= m_pParam + filterNum;
+	m_pDeltaFilter		= m_pDeltaParam;
+	m_pDeltaBias		= (m_pDeltaParam != NULL) ? m_pDeltaParam + filterNum : NULL;
+	m_pMomentFilter		= m_pMomentParam;
+	m_pMomentBias		= (m_pMomentParam != NULL) ? m_pMomentParam + filterNum : NULL;
+	m_pVelocityFilter	= m_pVelocityParam;
+	m_pVelocityBias		= (m_pVelocityParam != NULL) ? m_pVelocityParam + filterNum : NULL;
+	m_WinogradValid		= false;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 計算方式の設定
+ * -Winograd は 3x3, ストライド1 以外では行列積に切り替える
+ * -推論専用なら後方出力だけで使う作業領域は確保しない
+ *
+ * @param engine 計算方式
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::SetEngine(Engine engine)
+{
+	const unsigned int	k			= m_Channel*m_FilterSize*m_FilterSize;
+	const unsigned int	n			= m_WMax*m_HMax;
+	const bool			training	= (m_Mode == Mode::TrainingMode);
+
+	if ((engine == WinogradEngine)
+	 && ((m_FilterSize != 3) || (m_Stride != 1)))
+		engine	= GemmEngine;
+
+	m_Engine	= engine;
+
+	ReleaseArray(m_Column);
+	ReleaseArray(m_DeltaColumn);
+	ReleaseArray(m_WinogradFilter);
+	ReleaseArray(m_WinogradBackFilter);
+
+	switch (m_Engine)
+	{
+	  case GemmEngine:
+		m_Column.resize(k * n);
+		if (training)
+			m_DeltaColumn.resize(k * n);
+		break;
+
+	  case WinogradEngine:
+		// フィルタ差分は im2col + 行列積で求める.
+		// パディングなしの入力差分は 0 の多いタイルになるので行列積で求める.
+		if (training)
+		{
+			m_Column.resize(k * n);
+			if (m_Padding == 0)
+				m_DeltaColumn.resize(k * n);
+			else
+				m_WinogradBackFilter.resize(m_FilterNum*m_Channel*16);
+		}
+		// 変換後フィルタは 4x4.
+		m_WinogradFilter.resize(m_FilterNum*m_Channel*16);
+		m_WinogradValid	= false;
+		break;
+
+	  default:
+		break;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * Winograd 変換後フィルタの更新
+ * -フィルタが変更されたときだけ作り直す
  */
 //----------------------------------------------------------------------
-void NeuralNet::ConvolutionLayer::Forward(const std::vector<double> &input,
-										  std::vector<double>       &output)
+void NeuralNet::ConvolutionLayer::UpdateWinogradFilter(void)
 {
-	if (input.size() != m_InputNum)
+	if (m_WinogradValid)
 		return;
-	
-	output.resize(m_OutputNum);
 
+	WinogradFilterTransform(&m_WinogradFilter[0],
+							m_pFilter,
+							m_FilterNum,
+							m_Channel,
+							false);
+
+	// 回転フィルタはパディングありの後方出力だけで使う.
+	if (!m_WinogradBackFilter.empty())
+	{
+		WinogradFilterTransform(&m_WinogradBackFilter[0],
+								m_pFilter,
+								m_FilterNum,
+								m_Channel,
+								true);
+	}
+
+	m_WinogradValid	= true;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::Forward(const Real *pInput,
+										  Real       *pOutput)
+{
+	ForwardEngine(pInput, pOutput);
+
+	// 出力が L1 にあるうちに活性化する.
+	Activation<Real>	activation;
+
+	if (GetActivation(activation))
+		Activate(pOutput, m_OutputNum, activation);
+
+	// 学習用に入力値を参照しておく.
+	m_pInput	= pInput;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力(N 件)
+ * -1 件ごとの畳み込み自体が行列積(Winograd)なので件ごとに計算する
+ *
+ * @param  pInput   入力値配列(batchNum x 入力数)
+ * @param  pOutput  出力値受取配列(batchNum x 出力数)
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::ForwardBatch(const Real   *pInput,
+											   Real         *pOutput,
+											   unsigned int batchNum)
+{
+	for (unsigned int b = 0; b < batchNum; ++b)
+		ForwardEngine(pInput + b*m_InputNum, pOutput + b*m_OutputNum);
+
+	Activation<Real>	activation;
+
+	if (GetActivation(activation, batchNum))
+		ActivateBatch(pOutput, m_OutputNum, batchNum, activation);
+
+	// 学習用に入力値を参照しておく.
+	m_pInput	= pInput;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力(計算方式ごと, 活性化前)
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::ForwardEngine(const Real *pInput,
+												Real       *pOutput)
+{
+	switch (m_Engine)
+	{
+	  case GemmEngine:
+		ForwardGemm(pInput, pOutput, &m_Column[0]);
+		break;
+
+	  case WinogradEngine:
+		UpdateWinogradFilter();
+		ForwardWinograd(pInput, pOutput);
+		break;
+
+	  default:
+		ForwardDirect(pInput, pOutput);
+		break;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 推論専用の前方出力
+ * -層の状態を書き換えない(複数スレッドから同時に呼べる)
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pWork   作業領域(GetWorkNum() 要素)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::Evaluate(const Real *pInput,
+										   Real       *pOutput,
+										   Real       *pWork) const
+{
+	// 変換後フィルタが古ければ(重みの変更後)行列積で計算する.
+	if ((m_Engine == WinogradEngine) && m_WinogradValid)
+		ForwardWinograd(pInput, pOutput);
+	else if (m_Engine != DirectEngine)
+		ForwardGemm(pInput, pOutput, pWork);
+	else
+		ForwardDirect(pInput, pOutput);
+
+	Activation<Real>	activation;
+
+	if (GetActivation(activation))
+	{
+		activation.pMask	= NULL;
+		Activate(pOutput, m_OutputNum, activation);
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 推論専用の前方出力の作業領域の要素数
+ * -行列積(Winograd の代替を含む)の展開用
+ *
+ * @return 要素数
+ */
+//----------------------------------------------------------------------
+unsigned int NeuralNet::ConvolutionLayer::GetWorkNum(void) const
+{
+	if (m_Engine == DirectEngine)
+		return (0);
+
+	return (m_Channel*m_FilterSize*m_FilterSize * m_WMax*m_HMax);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力(直接ループ)
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::ForwardDirect(const Real *pInput,
+												Real       *pOutput) const
+{
 	// 横幅.
 	for (unsigned int w = 0; w < m_WMax; ++w)
 	{
@@ -439,7 +1115,7 @@ void NeuralNet::ConvolutionLayer::Forward(const std::vector<double> &input,
 			{
 				int	outputIndex	= OutputIndex(w, h, f);
 				
-				output[outputIndex]	= 0.0;
+				pOutput[outputIndex]	= 0.0;
 			}
 		}
 	}
@@ -475,46 +1151,200 @@ void NeuralNet::ConvolutionLayer::Forward(const std::vector<double> &input,
 							
 							int	inputIndex	= InputIndex(iW, iH, c);
 
-							output[outputIndex]	+=
-								input[inputIndex]
+							pOutput[outputIndex]	+=
+								pInput[inputIndex]
 								* FilterAt(i, j, f, c);
 						}
 					}
-					output[outputIndex]	+= GetBias(f, c);
+					pOutput[outputIndex]	+= GetBias(f, c);
 				}
 			}
 		}
-		
-		// 横幅.
-		for (unsigned int w = 0; w < m_Width; ++w)
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力(im2col + 行列積)
+ * -入力をパッチ行列 P((c,i,j) x (w,h)) に展開し,
+ *  出力 = フィルタ(f x (c,i,j)) * P をまとめて求める
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pColumn パッチ行列の展開先
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::ForwardGemm(const Real *pInput,
+											  Real       *pOutput,
+											  Real       *pColumn) const
+{
+	const unsigned int	k	= m_Channel*m_FilterSize*m_FilterSize;
+	const unsigned int	n	= m_WMax*m_HMax;
+
+	Im2Col(pColumn,
+		   pInput,
+		   m_Width,
+		   m_Height,
+		   m_Channel,
+		   m_FilterSize,
+		   m_Stride,
+		   m_Padding);
+
+	// バイアス(チャンネル分の総和)で初期化.
+	for (unsigned int f = 0; f < m_FilterNum; ++f)
+	{
+		Real	bias	= 0;
+
+		for (unsigned int c = 0; c < m_Channel; ++c)
+			bias	+= BiasAt(f, c);
+
+		for (unsigned int i = 0; i < n; ++i)
+			pOutput[f*n+i]	= bias;
+	}
+
+	MatrixMultiply(pOutput,
+				   m_pFilter,
+				   pColumn,
+				   m_FilterNum,
+				   n,
+				   k,
+				   false,
+				   false);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力(Winograd F(2x2,3x3))
+ * -出力 2x2 ごとに 4x4 の入力タイルを変換し, 要素積 16 回で求める
+ *  (直接計算の 36 回に対して乗算数 1/2.25)
+ * -変換後フィルタは作成済みであること
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::ForwardWinograd(const Real *pInput,
+												  Real       *pOutput) const
+{
+	const unsigned int	n	= m_WMax*m_HMax;
+
+	WinogradConvolution(pOutput,
+						pInput,
+						&m_WinogradFilter[0],
+						m_Width,
+						m_Height,
+						m_Channel,
+						m_WMax,
+						m_HMax,
+						m_FilterNum,
+						(int)m_Padding);
+
+	// バイアス(チャンネル分の総和)を加算.
+	for (unsigned int f = 0; f < m_FilterNum; ++f)
+	{
+		Real	bias	= 0;
+
+		for (unsigned int c = 0; c < m_Channel; ++c)
+			bias	+= BiasAt(f, c);
+
+		for (unsigned int i = 0; i < n; ++i)
+			pOutput[f*n+i]	+= bias;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後方出力
+ *
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::Backward(const Real *pDelta,
+										   Real       *pOutput)
+{
+	BackwardEngine(FusedDelta(pDelta), pOutput);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後方出力(N 件)
+ * -フィルタ差分には N 件分を加算する
+ *
+ * @param  pDelta   出力差分値配列(batchNum x 出力数)
+ * @param  pOutput  出力値受取配列(batchNum x 入力数)
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::BackwardBatch(const Real   *pDelta,
+												Real         *pOutput,
+												unsigned int batchNum)
+{
+	const Real	*pPreDelta	= FusedDelta(pDelta, batchNum);
+	const Real	*pInput		= m_pInput;
+
+	// 展開済みの m_Column は最後の 1 件のものなので,
+	// 最後の件から逆順に計算し, それ以外は展開し直す.
+	for (unsigned int b = batchNum; b-- > 0;)
+	{
+		m_pInput	= pInput + b*m_InputNum;
+
+		if ((m_Engine == GemmEngine) && (b + 1 < batchNum))
 		{
-			// 高さ
-			for (unsigned int h = 0; h < m_Height; ++h)
-			{
-				unsigned int inputIndex	= InputIndex(w, h, c);
-				
-				InputAt(inputIndex)	= input[inputIndex];
-			}
+			Im2Col(&m_Column[0],
+				   m_pInput,
+				   m_Width,
+				   m_Height,
+				   m_Channel,
+				   m_FilterSize,
+				   m_Stride,
+				   m_Padding);
 		}
+
+		BackwardEngine(pPreDelta + b*m_OutputNum, pOutput + b*m_InputNum);
 	}
+
+	m_pInput	= pInput;
 }
 
 //----------------------------------------------------------------------
 /**
- * 後方出力
+ * 後方出力(計算方式ごと, 活性化の微分をかけた差分を使う)
  *
- * @param  delta  出力差分値配列
- * @param  output 出力値受取配列
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::ConvolutionLayer::Backward(const std::vector<double> &delta,
-										   std::vector<double>       &output)
+void NeuralNet::ConvolutionLayer::BackwardEngine(const Real *pDelta,
+												 Real       *pOutput)
 {
-	if (delta.size() != m_OutputNum)
-		return;
+	switch (m_Engine)
+	{
+	  case GemmEngine:
+		BackwardGemm(pDelta, pOutput);
+		break;
+
+	  case WinogradEngine:
+		BackwardWinograd(pDelta, pOutput);
+		break;
 
-	output.resize(m_InputNum);
+	  default:
+		BackwardDirect(pDelta, pOutput);
+		break;
+	}
+}
 
+//----------------------------------------------------------------------
+/**
+ * 後方出力(直接ループ)
+ *
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ConvolutionLayer::BackwardDirect(const Real *pDelta,
+												 Real       *pOutput)
+{
 	// チャンネル数ループ
 	for (unsigned int c = 0; c < m_Channel; ++c)
 	{
@@ -526,7 +1356,7 @@ void NeuralNet::ConvolutionLayer::Backward(const std::vector<double> &delta,
 			{
 				int	inputIndex	= InputIndex(w, h, c);
 
-				output[inputIndex]	= 0.0;
+				pOutput[inputIndex]	= 0.0;
 			}
 		}
 	}
@@ -545,33 +1375,33 @@ void NeuralNet::ConvolutionLayer::Backward(const std::vector<double> &delta,
 				{
 					int outputIndex	= OutputIndex(w, h, f);
 
-					// フィルタ計算.
+					// フィルタ計算(前方出力と同じ位置に戻す).
 					for (unsigned int i = 0; i < m_FilterSize; ++i)
 					{
-						int	iW	= w*m_Stride-i+m_Padding;
+						int	iW	= w*m_Stride+i-m_Padding;
 
 						if ((iW < 0) || (iW >= (int)m_Width))
 							continue;
 						
 						for (unsigned int j = 0; j < m_FilterSize; ++j)
 						{
-							int	iH	= h*m_Stride-j+m_Padding;
+							int	iH	= h*m_Stride+j-m_Padding;
 
 							if ((iH < 0) || (iH >= (int)m_Height))
 								continue;
 
 							int	inputIndex	= InputIndex(iW, iH, c);
 							
-							output[inputIndex]	+= delta[outputIndex]
-												 * FilterBackAt(i, j, f, c);
+							pOutput[inputIndex]	+= pDelta[outputIndex]
+												  * FilterAt(i, j, f, c);
 
 							DeltaFilterAt(i, j, f, c)	+=
-								delta[outputIndex]
+								pDelta[outputIndex]
 							   * InputAt(inputIndex);
 						}
 					}
 
-					DeltaBiasAt(f, c)	+= delta[outputIndex];
+					DeltaBiasAt(f, c)	+= pDelta[outputIndex];
 				}
 			}
 		}
@@ -580,107 +1410,148 @@ void NeuralNet::ConvolutionLayer::Backward(const std::vector<double> &delta,
 
 //----------------------------------------------------------------------
 /**
- * 学習
+ * 後方出力(im2col + 行列積)
+ * -フィルタ差分 += 差分(f x (w,h)) * P^T
+ * -入力差分     =  col2im(フィルタ^T * 差分)
  *
- * @param learnRatio 学習率
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::ConvolutionLayer::Learn(double learnRatio)
+void NeuralNet::ConvolutionLayer::BackwardGemm(const Real *pDelta,
+											   Real       *pOutput)
 {
-	// フィルタ数ループ
+	const unsigned int	k	= m_Channel*m_FilterSize*m_FilterSize;
+	const unsigned int	n	= m_WMax*m_HMax;
+
+	// m_Column は直前の前方出力で展開したもの.
+	MatrixMultiply(m_pDeltaFilter,
+				   pDelta,
+				   &m_Column[0],
+				   m_FilterNum,
+				   k,
+				   n,
+				   false,
+				   true);
+
+	std::fill(m_DeltaColumn.begin(), m_DeltaColumn.end(), (Real)0);
+
+	MatrixMultiply(&m_DeltaColumn[0],
+				   m_pFilter,
+				   pDelta,
+				   k,
+				   n,
+				   m_FilterNum,
+				   true,
+				   false);
+
+	std::fill(pOutput, pOutput + m_InputNum, (Real)0);
+
+	Col2Im(pOutput,
+		   &m_DeltaColumn[0],
+		   m_Width,
+		   m_Height,
+		   m_Channel,
+		   m_FilterSize,
+		   m_Stride,
+		   m_Padding);
+
 	for (unsigned int f = 0; f < m_FilterNum; ++f)
 	{
-		// チャンネル数ループ
+		Real	total	= 0;
+
+		for (unsigned int i = 0; i < n; ++i)
+			total	+= pDelta[f*n+i];
+
 		for (unsigned int c = 0; c < m_Channel; ++c)
-		{
-			// フィルタ計算.
-			for (unsigned int i = 0; i < m_FilterSize; ++i)
-			{
-				for (unsigned int j = 0; j < m_FilterSize; ++j)
-				{
-					FilterAt(i, j, f, c) += DeltaFilterAt(i, j, f, c)
-										  * learnRatio;
-					DeltaFilterAt(i, j, f, c)	= 0.0;
-				}
-			}
-			
-			BiasAt(f, c)		+= DeltaBiasAt(f, c)
-								 * learnRatio;
-			DeltaBiasAt(f, c)	=  0.0;
-		}
+			DeltaBiasAt(f, c)	+= total;
 	}
 }
 
-
 //----------------------------------------------------------------------
 /**
- * Adam学習
+ * 後方出力(Winograd F(2x2,3x3))
+ * -入力差分 = 差分(フィルタ数チャンネル)と 180 度回転したフィルタの
+ *  畳み込み(パディング 2-padding)
+ *  パディングなしのときはタイルの大半が 0 になるので col2im で求める
+ * -フィルタ差分は im2col + 行列積で求める
  *
- * @param alpha    係数更新率
- * @param beta1    モーメント更新率
- * @param beta2    速度更新率
- * @param epsilon  誤差値
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::ConvolutionLayer::LearnAdam(double alpha,
-											double beta1,
-											double beta2,
-											double epsilon)
+void NeuralNet::ConvolutionLayer::BackwardWinograd(const Real *pDelta,
+												   Real       *pOutput)
 {
-	// フィルタ数ループ
+	const unsigned int	k	= m_Channel*m_FilterSize*m_FilterSize;
+	const unsigned int	n	= m_WMax*m_HMax;
+
+	if (m_Padding > 0)
+	{
+		UpdateWinogradFilter();
+
+		WinogradConvolution(pOutput,
+							pDelta,
+							&m_WinogradBackFilter[0],
+							m_WMax,
+							m_HMax,
+							m_FilterNum,
+							m_Width,
+							m_Height,
+							m_Channel,
+							2 - (int)m_Padding);
+	}
+	else {
+		std::fill(m_DeltaColumn.begin(), m_DeltaColumn.end(), (Real)0);
+
+		MatrixMultiply(&m_DeltaColumn[0],
+					   m_pFilter,
+					   pDelta,
+					   k,
+					   n,
+					   m_FilterNum,
+					   true,
+					   false);
+
+		std::fill(pOutput, pOutput + m_InputNum, (Real)0);
+
+		Col2Im(pOutput,
+			   &m_DeltaColumn[0],
+			   m_Width,
+			   m_Height,
+			   m_Channel,
+			   m_FilterSize,
+			   m_Stride,
+			   m_Padding);
+	}
+
+	Im2Col(&m_Column[0],
+		   m_pInput,
+		   m_Width,
+		   m_Height,
+		   m_Channel,
+		   m_FilterSize,
+		   m_Stride,
+		   m_Padding);
+
+	MatrixMultiply(m_pDeltaFilter,
+				   pDelta,
+				   &m_Column[0],
+				   m_FilterNum,
+				   k,
+				   n,
+				   false,
+				   true);
+
 	for (unsigned int f = 0; f < m_FilterNum; ++f)
 	{
-		// チャンネル数ループ
-		for (unsigned int c = 0; c < m_Channel; ++c)
-		{
-			// フィルタ計算.
-			for (unsigned int i = 0; i < m_FilterSize; ++i)
-			{
-				for (unsigned int j = 0; j < m_FilterSize; ++j)
-				{
-					MomentFilterAt(i, j, f, c)	=
-						beta1
-					   *MomentFilterAt(i, j, f, c)
-					   +(1.0-beta1)
-					   *DeltaFilterAt(i, j, f, c);
-					VelocityFilterAt(i, j, f, c)	=
-						beta2
-					   *VelocityFilterAt(i, j, f, c)
-					   +(1.0-beta2)
-					   *pow(DeltaFilterAt(i, j, f, c), 2);
-
-					const double	m	= MomentFilterAt(  i, j, f, c)
-										/ (1.0-beta1);
-					const double	v	= VelocityFilterAt(i, j, f, c)
-										/ (1.0-beta2);
-
-					FilterAt(i, j, f, c)	+= alpha * m
-											/ (sqrt(v) + epsilon);
-
-					DeltaFilterAt(i, j, f, c)	= 0.0;
-				}
-			}
+		Real	total	= 0;
 
-			MomentBiasAt(f, c)	=
-						beta1
-					   *MomentBiasAt(f, c)
-					   +(1.0-beta1)
-					   *DeltaBiasAt( f, c);
-			VelocityBiasAt(f, c)	=
-						beta2
-					   *VelocityBiasAt(f, c)
-					   +(1.0-beta2)
-					   *pow(DeltaBiasAt(f, c), 2);
-
-			const double	m	= MomentBiasAt(  f, c)
-								/ (1.0-beta1);
-			const double	v	= VelocityBiasAt(f, c)
-								/ (1.0-beta2);
-
-			BiasAt(f, c)		+= alpha * m
-								/ (sqrt(v) + epsilon);
-			DeltaBiasAt(f, c)	=  0.0;
-		}
+		for (unsigned int i = 0; i < n; ++i)
+			total	+= pDelta[f*n+i];
+
+		for (unsigned int c = 0; c < m_Channel; ++c)
+			DeltaBiasAt(f, c)	+= total;
 	}
 }
 
@@ -688,18 +1559,54 @@ void NeuralNet::ConvolutionLayer::LearnAdam(double alpha,
 /**
  * 前方出力
  *
- * @param  input  入力値配列
- * @param  output 出力値受取配列
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::MaxPoolingLayer::Forward(const std::vector<double> &input,
-										 std::vector<double>       &output)
+void NeuralNet::MaxPoolingLayer::Forward(const Real *pInput,
+										 Real       *pOutput)
 {
-	if (input.size() != m_InputNum)
-		return;
-	
-	output.resize(m_OutputNum);
+	ForwardSample(pInput, pOutput, &m_Mask[0]);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力(N 件)
+ *
+ * @param  pInput   入力値配列(batchNum x 入力数)
+ * @param  pOutput  出力値受取配列(batchNum x 出力数)
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::MaxPoolingLayer::ForwardBatch(const Real   *pInput,
+											  Real         *pOutput,
+											  unsigned int batchNum)
+{
+	// 縮めない(件数を戻しても再確保しない).
+	if (m_Mask.size() < m_OutputNum * batchNum)
+		m_Mask.resize(m_OutputNum * batchNum);
+
+	for (unsigned int b = 0; b < batchNum; ++b)
+	{
+		ForwardSample(pInput  + b*m_InputNum,
+					  pOutput + b*m_OutputNum,
+					  &m_Mask[b*m_OutputNum]);
+	}
+}
 
+//----------------------------------------------------------------------
+/**
+ * 前方出力(1 件)
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pMask   選んだ入力番号の受取配列(出力数, 推論専用なら NULL)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::MaxPoolingLayer::ForwardSample(const Real   *pInput,
+											   Real         *pOutput,
+											   unsigned int *pMask) const
+{
 	// チャンネル数ループ
 	for (unsigned int c = 0; c < m_Channel; ++c)
 	{
@@ -709,18 +1616,18 @@ void NeuralNet::MaxPoolingLayer::Forward(const std::vector<double> &input,
 			// 高さ
 			for (unsigned int h = 0; h < m_HMax; ++h)
 			{
-				int	outputIndex	= OutputIndex(w, h, c);
+				int				outputIndex	= OutputIndex(w, h, c);
+				unsigned int	selected	= InputIndex(w*m_Stride,
+														 h*m_Stride,
+														 c);
 
-				m_Mask[outputIndex]	= InputIndex(w*m_Stride,
-												 h*m_Stride,
-												 c);
-				if (m_Mask[outputIndex] < m_InputNum)
+				if (selected < m_InputNum)
 				{
-					output[outputIndex] =
-						input[m_Mask[outputIndex]];
+					pOutput[outputIndex] =
+						pInput[selected];
 				}
 				else {
-					output[outputIndex] = 0.0;
+					pOutput[outputIndex] = 0.0;
 				}
 
 				// フィルタ計算.
@@ -740,13 +1647,16 @@ void NeuralNet::MaxPoolingLayer::Forward(const std::vector<double> &input,
 
 						int	inputIndex	= InputIndex(iW, iH, c);
 
-						if (input[inputIndex] > output[outputIndex])
+						if (pInput[inputIndex] > pOutput[outputIndex])
 						{
-							output[outputIndex]	= input[inputIndex];
-							m_Mask[outputIndex]	= inputIndex;
+							pOutput[outputIndex]	= pInput[inputIndex];
+							selected				= inputIndex;
 						}
 					}
 				}
+
+				if (pMask != NULL)
+					pMask[outputIndex]	= selected;
 			}
 		}
 	}
@@ -756,18 +1666,67 @@ void NeuralNet::MaxPoolingLayer::Forward(const std::vector<double> &input,
 /**
  * 後方出力
  *
- * @param  delta  出力差分値配列
- * @param  output 出力値受取配列
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
  */
 //----------------------------------------------------------------------
-void NeuralNet::MaxPoolingLayer::Backward(const std::vector<double> &delta,
-										  std::vector<double>       &output)
+void NeuralNet::MaxPoolingLayer::Backward(const Real *pDelta,
+										  Real       *pOutput)
 {
-	if (delta.size() != m_OutputNum)
-		return;
+	BackwardSample(pDelta, pOutput, &m_Mask[0]);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 推論専用の前方出力
+ * -層の状態を書き換えない(複数スレッドから同時に呼べる)
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pWork   作業領域(GetWorkNum() 要素)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::MaxPoolingLayer::Evaluate(const Real *pInput,
+										  Real       *pOutput,
+										  Real       *pWork) const
+{
+	ForwardSample(pInput, pOutput, NULL);
+}
 
-	output.resize(m_InputNum);
+//----------------------------------------------------------------------
+/**
+ * 後方出力(N 件)
+ *
+ * @param  pDelta   出力差分値配列(batchNum x 出力数)
+ * @param  pOutput  出力値受取配列(batchNum x 入力数)
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::MaxPoolingLayer::BackwardBatch(const Real   *pDelta,
+											   Real         *pOutput,
+											   unsigned int batchNum)
+{
+	for (unsigned int b = 0; b < batchNum; ++b)
+	{
+		BackwardSample(pDelta  + b*m_OutputNum,
+					   pOutput + b*m_InputNum,
+					   &m_Mask[b*m_OutputNum]);
+	}
+}
 
+//----------------------------------------------------------------------
+/**
+ * 後方出力(1 件)
+ *
+ * @param  pDelta  出力差分値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pMask   前方出力で選んだ入力番号の配列(出力数)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::MaxPoolingLayer::BackwardSample(const Real         *pDelta,
+												Real               *pOutput,
+												const unsigned int *pMask)
+{
 	// チャンネル数ループ
 	for (unsigned int c = 0; c < m_Channel; ++c)
 	{
@@ -779,7 +1738,7 @@ void NeuralNet::MaxPoolingLayer::Backward(const std::vector<double> &delta,
 			{
 				int	inputIndex	= InputIndex(w, h, c);
 
-				output[inputIndex]	= 0.0;
+				pOutput[inputIndex]	= 0.0;
 			}
 		}
 	}
@@ -795,7 +1754,7 @@ void NeuralNet::MaxPoolingLayer::Backward(const std::vector<double> &delta,
 			{
 				int outputIndex	= OutputIndex(w, h, c);
 
-				output[m_Mask[outputIndex]]	+= delta[outputIndex];
+				pOutput[pMask[outputIndex]]	+= pDelta[outputIndex];
 			}
 		}
 	}
@@ -806,7 +1765,20 @@ void NeuralNet::MaxPoolingLayer::Backward(const std::vector<double> &delta,
  * コンストラクタ
  */
 //----------------------------------------------------------------------
-NeuralNet::NeuralNet()
+NeuralNet::NeuralNet() :
+m_SparseInput(false),
+m_BatchNum(0),
+m_AccumulatorDepth(0),
+m_Mode(Mode::TrainingMode),
+m_Accuracy(AccuracyExact),
+m_pParam(NULL),
+m_ParamNum(0),
+m_pValue(NULL),
+m_pState(NULL),
+m_LearnStep(0),
+m_NormMode(NormMode::NoNorm),
+m_NormLimit(0.0),
+m_DeltaNorm(0.0)
 {
 }
 
@@ -885,7 +1857,7 @@ bool NeuralNet::AddRReLULayer(unsigned int inputNum)
 bool NeuralNet::AddLReLULayer(unsigned int inputNum, double alpha)
 {
 	m_Layer.push_back(std::shared_ptr<LReLULayer>
-					  (new LReLULayer(inputNum, alpha)));
+					  (new LReLULayer(inputNum, (Real)alpha)));
 
 	return (CheckAddLayerConnect());
 }
@@ -960,238 +1932,1338 @@ bool NeuralNet::AddConvolutionLayer(unsigned int width,
 											stride,
 											padding)));
 
-	return (CheckAddLayerConnect());
+	return (CheckAddLayerConnect());
+}
+
+//----------------------------------------------------------------------
+/**
+ * プーリング(最大値選出)層の追加
+ * -width x height x chanel が入力になる
+ * -((height+2*padding-filterSize)/stride+1)
+ *  x((width+2*padding-filterSize)/stride+1)
+ *  x channel が出力になる
+ *
+ * @param width      入力の横幅
+ * @param height     入力の高さ
+ * @param channel    入力のチャンネル数
+ * @param filterSize フィルタのサイズ
+ * @param stride     フィルタの移動幅
+ * @param padding    パディングの幅
+ *
+ * @return           成否
+ */
+//----------------------------------------------------------------------
+bool NeuralNet::AddMaxPoolingLayer(unsigned int width,
+								   unsigned int height,
+								   unsigned int channel,
+								   unsigned int filterSize,
+								   unsigned int stride,
+								   unsigned int padding)
+{
+	m_Layer.push_back(std::shared_ptr<MaxPoolingLayer>
+					  (new MaxPoolingLayer(width,
+										   height,
+										   channel,
+										   filterSize,
+										   stride,
+										   padding)));
+
+	return (CheckAddLayerConnect());
+}
+
+//----------------------------------------------------------------------
+/**
+ * 入力値の設定
+ *
+ * @param input      入力値の配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::SetInput(const std::vector<double> &input)
+{
+	m_Input.assign(input.begin(), input.end());
+
+	// 盤面のような 0/1 入力は疎入力として扱う.
+	m_SparseInput	= FindActiveInput(input, m_Active);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 0/1 入力の判定
+ *
+ * @param input      入力値の配列
+ * @param active     値が 1 の入力番号の受取
+ *
+ * @return           すべて 0 か 1 か
+ */
+//----------------------------------------------------------------------
+bool NeuralNet::FindActiveInput(const std::vector<double>  &input,
+								std::vector<unsigned int> &active)
+{
+	active.clear();
+	for (unsigned int i = 0; i < input.size(); ++i)
+	{
+		if (input[i] == 1.0)
+			active.push_back(i);
+		else if (input[i] != 0.0)
+			return (false);
+	}
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 疎入力値の設定
+ * -指定した番号の入力を 1, それ以外を 0 とする
+ *
+ * @param active     値が 1 の入力番号の配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::SetSparseInput(const std::vector<unsigned int> &active)
+{
+	m_Input.assign(GetInputNum(), 0);
+	for (unsigned int a = 0; a < active.size(); ++a)
+	{
+		if (active[a] < m_Input.size())
+			m_Input[active[a]]	= 1;
+	}
+
+	m_SparseInput	= true;
+	m_Active		= active;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 出力値の取得
+ *
+ * @param output   出力値の配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::GetOutput(std::vector<double> &output) const
+{
+	if (m_Layer.size() == 0)
+		return;
+
+	output.assign(m_Output.begin(), m_Output.end());
+}
+
+//----------------------------------------------------------------------
+/**
+ * 入力値の設定(N 件)
+ * -入力数と合わない件があれば件数を 0 にする
+ *
+ * @param input      1 件ごとの入力値の配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::SetInputBatch(const std::vector<std::vector<double>> &input)
+{
+	const unsigned int	inputNum	= GetInputNum();
+
+	m_BatchNum	= 0;
+	m_BatchInput.resize(input.size() * inputNum);
+
+	for (unsigned int b = 0; b < input.size(); ++b)
+	{
+		if (input[b].size() != inputNum)
+			return;
+
+		std::copy(input[b].begin(), input[b].end(), &m_BatchInput[b*inputNum]);
+	}
+
+	m_BatchNum	= input.size();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 出力値の取得(N 件)
+ *
+ * @param output   1 件ごとの出力値の配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::GetOutputBatch(std::vector<std::vector<double>> &output) const
+{
+	const unsigned int	outputNum	= GetOutputNum();
+
+	if (m_BatchOutput.size() < m_BatchNum * outputNum)
+		return;
+
+	output.resize(m_BatchNum);
+	for (unsigned int b = 0; b < m_BatchNum; ++b)
+	{
+		output[b].assign(m_BatchOutput.begin() + b*outputNum,
+						 m_BatchOutput.begin() + (b+1)*outputNum);
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 損失値の計算
+ *
+ * @param teacher   教師信号の配列
+ *
+ * @return          二乗誤差の総和
+ */
+//----------------------------------------------------------------------
+double NeuralNet::CalcSquareLoss(const std::vector<double> &teacher)
+{
+	double	lossSum	= 0.0;
+	
+	m_Loss.resize(teacher.size());
+	
+	for (unsigned int i = 0; i < teacher.size(); ++i)
+	{
+		m_Loss[i]	= (Real)(teacher[i] - m_Output[i]);
+
+		lossSum		+= m_Loss[i] * m_Loss[i];
+		//lossSum		+= -teacher[i] * log(m_Output[i] + 1.0e-7);
+	}
+
+	return (lossSum);
+}
+
+//----------------------------------------------------------------------
+/**
+* 損失値の計算
+*
+* @param teacher   教師信号の配列
+*
+* @return          クロスエントロピー誤差の総和
+*/
+//----------------------------------------------------------------------
+double NeuralNet::CalcCrossEntropyLoss(const std::vector<double> &teacher)
+{
+	double	lossSum = 0.0;
+
+	m_Loss.resize(teacher.size());
+
+	for (unsigned int i = 0; i < teacher.size(); ++i)
+	{
+		m_Loss[i] = (Real)(teacher[i] - m_Output[i]);
+
+		lossSum		+= -teacher[i] * log(m_Output[i] + 1.0e-7);
+	}
+
+	return (lossSum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 損失値の計算(N 件)
+ *
+ * @param teacher   1 件ごとの教師信号の配列
+ *
+ * @return          二乗誤差の総和(N 件分)
+ */
+//----------------------------------------------------------------------
+double NeuralNet::CalcSquareLossBatch(const std::vector<std::vector<double>> &teacher)
+{
+	const unsigned int	outputNum	= GetOutputNum();
+	double				lossSum		= 0.0;
+
+	m_BatchLoss.resize(m_BatchNum * outputNum);
+
+	for (unsigned int b = 0; (b < m_BatchNum) && (b < teacher.size()); ++b)
+	{
+		const Real	*pOutput	= &m_BatchOutput[b*outputNum];
+		Real		*pLoss		= &m_BatchLoss[b*outputNum];
+
+		for (unsigned int i = 0; i < outputNum; ++i)
+		{
+			pLoss[i]	=  (Real)(teacher[b][i] - pOutput[i]);
+			lossSum		+= pLoss[i] * pLoss[i];
+		}
+	}
+
+	return (lossSum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 損失値の計算(N 件)
+ *
+ * @param teacher      1 件ごとの教師信号の配列
+ * @param pSampleLoss  1 件ごとの誤差の受取配列(N 要素, 不要なら NULL)
+ *
+ * @return             クロスエントロピー誤差の総和(N 件分)
+ */
+//----------------------------------------------------------------------
+double NeuralNet::CalcCrossEntropyLossBatch(const std::vector<std::vector<double>> &teacher,
+											double                                 *pSampleLoss)
+{
+	const unsigned int	outputNum	= GetOutputNum();
+	double				lossSum		= 0.0;
+
+	m_BatchLoss.resize(m_BatchNum * outputNum);
+
+	for (unsigned int b = 0; (b < m_BatchNum) && (b < teacher.size()); ++b)
+	{
+		const Real	*pOutput	= &m_BatchOutput[b*outputNum];
+		Real		*pLoss		= &m_BatchLoss[b*outputNum];
+		double		sampleLoss	= 0.0;
+
+		for (unsigned int i = 0; i < outputNum; ++i)
+		{
+			const double	loss	= -teacher[b][i] * log(pOutput[i] + 1.0e-7);
+
+			pLoss[i]	=  (Real)(teacher[b][i] - pOutput[i]);
+			lossSum		+= loss;
+			sampleLoss	+= loss;
+		}
+
+		if (pSampleLoss != NULL)
+			pSampleLoss[b]	= sampleLoss;
+	}
+
+	return (lossSum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Forward(void)
+{
+	if ((m_Layer.size() == 0)
+	||  (m_Input.size() != GetInputNum()))
+		return;
+
+	ForwardLayers(&m_Input[0], &m_Output[0], m_SparseInput);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力(呼び出し側の配列を直接使う)
+ * -入力・出力を複製しない. 内部の出力値(GetOutput, 損失計算)は更新しない
+ *
+ * @param  pInput  入力値配列(GetInputNum() 要素)
+ * @param  pOutput 出力値受取配列(GetOutputNum() 要素)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Forward(const Real *pInput, Real *pOutput)
+{
+	if (m_Layer.size() == 0)
+		return;
+
+	ForwardLayers(pInput, pOutput, false);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 各層の前方出力
+ * -層の間は作業領域を使い, 各層は前の層の出力を直接入力にする
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  sparse  m_Active を先頭層の疎入力に使うか
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ForwardLayers(const Real *pInput, Real *pOutput, bool sparse)
+{
+	const Real	*pLayerInput	= pInput;
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+	{ 
+		// 前の層にまとめた層は計算済み.
+		if (IsAbsorbed(i))
+			continue;
+
+		const unsigned int	next			= NextLayer(i);
+		Real				*pLayerOutput	= (next < m_Layer.size())
+											? &m_Activation[next][0]
+											: pOutput;
+
+		// 先頭層が疎入力に対応していなければ通常の前方出力.
+		if ((i > 0)
+		||  !sparse
+		||  !m_Layer[i]->ForwardSparse(m_Active, pLayerOutput))
+			m_Layer[i]->Forward(pLayerInput, pLayerOutput);
+
+		pLayerInput	= pLayerOutput;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後方出力
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Backward(void)
+{
+	if ((m_Layer.size() == 0)
+	||  (m_Mode != Mode::TrainingMode)
+	||  (m_Loss.size() != GetOutputNum()))
+		return;
+
+	const Real	*pDelta	= &m_Loss[0];
+
+	for(unsigned int i = 0, index = m_Layer.size()-1;
+		i < m_Layer.size();
+		++i, --index)
+	{
+		if (IsAbsorbed(index))
+			continue;
+
+		m_Layer[index]->Backward(pDelta, &m_Delta[index][0]);
+		pDelta	= &m_Delta[index][0];
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力(N 件)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ForwardBatch(void)
+{
+	if ((m_Layer.size() == 0)
+	||  (m_BatchNum == 0))
+		return;
+
+	m_BatchOutput.resize(m_BatchNum * GetOutputNum());
+
+	ForwardLayersBatch(&m_BatchInput[0], &m_BatchOutput[0], m_BatchNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力(N 件, 呼び出し側の配列を直接使う)
+ * -内部の出力値(GetOutputBatch, 損失計算)は更新しない
+ *
+ * @param  pInput   入力値配列(batchNum x GetInputNum())
+ * @param  pOutput  出力値受取配列(batchNum x GetOutputNum())
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ForwardBatch(const Real *pInput, Real *pOutput, unsigned int batchNum)
+{
+	if ((m_Layer.size() == 0)
+	||  (batchNum == 0))
+		return;
+
+	ForwardLayersBatch(pInput, pOutput, batchNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 推論(重みの共有)
+ * -ネットの状態を書き換えず, 層の間の値は実行状態に置く
+ *
+ * @param  pInput   入力値配列(GetInputNum() 要素)
+ * @param  pOutput  出力値受取配列(GetOutputNum() 要素)
+ * @param  context  実行状態(スレッドごと)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Evaluate(const Real       *pInput,
+						 Real             *pOutput,
+						 ExecutionContext &context) const
+{
+	if (m_Layer.size() == 0)
+		return;
+
+	PlanContext(context);
+	EvaluateLayers(pInput, pOutput, false, context);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 推論(重みの共有)
+ * -入力が 0/1 なら先頭層は疎入力で計算する
+ *
+ * @param  input    入力値の配列
+ * @param  output   出力値の受取
+ * @param  context  実行状態(スレッドごと)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Evaluate(const std::vector<double> &input,
+						 std::vector<double>       &output,
+						 ExecutionContext          &context) const
+{
+	if ((m_Layer.size() == 0)
+	||  (input.size() != GetInputNum()))
+		return;
+
+	PlanContext(context);
+
+	const bool	sparse	= FindActiveInput(input, context.m_Active);
+
+	context.m_Input.assign(input.begin(), input.end());
+	EvaluateLayers(&context.m_Input[0], &context.m_Output[0], sparse, context);
+
+	output.assign(context.m_Output.begin(), context.m_Output.end());
+}
+
+//----------------------------------------------------------------------
+/**
+ * 実行状態の作業領域の確保
+ * -足りないときだけ広げる(2 回目以降は確保しない)
+ *
+ * @param  context  実行状態
+ */
+//----------------------------------------------------------------------
+void NeuralNet::PlanContext(ExecutionContext &context) const
+{
+	unsigned int	workNum	= 0;
+
+	if (context.m_Activation.size() < m_Layer.size())
+		context.m_Activation.resize(m_Layer.size());
+
+	for (unsigned int k = 0; k < m_Layer.size(); ++k)
+	{
+		const unsigned int	inputNum	= m_Layer[k]->GetInputNum();
+
+		if ((k > 0) && (context.m_Activation[k].size() < inputNum))
+			context.m_Activation[k].resize(inputNum);
+
+		workNum	= std::max(workNum, m_Layer[k]->GetWorkNum());
+	}
+
+	// 作業領域がない層にも有効なポインタを渡す.
+	if (context.m_Work.size() < workNum + 1)
+		context.m_Work.resize(workNum + 1);
+
+	if (context.m_Output.size() != GetOutputNum())
+		context.m_Output.resize(GetOutputNum());
+
+	context.m_Active.reserve(GetInputNum());
+}
+
+//----------------------------------------------------------------------
+/**
+ * 各層の推論
+ *
+ * @param  pInput   入力値配列
+ * @param  pOutput  出力値受取配列
+ * @param  sparse   context.m_Active を先頭層の疎入力に使うか
+ * @param  context  実行状態
+ */
+//----------------------------------------------------------------------
+void NeuralNet::EvaluateLayers(const Real       *pInput,
+							   Real             *pOutput,
+							   bool             sparse,
+							   ExecutionContext &context) const
+{
+	const Real	*pLayerInput	= pInput;
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+	{
+		if (IsAbsorbed(i))
+			continue;
+
+		const unsigned int	next			= NextLayer(i);
+		Real				*pLayerOutput	= (next < m_Layer.size())
+											? &context.m_Activation[next][0]
+											: pOutput;
+
+		if ((i > 0)
+		||  !sparse
+		||  !m_Layer[i]->EvaluateSparse(context.m_Active, pLayerOutput))
+			m_Layer[i]->Evaluate(pLayerInput, pLayerOutput, &context.m_Work[0]);
+
+		pLayerInput	= pLayerOutput;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 各層の前方出力(N 件)
+ *
+ * @param  pInput   入力値配列
+ * @param  pOutput  出力値受取配列
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ForwardLayersBatch(const Real   *pInput,
+								   Real         *pOutput,
+								   unsigned int batchNum)
+{
+	const Real	*pLayerInput	= pInput;
+
+	PlanBatchWorkspace(batchNum);
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+	{
+		if (IsAbsorbed(i))
+			continue;
+
+		const unsigned int	next			= NextLayer(i);
+		Real				*pLayerOutput	= (next < m_Layer.size())
+											? &m_Activation[next][0]
+											: pOutput;
+
+		m_Layer[i]->ForwardBatch(pLayerInput, pLayerOutput, batchNum);
+		pLayerInput	= pLayerOutput;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後方出力(N 件)
+ * -重み差分には N 件分を加算する
+ */
+//----------------------------------------------------------------------
+void NeuralNet::BackwardBatch(void)
+{
+	if ((m_Layer.size() == 0)
+	||  (m_Mode != Mode::TrainingMode)
+	||  (m_BatchNum == 0)
+	||  (m_BatchLoss.size() != m_BatchNum * GetOutputNum()))
+		return;
+
+	const Real	*pDelta	= &m_BatchLoss[0];
+
+	for(unsigned int i = 0, index = m_Layer.size()-1;
+		i < m_Layer.size();
+		++i, --index)
+	{
+		if (IsAbsorbed(index))
+			continue;
+
+		m_Layer[index]->BackwardBatch(pDelta, &m_Delta[index][0], m_BatchNum);
+		pDelta	= &m_Delta[index][0];
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 作業領域の確保(N 件)
+ * -足りないときだけ広げる. 1 件の計算は先頭を使う
+ *
+ * @param  batchNum 件数
+ */
+//----------------------------------------------------------------------
+void NeuralNet::PlanBatchWorkspace(unsigned int batchNum)
+{
+	for (unsigned int k = 0; k < m_Layer.size(); ++k)
+	{
+		const unsigned int	size	= m_Layer[k]->GetInputNum() * batchNum;
+
+		if ((k > 0) && (m_Activation[k].size() < size))
+			m_Activation[k].resize(size);
+
+		if ((m_Mode == Mode::TrainingMode) && (m_Delta[k].size() < size))
+			m_Delta[k].resize(size);
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 作業領域の確保
+ * -層の間の出力値・差分値の配列を層の追加時にまとめて確保し,
+ *  前方出力・後方出力では確保済みの配列に書き込む
+ */
+//----------------------------------------------------------------------
+void NeuralNet::PlanWorkspace(void)
+{
+	const unsigned int	layerNum	= m_Layer.size();
+
+	m_Activation.resize(layerNum + 1);
+	m_Delta.resize(layerNum);
+
+	for (unsigned int k = 0; k < layerNum; ++k)
+	{
+		const unsigned int	inputNum	= m_Layer[k]->GetInputNum();
+
+		// 先頭層の入力は m_Input か呼び出し側の配列.
+		if (k > 0)
+			m_Activation[k].resize(inputNum);
+
+		// 推論専用なら差分は持たない.
+		if (m_Mode == Mode::TrainingMode)
+			m_Delta[k].resize(inputNum);
+		else
+			ReleaseArray(m_Delta[k]);
+	}
+
+	m_Input.resize(GetInputNum());
+	m_Active.reserve(GetInputNum());
+	m_Output.resize(GetOutputNum());
+	m_Loss.resize(GetOutputNum());
+}
+
+//----------------------------------------------------------------------
+/**
+ * 層の融合
+ * -全結合層・畳み込み層の直後の活性化層(と最後の Soft-Max 層)を
+ *  その層の出力にまとめて計算し, 中間の配列を作らないようにする
+ * -結果は融合しない場合と同じ. 層を追加・読み込みしたら再度呼ぶこと
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Compile(void)
+{
+	Decompile();
+
+	m_Absorbed.assign(m_Layer.size(), false);
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+	{
+		const unsigned int	type	= m_Layer[i]->GetType();
+
+		// Evaluate は変換後フィルタを作らないので先に作っておく.
+		if (type == LayerType::Convolution)
+		{
+			std::shared_ptr<ConvolutionLayer>	pConv	=
+				std::dynamic_pointer_cast<ConvolutionLayer>(m_Layer[i]);
+
+			if (pConv->GetEngine() == ConvolutionLayer::WinogradEngine)
+				pConv->UpdateWinogradFilter();
+		}
+
+		if ((type != LayerType::Affine)
+		&&  (type != LayerType::Convolution))
+			continue;
+
+		ActivateLayer	*pActivation	= NULL;
+		bool			softMax			= false;
+		unsigned int	next			= i + 1;
+
+		if (next < m_Layer.size())
+		{
+			pActivation	= dynamic_cast<ActivateLayer *>(m_Layer[next].get());
+			if (pActivation != NULL)
+				m_Absorbed[next++]	= true;
+		}
+
+		if ((next < m_Layer.size())
+		&&  (m_Layer[next]->GetType() == LayerType::SoftMax))
+		{
+			softMax				= true;
+			m_Absorbed[next++]	= true;
+		}
+
+		m_Layer[i]->SetActivation(pActivation, softMax);
+		i	= next - 1;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 層の融合の解除
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Decompile(void)
+{
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+		m_Layer[i]->SetActivation(NULL, false);
+
+	m_Absorbed.clear();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 差分評価の開始
+ * -積んであった局面は捨て, 入力から 1 層目の活性化前出力を作り直す
+ *
+ * @param active   値が 1 の入力番号の配列
+ *
+ * @return         成否(先頭が全結合層でない, 番号が範囲外なら失敗)
+ */
+//----------------------------------------------------------------------
+bool NeuralNet::ResetAccumulator(const std::vector<unsigned int> &active)
+{
+	m_AccumulatorDepth	= 0;
+
+	if ((m_Layer.size() == 0) || (m_Layer[0]->GetType() != LayerType::Affine))
+		return (false);
+
+	for (unsigned int a = 0; a < active.size(); ++a)
+	{
+		if (active[a] >= GetInputNum())
+			return (false);
+	}
+
+	std::shared_ptr<AffineLayer>	pAffine	=
+		std::dynamic_pointer_cast<AffineLayer>(m_Layer[0]);
+	const unsigned int				num		= pAffine->GetOutputNum();
+
+	if (m_Accumulator.size() < num)
+		m_Accumulator.resize(num);
+
+	pAffine->ResetAccumulator(&m_Accumulator[0], active);
+	m_AccumulatorDepth	= 1;
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 差分評価の局面を進める
+ * -現在の局面を複製して積み, 変化した入力の分だけ更新する
+ *
+ * @param added    0 から 1 になった入力番号の配列
+ * @param removed  1 から 0 になった入力番号の配列
+ *
+ * @return         成否(ResetAccumulator 前, 番号が範囲外なら失敗)
+ */
+//----------------------------------------------------------------------
+bool NeuralNet::PushAccumulator(const std::vector<unsigned int> &added,
+								const std::vector<unsigned int> &removed)
+{
+	if (m_AccumulatorDepth == 0)
+		return (false);
+
+	for (unsigned int a = 0; a < added.size(); ++a)
+	{
+		if (added[a] >= GetInputNum())
+			return (false);
+	}
+	for (unsigned int r = 0; r < removed.size(); ++r)
+	{
+		if (removed[r] >= GetInputNum())
+			return (false);
+	}
+
+	std::shared_ptr<AffineLayer>	pAffine	=
+		std::dynamic_pointer_cast<AffineLayer>(m_Layer[0]);
+	const unsigned int				num		= pAffine->GetOutputNum();
+
+	// 戻したときに再確保しないよう, 配列は縮めない.
+	if (m_Accumulator.size() < (m_AccumulatorDepth + 1) * num)
+		m_Accumulator.resize((m_AccumulatorDepth + 1) * num);
+
+	Real	*pTop	= &m_Accumulator[(m_AccumulatorDepth - 1) * num];
+
+	memcpy(pTop + num, pTop, sizeof(Real) * num);
+	pAffine->UpdateAccumulator(pTop + num, added, removed);
+	++m_AccumulatorDepth;
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 差分評価の局面を一つ戻す
+ * -最初の局面(ResetAccumulator の局面)は残す
+ */
+//----------------------------------------------------------------------
+void NeuralNet::PopAccumulator(void)
+{
+	if (m_AccumulatorDepth > 1)
+		--m_AccumulatorDepth;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 差分評価の前方出力
+ * -積んである最後の局面の 1 層目出力から 2 層目以降を計算する
+ */
+//----------------------------------------------------------------------
+void NeuralNet::ForwardAccumulator(void)
+{
+	if (m_AccumulatorDepth == 0)
+		return;
+
+	const unsigned int	num		= m_Layer[0]->GetOutputNum();
+	const Real			*pTop	= &m_Accumulator[(m_AccumulatorDepth - 1) * num];
+
+	// 積んであるのは活性化前の値なので, 先頭層に融合した層も個別に計算する.
+	unsigned int	head	= 1;
+
+	while (IsAbsorbed(head))
+		++head;
+
+	Real	*pLayerInput	= (m_Layer.size() > 1) ? &m_Activation[1][0] : &m_Output[0];
+
+	std::copy(pTop, pTop + num, pLayerInput);
+	for (unsigned int i = 1; i < m_Layer.size(); ++i)
+	{
+		if ((i >= head) && IsAbsorbed(i))
+			continue;
+
+		const unsigned int	next			= (i < head) ? i + 1 : NextLayer(i);
+		Real				*pLayerOutput	= (next < m_Layer.size())
+											? &m_Activation[next][0]
+											: &m_Output[0];
+
+		m_Layer[i]->Forward(pLayerInput, pLayerOutput);
+		pLayerInput	= pLayerOutput;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 学習
+ * -モーメンタム付きの勾配降下. モーメンタムは Adam のモーメントの領域に持つ
+ *
+ * @param learnRatio   学習率
+ * @param momentum     モーメンタム係数(0 ならモーメンタムなし)
+ * @param weightDecay  重み減衰率
+ */
+//----------------------------------------------------------------------
+void NeuralNet::Learn(double learnRatio,
+					  double momentum,
+					  double weightDecay)
+{
+	if ((m_Layer.size() == 0)
+	||  (m_Mode != Mode::TrainingMode))
+		return ;
+
+	++m_LearnStep;
+
+	// 重み・バイアスは平坦な領域をまとめて更新する.
+	SgdUpdate(m_pValue,
+			  GetDeltaParam(),
+			  (momentum != 0.0) ? m_pState : NULL,
+			  (Real)learnRatio,
+			  (Real)momentum,
+			  (Real)weightDecay,
+			  DeltaScale(),
+			  m_ParamNum);
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+	{
+		m_Layer[i]->Learn(learnRatio);
+		m_Layer[i]->ParamChanged();
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * Adam学習
+ * -バイアス補正は更新回数 t で 1 - beta^t
+ *
+ * @param alpha        係数更新率
+ * @param beta1        モーメント更新率
+ * @param beta2        速度更新率
+ * @param epsilon      誤差値
+ * @param weightDecay  重み減衰率(値に直接かける. 0 でなければ AdamW)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::LearnAdam(double alpha,
+						  double beta1,
+						  double beta2,
+						  double epsilon,
+						  double weightDecay)
+{
+	if ((m_Layer.size() == 0)
+	||  (m_Mode != Mode::TrainingMode))
+		return ;
+
+	++m_LearnStep;
+
+	// 重み・バイアスは平坦な領域をまとめて更新する(内部の数値型で計算する).
+	AdamUpdate(m_pValue,
+			   GetDeltaParam(),
+			   m_pState,
+			   m_pState + m_ParamNum,
+			   (Real)alpha,
+			   (Real)beta1,
+			   (Real)beta2,
+			   (Real)epsilon,
+			   (Real)weightDecay,
+			   DeltaScale(),
+			   m_LearnStep,
+			   m_ParamNum);
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+	{
+		m_Layer[i]->LearnAdam(alpha, beta1, beta2, epsilon);
+		m_Layer[i]->ParamChanged();
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * Adamパラメータリセット
+ */
+//----------------------------------------------------------------------
+void NeuralNet::LearnAdamReset(void)
+{
+	if ((m_Layer.size() == 0)
+	||  (m_Mode != Mode::TrainingMode))
+		return ;
+
+	// モーメントと速度は続けて並んでいる.
+	memset(m_pState, 0, sizeof(Real) * m_ParamNum * 2);
+	m_LearnStep	= 0;
 }
 
 //----------------------------------------------------------------------
 /**
- * プーリング(最大値選出)層の追加
- * -width x height x chanel が入力になる
- * -((height+2*padding-filterSize)/stride+1)
- *  x((width+2*padding-filterSize)/stride+1)
- *  x channel が出力になる
+ * 差分のノルムの扱いの設定
  *
- * @param width      入力の横幅
- * @param height     入力の高さ
- * @param channel    入力のチャンネル数
- * @param filterSize フィルタのサイズ
- * @param stride     フィルタの移動幅
- * @param padding    パディングの幅
+ * @param  mode   扱い
+ * @param  limit  ノルムの上限(ClipNorm)・目標(RescaleNorm)
+ */
+//----------------------------------------------------------------------
+void NeuralNet::SetDeltaNormLimit(NormMode mode, double limit)
+{
+	m_NormMode	= mode;
+	m_NormLimit	= limit;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 差分にかける倍率
+ * -全層の差分の L2 ノルムを求めて m_DeltaNorm に残す
  *
- * @return           成否
+ * @return 倍率(扱いが NoNorm, ノルムが 0 なら 1)
  */
 //----------------------------------------------------------------------
-bool NeuralNet::AddMaxPoolingLayer(unsigned int width,
-								   unsigned int height,
-								   unsigned int channel,
-								   unsigned int filterSize,
-								   unsigned int stride,
-								   unsigned int padding)
+NeuralNet::Real NeuralNet::DeltaScale(void)
 {
-	m_Layer.push_back(std::shared_ptr<MaxPoolingLayer>
-					  (new MaxPoolingLayer(width,
-										   height,
-										   channel,
-										   filterSize,
-										   stride,
-										   padding)));
+	// 詰め物は 0 なので平坦な領域をそのまま集計してよい.
+	m_DeltaNorm	= sqrt(SquareSum(GetDeltaParam(), m_ParamNum));
 
-	return (CheckAddLayerConnect());
+	if ((m_DeltaNorm <= 0.0)
+	||  (m_NormMode == NormMode::NoNorm)
+	||  ((m_NormMode == NormMode::ClipNorm) && (m_DeltaNorm <= m_NormLimit)))
+		return (1);
+
+	return ((Real)(m_NormLimit / m_DeltaNorm));
 }
 
 //----------------------------------------------------------------------
 /**
- * 入力値の設定
+ * 動作モードの設定
+ * -推論専用にすると各層の差分・Adam の状態と後方出力用の作業領域を解放する
+ *  学習用に戻すと状態は 0 から始める
  *
- * @param input      入力値の配列
+ * @param  mode  動作モード
  */
 //----------------------------------------------------------------------
-void NeuralNet::SetInput(const std::vector<double> &input)
+void NeuralNet::SetMode(Mode mode)
 {
-	m_Input	= input;
+	m_Mode	= mode;
+
+	PlanParam();
+	if (mode == Mode::TrainingMode)
+		memset(m_pParam + m_ParamNum, 0, sizeof(Real) * m_ParamNum * 3);
+	m_LearnStep	= 0;
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+		m_Layer[i]->SetMode(mode);
+
+	PlanWorkspace();
 }
 
 //----------------------------------------------------------------------
 /**
- * 出力値の取得
+ * exp の計算精度の設定
+ * -全層の Sigmoid・Soft-Max(融合したものを含む)に適用する
  *
- * @param output   出力値の配列
+ * @param  accuracy  計算精度
  */
 //----------------------------------------------------------------------
-void NeuralNet::GetOutput(std::vector<double> &output) const
+void NeuralNet::SetAccuracy(ActivationAccuracy accuracy)
 {
-	if (m_Layer.size() == 0)
-		return;
+	m_Accuracy	= accuracy;
 
-	output	= m_Output;
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+		m_Layer[i]->SetAccuracy(accuracy);
 }
 
 //----------------------------------------------------------------------
 /**
- * 損失値の計算
- *
- * @param teacher   教師信号の配列
+ * 乱数の種の設定
+ * -RReLU 層ごとに種に層番号を足して使う
  *
- * @return          二乗誤差の総和
+ * @param  seed  乱数の種
  */
 //----------------------------------------------------------------------
-double NeuralNet::CalcSquareLoss(const std::vector<double> &teacher)
+void NeuralNet::SetRandomSeed(unsigned int seed)
 {
-	double	lossSum	= 0.0;
-	
-	m_Loss.resize(teacher.size());
-	
-	for (unsigned int i = 0; i < teacher.size(); ++i)
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
 	{
-		m_Loss[i]	= teacher[i] - m_Output[i];
-
-		lossSum		+= m_Loss[i] * m_Loss[i];
-		//lossSum		+= -teacher[i] * log(m_Output[i] + 1.0e-7);
+		if (m_Layer[i]->GetType() == LayerType::RReLU)
+			std::dynamic_pointer_cast<RReLULayer>(m_Layer[i])->SetSeed(seed + i);
 	}
-
-	return (lossSum);
 }
 
 //----------------------------------------------------------------------
 /**
-* 損失値の計算
-*
-* @param teacher   教師信号の配列
-*
-* @return          クロスエントロピー誤差の総和
-*/
+ * 学習する値の平坦な領域の確保
+ * -各層の値(学習用なら差分・Adam の状態も)を 1 つの領域に並べ直し, 層に参照させる
+ *  今の値・状態はそのまま引き継ぐ
+ */
 //----------------------------------------------------------------------
-double NeuralNet::CalcCrossEntropyLoss(const std::vector<double> &teacher)
+void NeuralNet::PlanParam(void)
 {
-	double	lossSum = 0.0;
-
-	m_Loss.resize(teacher.size());
+	const unsigned int			align		= PARAM_ALIGN / sizeof(Real);
+	const unsigned int			sectionNum	= (m_Mode == Mode::TrainingMode) ? 4 : 1;
+	std::vector<unsigned int>	offset(m_Layer.size());
+	unsigned int				paramNum	= 0;
 
-	for (unsigned int i = 0; i < teacher.size(); ++i)
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
 	{
-		m_Loss[i] = teacher[i] - m_Output[i];
+		offset[i]	=  paramNum;
+		paramNum	+= (m_Layer[i]->GetParamNum() + align - 1) / align * align;
+	}
 
-		lossSum		+= -teacher[i] * log(m_Output[i] + 1.0e-7);
+	// 先頭を境界にそろえる分だけ余分に確保する.
+	std::vector<Real>	arena(paramNum * sectionNum + align, 0);
+	const uintptr_t		address	= (uintptr_t)&arena[0];
+	Real				*pParam	= (Real *)((address + PARAM_ALIGN - 1)
+										 & ~(uintptr_t)(PARAM_ALIGN - 1));
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+	{
+		if (m_Layer[i]->GetParamNum() == 0)
+			continue;
+
+		Real	*pLayerParam	= pParam + offset[i];
+
+		if (sectionNum == 1)
+			m_Layer[i]->BindParam(pLayerParam, NULL, NULL, NULL);
+		else
+			m_Layer[i]->BindParam(pLayerParam,
+								  pLayerParam + paramNum,
+								  pLayerParam + paramNum * 2,
+								  pLayerParam + paramNum * 3);
 	}
 
-	return (lossSum);
+	m_ParamArena.swap(arena);
+	m_pParam	= pParam;
+	m_ParamNum	= paramNum;
+	m_pValue	= pParam;
+	m_pState	= (sectionNum > 1) ? pParam + paramNum * 2 : NULL;
 }
 
 //----------------------------------------------------------------------
 /**
- * 前方出力
+ * 学習する値の変更の通知
+ * -GetParam の配列を直接書き換えた後に呼ぶ(Winograd 変換後フィルタを作り直させる)
  */
 //----------------------------------------------------------------------
-void NeuralNet::Forward(void)
+void NeuralNet::ParamChanged(void)
+{
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+		m_Layer[i]->ParamChanged();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 同じ構成か
+ *
+ * @param  net  比べるネット
+ *
+ * @return      層の種類・入出力数・学習する値の数が同じか
+ */
+//----------------------------------------------------------------------
+bool NeuralNet::IsSameStructure(const NeuralNet &net) const
 {
-	std::vector<double>	tmp[2];
+	if ((m_Layer.size() != net.m_Layer.size())
+	||  (m_ParamNum     != net.m_ParamNum))
+		return (false);
 
-	tmp[0]	= m_Input;
 	for (unsigned int i = 0; i < m_Layer.size(); ++i)
-	{ 
-		m_Layer[i]->Forward(tmp[i&1], tmp[(i+1)&1]);
-		for (auto v : tmp[(i+1)&1])
-		{ 
-			if (isnan(v))
-				v = 0.0;
-		}
+	{
+		if ((m_Layer[i]->GetType()      != net.m_Layer[i]->GetType())
+		||  (m_Layer[i]->GetInputNum()  != net.m_Layer[i]->GetInputNum())
+		||  (m_Layer[i]->GetOutputNum() != net.m_Layer[i]->GetOutputNum())
+		||  (m_Layer[i]->GetParamNum()  != net.m_Layer[i]->GetParamNum()))
+			return (false);
 	}
-	m_Output	= tmp[m_Layer.size()&1];
+
+	return (true);
 }
 
 //----------------------------------------------------------------------
 /**
- * 後方出力
+ * 複製
+ * -保存形式を経由して同じ構成・値のネットを作る(内部の数値型のまま保存するので値は同じ)
+ *
+ * @param  net   複製元のネット
+ * @param  mode  作り直したネットの動作モード
+ *
+ * @return       成否
  */
 //----------------------------------------------------------------------
-void NeuralNet::Backward(void)
+bool NeuralNet::Clone(const NeuralNet &net, Mode mode)
 {
-	std::vector<double>	tmp[2];
-	
-	tmp[0]	= m_Loss;
-	for(unsigned int i = 0, index = m_Layer.size()-1;
-		i < m_Layer.size();
-		++i, --index)
-		m_Layer[index]->Backward(tmp[i&1], tmp[(i+1)&1]);
+	if ((this == &net)
+	||  (net.m_Layer.size() == 0))
+		return (false);
+
+	std::vector<char>	data;
 
-	m_Input	= tmp[m_Layer.size()&1];
+	net.Save(data);
+
+	// Load は層を後ろに足すので, 今の層を捨ててから読む.
+	Decompile();
+	m_Layer.clear();
+	m_BatchNum	= 0;
+
+	Load(data, mode);
+	SetAccuracy(net.m_Accuracy);
+
+	return (IsSameStructure(net));
 }
 
 //----------------------------------------------------------------------
 /**
- * 学習
+ * 値の複写
+ * -重み・バイアスは平坦な領域をまとめて複写する
  *
- * @param learnRatio  学習率
+ * @param  net  複写元のネット(同じ構成)
+ *
+ * @return      成否
  */
 //----------------------------------------------------------------------
-void NeuralNet::Learn(double learnRatio)
+bool NeuralNet::CopyParam(const NeuralNet &net)
 {
-	if (m_Layer.size() == 0)
-		return ;
+	if (!IsSameStructure(net))
+		return (false);
+
+	if (this == &net)
+		return (true);
+
+	// 値を共有していれば複写するものはない.
+	if (m_pValue != net.m_pValue)
+		memcpy(m_pValue, net.m_pValue, sizeof(Real) * m_ParamNum);
 
 	for (unsigned int i = 0; i < m_Layer.size(); ++i)
-		m_Layer[i]->Learn(learnRatio);
+	{
+		// RReLU のアルファは平坦な領域の外にある.
+		if (m_Layer[i]->GetType() == LayerType::RReLU)
+		{
+			const std::shared_ptr<RReLULayer>	pFrom	=
+				std::dynamic_pointer_cast<RReLULayer>(net.m_Layer[i]);
+			const std::shared_ptr<RReLULayer>	pTo		=
+				std::dynamic_pointer_cast<RReLULayer>(m_Layer[i]);
+
+			for (unsigned int j = 0; j < pTo->GetInputNum(); ++j)
+				pTo->SetAlpha(j, pFrom->GetAlpha(j));
+		}
+
+		m_Layer[i]->ParamChanged();
+	}
+
+	return (true);
 }
 
 //----------------------------------------------------------------------
 /**
- * Adam学習
+ * 値の共有
+ * -各層の値の参照先を net の平坦な領域に移す(差分は自分の領域のまま)
+ *  共有を始めるときの値は net のもの(RReLU のアルファは複写する)
+ * -shareState なら Adam のモーメント・速度の参照先も net の領域に移す
+ *  (共有を始めるときの状態は net のもの. 更新回数は複写しない)
  *
- * @param alpha    係数更新率
- * @param beta1    モーメント更新率
- * @param beta2    速度更新率
- * @param epsilon  誤差値
+ * @param  net         値を共有するネット(同じ構成, 学習用)
+ * @param  shareState  モーメント・速度も共有するか
+ *
+ * @return             成否
  */
 //----------------------------------------------------------------------
-void NeuralNet::LearnAdam(double alpha,
-						  double beta1,
-						  double beta2,
-						  double epsilon)
+bool NeuralNet::ShareParam(NeuralNet &net, bool shareState)
 {
-	if (m_Layer.size() == 0)
-		return ;
+	if ((m_Mode     != Mode::TrainingMode)
+	||  (net.m_Mode != Mode::TrainingMode)
+	||  !CopyParam(net))
+		return (false);
 
+	const unsigned int	align	= PARAM_ALIGN / sizeof(Real);
+	Real				*pState	= shareState ? net.m_pState : m_pParam + m_ParamNum * 2;
+	unsigned int		offset	= 0;
+
+	// 移すときに今の状態を書き込むので, 先に共有元の状態にそろえておく.
+	if (shareState && (m_pState != net.m_pState))
+		memcpy(m_pState, net.m_pState, sizeof(Real) * m_ParamNum * 2);
+
+	// 層の並びは PlanParam と同じ(値は複写済みなので移しても共有元は変わらない).
 	for (unsigned int i = 0; i < m_Layer.size(); ++i)
-		m_Layer[i]->LearnAdam(alpha, beta1, beta2, epsilon);
+	{
+		const unsigned int	paramNum	= m_Layer[i]->GetParamNum();
+
+		if (paramNum > 0)
+		{
+			m_Layer[i]->BindParam(net.m_pValue + offset,
+								  m_pParam + m_ParamNum + offset,
+								  pState                + offset,
+								  pState + m_ParamNum   + offset);
+			m_Layer[i]->ParamChanged();
+		}
+
+		offset	+= (paramNum + align - 1) / align * align;
+	}
+
+	m_pValue	= net.m_pValue;
+	m_pState	= pState;
+
+	return (true);
 }
 
 //----------------------------------------------------------------------
 /**
- * Adamパラメータリセット
+ * 差分の加算
+ * -別のネットで求めた差分を平坦な領域のままこのネットの差分に加える
+ *
+ * @param  net  加算する差分を持つネット(同じ構成, 学習用)
+ *
+ * @return      成否
  */
 //----------------------------------------------------------------------
-void NeuralNet::LearnAdamReset(void)
+bool NeuralNet::AddDeltaParam(const NeuralNet &net)
 {
-	if (m_Layer.size() == 0)
-		return ;
+	if ((m_Mode     != Mode::TrainingMode)
+	||  (net.m_Mode != Mode::TrainingMode)
+	||  !IsSameStructure(net))
+		return (false);
 
-	for (unsigned int i = 0; i < m_Layer.size(); ++i)
-		m_Layer[i]->LearnAdamReset();
+	AddArray(GetDeltaParam(), net.GetDeltaParam(), m_ParamNum);
+
+	return (true);
 }
 
 //----------------------------------------------------------------------
 /**
- * Deltaの正規化
+ * 学習状態の複写
+ * -モーメント・速度は平坦な領域をまとめて複写する
+ *
+ * @param  net  複写元のネット(同じ構成, 学習用)
+ *
+ * @return      成否
  */
 //----------------------------------------------------------------------
-void NeuralNet::DeltaNormalize(void)
+bool NeuralNet::CopyTrainingState(const NeuralNet &net)
 {
-	if (m_Layer.size() == 0)
-		return ;
+	if ((m_Mode     != Mode::TrainingMode)
+	||  (net.m_Mode != Mode::TrainingMode)
+	||  !IsSameStructure(net))
+		return (false);
+
+	if (this == &net)
+		return (true);
+
+	// 状態を共有していれば複写するものはない.
+	if (m_pState != net.m_pState)
+		memcpy(m_pState, net.m_pState, sizeof(Real) * m_ParamNum * 2);
+	m_LearnStep	= net.m_LearnStep;
 
 	for (unsigned int i = 0; i < m_Layer.size(); ++i)
-		m_Layer[i]->DeltaNormalize();
+	{
+		if (m_Layer[i]->GetType() == LayerType::RReLU)
+		{
+			const std::shared_ptr<RReLULayer>	pFrom	=
+				std::dynamic_pointer_cast<RReLULayer>(net.m_Layer[i]);
+			const std::shared_ptr<RReLULayer>	pTo		=
+				std::dynamic_pointer_cast<RReLULayer>(m_Layer[i]);
+
+			pTo->SetRandom(pFrom->GetRandom());
+		}
+	}
+
+	return (true);
 }
 
 //----------------------------------------------------------------------
 /**
  * 保存
  *
- * @param  data  バイナリ配列
+ * @param  data       バイナリ配列
+ * @param  precision  保存する数値精度
  */
 //----------------------------------------------------------------------
-void NeuralNet::Save(std::vector<char> &data)
+void NeuralNet::Save(std::vector<char> &data, Precision precision) const
 {
+	// 単精度のときだけ値のバイト数を先頭に書く(倍精度は従来形式のまま).
+	if (precision == Precision::SinglePrecision)
+	{
+		WriteIntData(data, LayerType::ValueSize);
+		WriteIntData(data, sizeof(float));
+	}
+
 	for (unsigned int i = 0; i < m_Layer.size(); ++i)
 	{
 		unsigned int	type	= m_Layer[i]->GetType();
@@ -1215,9 +3287,9 @@ void NeuralNet::Save(std::vector<char> &data)
 					for (unsigned int i = 0;
 						 i < pAffineLayer->GetInputNum();
 						 ++i)
-						WriteDoubleData(data, pAffineLayer->GetWeight(i, o));
+						WriteRealData(data, pAffineLayer->GetWeight(i, o), precision);
 
-					WriteDoubleData(data, pAffineLayer->GetBias(o));
+					WriteRealData(data, pAffineLayer->GetBias(o), precision);
 				}
 			}
 			break;
@@ -1244,7 +3316,7 @@ void NeuralNet::Save(std::vector<char> &data)
 					 i < pRReLULayer->GetInputNum();
 					 ++i)
 				{
-					WriteDoubleData(data, pRReLULayer->GetAlpha(i));
+					WriteRealData(data, pRReLULayer->GetAlpha(i), precision);
 				}
 			}
 			break;
@@ -1255,7 +3327,7 @@ void NeuralNet::Save(std::vector<char> &data)
 					std::dynamic_pointer_cast<LReLULayer>(m_Layer[i]);
 
 				WriteIntData(data, pLReLULayer->GetInputNum());
-				WriteDoubleData(data, pLReLULayer->GetAlpha());
+				WriteRealData(data, pLReLULayer->GetAlpha(), precision);
 			}
 			break;
 			
@@ -1289,12 +3361,12 @@ void NeuralNet::Save(std::vector<char> &data)
 								 y < pConvLayer->GetFilterSize();
 								 ++y)
 							{
-								WriteDoubleData(data,
-												pConvLayer->GetFilter(x, y, f, c));
+								WriteRealData(data,
+												pConvLayer->GetFilter(x, y, f, c), precision);
 							}
 						}
 						
-						WriteDoubleData(data, pConvLayer->GetBias(f, c));
+						WriteRealData(data, pConvLayer->GetBias(f, c), precision);
 					}
 				}
 			}
@@ -1322,19 +3394,40 @@ void NeuralNet::Save(std::vector<char> &data)
 //----------------------------------------------------------------------
 /**
  * 読み込み
+ * -保存時の数値精度から内部の数値型に変換する
+ * -推論専用で読み込むと重みとバイアスだけを確保する
  *
  * @param  data  バイナリ配列
+ * @param  mode  動作モード
+ *
+ * @return       読んだバイト数(学習状態を含む)
  */
 //----------------------------------------------------------------------
-void NeuralNet::Load(const std::vector<char> &data)
+unsigned int NeuralNet::Load(const std::vector<char> &data,
+							 Mode                    mode)
 {
 	unsigned int	type;
 	unsigned int	index = 0;
+	Precision		precision	= Precision::DoublePrecision;
+
+	m_AccumulatorDepth	= 0;
+	Decompile();
+	SetMode(mode);
 
 	while ((type = ReadIntData(data, index)) != LayerType::Blank)
 	{
 		switch (type)
 		{
+		  case ValueSize:
+			{
+				unsigned int size	= ReadIntData(data, index);
+
+				precision	= (size == sizeof(float))
+							? Precision::SinglePrecision
+							: Precision::DoublePrecision;
+			}
+			break;
+
 		  case Affine:
 			{
 				unsigned int inputNum	= ReadIntData(data, index);
@@ -1356,10 +3449,10 @@ void NeuralNet::Load(const std::vector<char> &data)
 					{
 						pAffineLayer->SetWeight(i,
 												o,
-												ReadDoubleData(data, index));
+												ReadRealData(data, index, precision));
 					}
 					
-					pAffineLayer->SetBias(o, ReadDoubleData(data, index));
+					pAffineLayer->SetBias(o, ReadRealData(data, index, precision));
 				}
 			}
 			break;
@@ -1386,7 +3479,7 @@ void NeuralNet::Load(const std::vector<char> &data)
 					 i < pRReLULayer->GetInputNum();
 					 ++i)
 				{
-					pRReLULayer->SetAlpha(i, ReadDoubleData(data, index));
+					pRReLULayer->SetAlpha(i, ReadRealData(data, index, precision));
 				}
 			}
 			break;
@@ -1402,7 +3495,7 @@ void NeuralNet::Load(const std::vector<char> &data)
 		  case LReLU:
 			{
 				unsigned int inputNum	= ReadIntData(   data, index);
-				double       alpha		= ReadDoubleData(data, index);
+				Real         alpha		= ReadRealData(data, index, precision);
 
 				AddLReLULayer(inputNum, alpha);
 			}
@@ -1459,11 +3552,11 @@ void NeuralNet::Load(const std::vector<char> &data)
 									y,
 									f,
 									c,
-									ReadDoubleData(data, index));
+									ReadRealData(data, index, precision));
 							}
 						}
 						
-						pConvLayer->SetBias(f, c, ReadDoubleData(data, index));
+						pConvLayer->SetBias(f, c, ReadRealData(data, index, precision));
 					}
 				}
 			}
@@ -1488,5 +3581,184 @@ void NeuralNet::Load(const std::vector<char> &data)
 			break;
 		}
 	}
+
+	// 学習状態が付いていれば戻す(推論専用なら読み飛ばす).
+	ReadTrainingState(data, index);
+
+	return (index);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 学習状態の保存
+ * -Save の直後に呼び, 同じ配列の後ろに付け足す(学習用のときだけ)
+ * -モーメント・速度は内部の数値型のまま, 層ごとに境界合わせの詰め物を除いて書く
+ *  (詰め物の数は数値型で変わるので, 単精度・倍精度のどちらでも読めるようにする)
+ *
+ * @param  data  バイナリ配列
+ */
+//----------------------------------------------------------------------
+void NeuralNet::SaveTrainingState(std::vector<char> &data) const
+{
+	if (m_Mode != Mode::TrainingMode)
+		return;
+
+	std::vector<std::string>	random;
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+	{
+		if (m_Layer[i]->GetType() == LayerType::RReLU)
+		{
+			const std::shared_ptr<RReLULayer>	pRReLULayer	=
+				std::dynamic_pointer_cast<RReLULayer>(m_Layer[i]);
+			std::ostringstream					stream;
+
+			stream << pRReLULayer->GetRandom();
+			random.push_back(stream.str());
+		}
+	}
+
+	unsigned int	paramNum	= 0;
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+		paramNum	+= m_Layer[i]->GetParamNum();
+
+	WriteIntData(data, LayerType::TrainingState);
+	WriteIntData(data, sizeof(Real));
+	WriteIntData(data, paramNum);
+	WriteIntData(data, m_LearnStep);
+	WriteIntData(data, random.size());
+
+	for (unsigned int r = 0; r < random.size(); ++r)
+	{
+		WriteIntData(data, random[r].size());
+		data.insert(data.end(), random[r].begin(), random[r].end());
+	}
+
+	const unsigned int	align	= PARAM_ALIGN / sizeof(Real);
+
+	// モーメント(全層)の後ろに速度(全層). 層の並びは PlanParam と同じ.
+	for (unsigned int section = 0; section < 2; ++section)
+	{
+		unsigned int	offset	= 0;
+
+		for (unsigned int i = 0; i < m_Layer.size(); ++i)
+		{
+			const unsigned int	layerNum	= m_Layer[i]->GetParamNum();
+			const char			*pState		=
+				(const char *)(m_pState + m_ParamNum * section + offset);
+
+			data.insert(data.end(), pState, pState + sizeof(Real) * layerNum);
+			offset	+= (layerNum + align - 1) / align * align;
+		}
+	}
 }
 
+//----------------------------------------------------------------------
+/**
+ * 学習状態の読み込み
+ * -構成が違う・推論専用なら読み飛ばすだけ
+ * -保存時の数値型が内部と違えば変換し, 層ごとに境界合わせの位置に置き直す
+ *
+ * @param  data   バイナリ配列
+ * @param  index  読む位置(学習状態が付いていれば後ろに進める)
+ *
+ * @return        戻したか
+ */
+//----------------------------------------------------------------------
+bool NeuralNet::ReadTrainingState(const std::vector<char> &data, unsigned int &index)
+{
+	unsigned int	position	= index;
+
+	if ((position + sizeof(unsigned int) * 5 > data.size())
+	||  (ReadIntData(data, position) != LayerType::TrainingState))
+		return (false);
+
+	const unsigned int	realSize	= ReadIntData(data, position);
+	const unsigned int	paramNum	= ReadIntData(data, position);
+	const unsigned int	learnStep	= ReadIntData(data, position);
+	const unsigned int	randomNum	= ReadIntData(data, position);
+
+	std::vector<std::string>	random(randomNum);
+
+	for (unsigned int r = 0; r < randomNum; ++r)
+	{
+		if (position + sizeof(unsigned int) > data.size())
+			return (false);
+
+		const unsigned int	size	= ReadIntData(data, position);
+
+		if (position + size > data.size())
+			return (false);
+
+		random[r].assign(data.begin() + position, data.begin() + position + size);
+		position	+= size;
+	}
+
+	if ((position + realSize * paramNum * 2 > data.size())
+	||  ((realSize != sizeof(float)) && (realSize != sizeof(double))))
+		return (false);
+
+	const char		*pState		= &data[0] + position;
+	unsigned int	layerParam	= 0;
+
+	index	= position + realSize * paramNum * 2;
+
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+		layerParam	+= m_Layer[i]->GetParamNum();
+
+	if ((m_Mode != Mode::TrainingMode)
+	||  (paramNum != layerParam))
+		return (false);
+
+	const unsigned int	align	= PARAM_ALIGN / sizeof(Real);
+
+	// モーメント(全層)の後ろに速度(全層). 層の並びは PlanParam と同じ.
+	for (unsigned int section = 0; section < 2; ++section)
+	{
+		unsigned int	offset	= 0;
+
+		for (unsigned int i = 0; i < m_Layer.size(); ++i)
+		{
+			const unsigned int	layerNum	= m_Layer[i]->GetParamNum();
+			Real				*pTo		= m_pState + m_ParamNum * section + offset;
+
+			for (unsigned int k = 0; k < layerNum; ++k, pState += realSize)
+			{
+				if (realSize == sizeof(float))
+				{
+					float	value;
+
+					memcpy(&value, pState, sizeof(value));
+					pTo[k]	= (Real)value;
+				}
+				else
+				{
+					double	value;
+
+					memcpy(&value, pState, sizeof(value));
+					pTo[k]	= (Real)value;
+				}
+			}
+			offset	+= (layerNum + align - 1) / align * align;
+		}
+	}
+
+	m_LearnStep	= learnStep;
+
+	for (unsigned int i = 0, r = 0; (i < m_Layer.size()) && (r < randomNum); ++i)
+	{
+		if (m_Layer[i]->GetType() == LayerType::RReLU)
+		{
+			const std::shared_ptr<RReLULayer>	pRReLULayer	=
+				std::dynamic_pointer_cast<RReLULayer>(m_Layer[i]);
+			std::istringstream					stream(random[r++]);
+			std::mt19937						generator;
+
+			stream >> generator;
+			pRReLULayer->SetRandom(generator);
+		}
+	}
+
+	return (true);
+}
@@ -8,11 +8,68 @@
 
 #include <math.h>
 #include <memory>
+#include <random>
 #include <vector>
 
+#include "NeuralNetKernel.h"
+
+// NEURAL_NET_FLOAT を定義すると単精度で学習・推論する.
 class NeuralNet
 {
+  public:
+	// 内部で使う数値型.
+#ifdef NEURAL_NET_FLOAT
+	typedef float	Real;
+#else
+	typedef double	Real;
+#endif
+
+	// 保存時の数値精度.
+	typedef enum Precision
+	{
+		DoublePrecision,	// 倍精度(従来形式)
+		SinglePrecision,	// 単精度
+	} Precision;
+
+	// 動作モード.
+	typedef enum Mode
+	{
+		TrainingMode,		// 学習用(差分・Adam の状態を持つ)
+		InferenceMode,		// 推論専用(重みとバイアスだけ持つ)
+	} Mode;
+
+	// 差分(勾配)のノルムの扱い(全層をまとめた L2 ノルム).
+	typedef enum NormMode
+	{
+		NoNorm,				// そのまま
+		ClipNorm,			// 上限を超えたら上限まで縮める
+		RescaleNorm,		// 常に上限にそろえる
+	} NormMode;
+
+	//----------------------------------------------------------------------
+	/// 推論の実行状態(スレッドごとに持つ)
+	// -層の間の出力値と作業領域だけを持ち, 重みは NeuralNet のものを使う
+	// -初回の Evaluate で NeuralNet に合わせて確保する
+	class ExecutionContext
+	{
+	  public:
+		ExecutionContext() {}
+		~ExecutionContext() {}
+
+	  private:
+		friend class NeuralNet;
+
+		std::vector<std::vector<Real>>	m_Activation;	// index 番目の層の入力
+		std::vector<Real>				m_Work;			// 層の作業領域
+		std::vector<Real>				m_Input;
+		std::vector<Real>				m_Output;
+		std::vector<unsigned int>		m_Active;		// 0/1 入力の値が 1 の番号
+	};
+
   private:
+	// 量子化推論ネットは層を直接参照する.
+	friend class QuantizedNet;
+
 	typedef enum LayerType
 	{
 		Blank		= 0x00000000UL,
@@ -30,7 +87,14 @@ class NeuralNet
 		Convolution	= 0x50000000UL,
 
 		MaxPooling	= 0x60000000UL,
+
+		ValueSize	= 0x70000000UL,		// 以降の実数値のバイト数(単精度保存時のみ)
+
+		TrainingState	= 0x80000000UL,	// ターミネータの後ろに付ける学習状態
 	} LayerType;
+
+	class ActivateLayer;
+
 	//----------------------------------------------------------------------
 	/// レイヤー基底クラス
 	class Layer
@@ -41,32 +105,118 @@ class NeuralNet
 			  unsigned int type) :
 		m_InputNum(inputNum),
 		m_OutputNum(outputNum),
-		m_Type(type)
+		m_Type(type),
+		m_Mode(Mode::InferenceMode),
+		m_pActivation(NULL),
+		m_SoftMax(false),
+		m_Accuracy(AccuracyExact),
+		m_ParamNum(0),
+		m_pParam(NULL),
+		m_pDeltaParam(NULL),
+		m_pMomentParam(NULL),
+		m_pVelocityParam(NULL)
 		{}
 		virtual ~Layer() {}
 
-		virtual void Forward(const std::vector<double> &input,
-							 std::vector<double>       &output) = 0;
-		virtual void Backward(const std::vector<double> &delta,
-							  std::vector<double>       &output) = 0;
+		// 入力は GetInputNum(), 出力は GetOutputNum() 要素の配列.
+		// 学習する層は入力を複製せずに参照するので, Backward までは書き換えないこと.
+		virtual void Forward(const Real *pInput,
+							 Real       *pOutput) = 0;
+		virtual void Backward(const Real *pDelta,
+							  Real       *pOutput) = 0;
+		// 入力が 0/1 のとき値が 1 の番号だけで前方出力する. 未対応なら false.
+		// 番号の配列も Backward まで参照する.
+		virtual bool ForwardSparse(const std::vector<unsigned int> &active,
+								   Real                            *pOutput)
+		{
+			return (false);
+		}
+		// N 件をまとめて計算する(入力・出力・差分は 1 件を 1 行とする行列).
+		// 後方出力の batchNum は直前の前方出力と同じにすること.
+		virtual void ForwardBatch( const Real   *pInput,
+								   Real         *pOutput,
+								   unsigned int batchNum) = 0;
+		virtual void BackwardBatch(const Real   *pDelta,
+								   Real         *pOutput,
+								   unsigned int batchNum) = 0;
+		// 推論専用の前方出力(層の状態を書き換えない).
+		// pWork は GetWorkNum() 要素の作業領域で, スレッドごとに分ければ同時に呼べる.
+		virtual void Evaluate(const Real *pInput,
+							  Real       *pOutput,
+							  Real       *pWork) const = 0;
+		virtual bool EvaluateSparse(const std::vector<unsigned int> &active,
+									Real                            *pOutput) const
+		{
+			return (false);
+		}
+		virtual unsigned int GetWorkNum(void) const {return (0);}
+		// 重み・バイアスは NeuralNet が平坦な領域でまとめて更新する.
+		// 層はそれ以外の値(RReLU のアルファなど)だけを更新する.
 		virtual void Learn(double learnRatio) {}
 		virtual void LearnAdam(double alpha,
 							   double beta1,
 							   double beta2,
 							   double epsilon) {}
-		virtual void LearnAdamReset(void) {}
-		virtual void DeltaNormalize(void) {}
+		// 平坦な領域の値を書き換えた後に呼ぶ(変換済みの値を作り直させる).
+		virtual void ParamChanged(void) {}
+
+		// 学習用の状態(差分・Adam・後方出力用の値)を確保・解放する.
+		// 生成直後は推論専用.
+		virtual void SetMode(Mode mode);
+		Mode         GetMode(void) const {return (m_Mode);}
+
+		// 学習する値(重み・バイアス)の数.
+		unsigned int GetParamNum(void) const {return (m_ParamNum);}
+		// 値・差分・Adam の状態の参照先を移す(NeuralNet の平坦な領域).
+		// 今の内容は新しい領域に複写し, 新しく持つ状態は 0 から始める.
+		// 推論専用なら値以外は NULL.
+		void BindParam(Real *pParam,
+					   Real *pDeltaParam,
+					   Real *pMomentParam,
+					   Real *pVelocityParam);
 		
 		void         SetType(unsigned int type) {m_Type	= type;}
 		unsigned int GetType(void) const        {return (m_Type);}
 
+		void               SetAccuracy(ActivationAccuracy accuracy) {m_Accuracy	= accuracy;}
+		ActivationAccuracy GetAccuracy(void) const                  {return (m_Accuracy);}
+
 		unsigned int GetInputNum( void) const   {return (m_InputNum);}
 		unsigned int GetOutputNum(void) const   {return (m_OutputNum);}
+
+		// 後続の活性化層・Soft-Max層を出力にまとめて適用する(NeuralNet::Compile).
+		void SetActivation(ActivateLayer *pActivation, bool softMax)
+		{
+			m_pActivation	= pActivation;
+			m_SoftMax		= softMax;
+		}
 		
 	  protected:
 		unsigned int	m_Type;
 		unsigned int	m_InputNum;
 		unsigned int	m_OutputNum;
+		Mode			m_Mode;
+
+		ActivateLayer		*m_pActivation;	// まとめて計算する活性化層(なければ NULL)
+		bool				m_SoftMax;		// 最後に Soft-Max をかける
+		ActivationAccuracy	m_Accuracy;		// Sigmoid・Soft-Max の exp の計算精度
+		std::vector<Real>	m_FusedDelta;	// 活性化の微分をかけた出力差分
+
+		// 学習する値と差分・Adam の状態(同じ並びで m_ParamNum 要素ずつ).
+		// NeuralNet に追加するまでは m_LocalParam に持ち, 追加するとネットの領域を参照する.
+		unsigned int		m_ParamNum;
+		std::vector<Real>	m_LocalParam;
+		Real				*m_pParam;
+		Real				*m_pDeltaParam;
+		Real				*m_pMomentParam;
+		Real				*m_pVelocityParam;
+
+		bool GetActivation(Activation<Real> &activation, unsigned int batchNum = 1) const;
+		const Real *FusedDelta(const Real *pDelta, unsigned int batchNum = 1);
+		void ReserveParam(unsigned int paramNum);
+		void ReserveLocalParam(void);
+		// 領域の中の重み・バイアスの位置を設定する(BindParam から呼ぶ).
+		virtual void UpdateParamView(void) {}
 	};
 
 	//----------------------------------------------------------------------
@@ -78,157 +228,137 @@ class NeuralNet
 					unsigned int outputNum);
 		~AffineLayer() {}
 
-		void Forward(const std::vector<double> &input,
-					 std::vector<double>       &output);
-		void Backward(const std::vector<double> &delta,
-					  std::vector<double>       &output);
-		void Learn(double learnRatio);
-		void LearnAdam(double alpha,
-					   double beta1,
-					   double beta2,
-					   double epsilon);
-		void LearnAdamReset(void)
-		{
-			for (unsigned int o = 0; o < m_OutputNum; ++o)
-			{
-				for (unsigned int i = 0; i < m_InputNum; ++i)
-				{
-					MomentWeightAt(  i, o)	= 0.0;
-					VelocityWeightAt(i, o)	= 0.0;
-				}
-				MomentBiasAt(  o)	= 0.0;
-				VelocityBiasAt(o)	= 0.0;
-			}
-		}
-		void DeltaNormalize(void)
-		{
-			double	total;
-
-			total	= 0.0;
-			for (unsigned int i = 0; i < m_DeltaWeight.size(); ++i)
-				total	+= m_DeltaWeight[i] * m_DeltaWeight[i];
-
-			if (total > 0.0)
-			{
-				for (unsigned int i = 0; i < m_DeltaWeight.size(); ++i)
-					m_DeltaWeight[i]	/= total;
-			}
-
-			total	= 0.0;
-			for (unsigned int i = 0; i < m_DeltaBias.size(); ++i)
-				total	+= m_DeltaBias[i] * m_DeltaBias[i];
-
-			if (total > 0.0)
-			{
-				for (unsigned int i = 0; i < m_DeltaBias.size(); ++i)
-					m_DeltaBias[i]	/= total;
-			}
-		}
-		
-		double GetWeight(unsigned int i, unsigned int o) const
+		void Forward(const Real *pInput,
+					 Real       *pOutput);
+		void Backward(const Real *pDelta,
+					  Real       *pOutput);
+		bool ForwardSparse(const std::vector<unsigned int> &active,
+						   Real                            *pOutput);
+		void Evaluate(const Real *pInput,
+					  Real       *pOutput,
+					  Real       *pWork) const;
+		bool EvaluateSparse(const std::vector<unsigned int> &active,
+							Real                            *pOutput) const;
+		void ForwardBatch( const Real   *pInput,
+						   Real         *pOutput,
+						   unsigned int batchNum);
+		void BackwardBatch(const Real   *pDelta,
+						   Real         *pOutput,
+						   unsigned int batchNum);
+		void ResetAccumulator( Real                            *pAccumulator,
+							   const std::vector<unsigned int> &active) const;
+		void UpdateAccumulator(Real                            *pAccumulator,
+							   const std::vector<unsigned int> &added,
+							   const std::vector<unsigned int> &removed) const;
+		Real GetWeight(unsigned int i, unsigned int o) const
 		{
 			return (WeightAt(i, o));
 		}
-		void   SetWeight(unsigned int i, unsigned int o, double w)
+		void SetWeight(unsigned int i, unsigned int o, Real w)
 		{
 			WeightAt(i, o)	= w;
 		}
-		double GetBias(unsigned int o) const
+		Real GetBias(unsigned int o) const
 		{
 			return (BiasAt(o));
 		}
-		void   SetBias(unsigned int o, double b)
+		void SetBias(unsigned int o, Real b)
 		{
 			BiasAt(o)	= b;
 		}
 
 	  private:
-		std::vector<double>	m_Input;
-		std::vector<double>	m_Weight;
-		std::vector<double>	m_Bias;
-		std::vector<double>	m_MomentWeight;
-		std::vector<double>	m_MomentBias;
-		std::vector<double>	m_VelocityWeight;
-		std::vector<double>	m_VelocityBias;
-		std::vector<double>	m_DeltaWeight;
-		std::vector<double>	m_DeltaBias;
+		const Real	*m_pInput;		// 直前の前方出力の入力(参照)
+
+		// 学習する値の領域の中の位置(重み, バイアスの順).
+		Real		*m_pWeight;
+		Real		*m_pBias;
+		Real		*m_pMomentWeight;
+		Real		*m_pMomentBias;
+		Real		*m_pVelocityWeight;
+		Real		*m_pVelocityBias;
+		Real		*m_pDeltaWeight;
+		Real		*m_pDeltaBias;
+
+		// 直前の前方出力が疎入力なら値が 1 の入力番号(後方出力で使う).
+		bool							m_Sparse;
+		const std::vector<unsigned int>	*m_pActive;
+
+		void UpdateParamView(void);
 
+		// 重みは入力順に並べる(出力方向が連続).
 		unsigned int WeightIndex(unsigned int i,
 								 unsigned int o) const
 		{
-			return (o*m_InputNum+i);
+			return (i*m_OutputNum+o);
 		}
-		double &InputAt(unsigned int i)
+		const Real &InputAt(unsigned int i) const
 		{
-			return (m_Input[i]);
+			return (m_pInput[i]);
 		}
-		const double &InputAt(unsigned int i) const
+		Real &WeightAt(unsigned int i, unsigned int o)
 		{
-			return (m_Input[i]);
+			return (m_pWeight[WeightIndex(i, o)]);
 		}
-		double &WeightAt(unsigned int i, unsigned int o)
+		const Real &WeightAt(unsigned int i, unsigned int o) const
 		{
-			return (m_Weight[WeightIndex(i, o)]);
+			return (m_pWeight[WeightIndex(i, o)]);
 		}
-		const double &WeightAt(unsigned int i, unsigned int o) const
+		Real &BiasAt(unsigned int o)
 		{
-			return (m_Weight[WeightIndex(i, o)]);
+			return (m_pBias[o]);
 		}
-		double &BiasAt(unsigned int o)
+		const Real &BiasAt(unsigned int o) const
 		{
-			return (m_Bias[o]);
+			return (m_pBias[o]);
 		}
-		const double &BiasAt(unsigned int o) const
+		Real &MomentWeightAt(unsigned int i, unsigned int o)
 		{
-			return (m_Bias[o]);
+			return (m_pMomentWeight[WeightIndex(i, o)]);
 		}
-		double &MomentWeightAt(unsigned int i, unsigned int o)
+		const Real &MomentWeightAt(unsigned int i, unsigned int o) const
 		{
-			return (m_MomentWeight[WeightIndex(i, o)]);
+			return (m_pMomentWeight[WeightIndex(i, o)]);
 		}
-		const double &MomentWeightAt(unsigned int i, unsigned int o) const
+		Real &VelocityWeightAt(unsigned int i, unsigned int o)
 		{
-			return (m_MomentWeight[WeightIndex(i, o)]);
+			return (m_pVelocityWeight[WeightIndex(i, o)]);
 		}
-		double &VelocityWeightAt(unsigned int i, unsigned int o)
+		const Real &VelocityWeightAt(unsigned int i, unsigned int o) const
 		{
-			return (m_VelocityWeight[WeightIndex(i, o)]);
+			return (m_pVelocityWeight[WeightIndex(i, o)]);
 		}
-		const double &VelocityWeightAt(unsigned int i, unsigned int o) const
+		Real &MomentBiasAt(unsigned int o)
 		{
-			return (m_VelocityWeight[WeightIndex(i, o)]);
+			return (m_pMomentBias[o]);
 		}
-		double &MomentBiasAt(unsigned int o)
+		const Real &MomentBiasAt(unsigned int o) const
 		{
-			return (m_MomentBias[o]);
+			return (m_pMomentBias[o]);
 		}
-		const double &MomentBiasAt(unsigned int o) const
+		Real &VelocityBiasAt(unsigned int o)
 		{
-			return (m_MomentBias[o]);
+			return (m_pVelocityBias[o]);
 		}
-		double &VelocityBiasAt(unsigned int o)
+		const Real &VelocityBiasAt(unsigned int o) const
 		{
-			return (m_VelocityBias[o]);
+			return (m_pVelocityBias[o]);
 		}
-		const double &VelocityBiasAt(unsigned int o) const
+		Real &DeltaWeightAt(unsigned i, unsigned o)
 		{
-			return (m_VelocityBias[o]);
+			return (m_pDeltaWeight[WeightIndex(i, o)]);
 		}
-		double &DeltaWeightAt(unsigned i, unsigned o)
+		const Real &DeltaWeightAt(unsigned i, unsigned o) const
 		{
-			return (m_DeltaWeight[WeightIndex(i, o)]);
+			return (m_pDeltaWeight[WeightIndex(i, o)]);
 		}
-		const double &DeltaWeightAt(unsigned i, unsigned o) const
+		Real &DeltaBiasAt(unsigned int o)
 		{
-			return (m_DeltaWeight[WeightIndex(i, o)]);
+			return (m_pDeltaBias[o]);
 		}
-		double &DeltaBiasAt(unsigned int o)
+		const Real &DeltaBiasAt(unsigned int o) const
 		{
-			return (m_DeltaBias[o]);
-		}
-		const double &DeltaBiasAt(unsigned int o) const
-		{
-			return (m_DeltaBias[o]);
+			return (m_pDeltaBias[o]);
 		}
 	};
 	//----------------------------------------------------------------------
@@ -241,14 +371,37 @@ class NeuralNet
 		virtual ~ActivateLayer(void)
 		{}
 		
-		void Forward(const std::vector<double> &input,
-					 std::vector<double>       &output);
-		void Backward(const std::vector<double> &delta,
-					  std::vector<double>       &output);
+		void Forward(const Real *pInput,
+					 Real       *pOutput);
+		void Backward(const Real *pDelta,
+					  Real       *pOutput);
+		void ForwardBatch( const Real   *pInput,
+						   Real         *pOutput,
+						   unsigned int batchNum);
+		void BackwardBatch(const Real   *pDelta,
+						   Real         *pOutput,
+						   unsigned int batchNum);
+		void Evaluate(const Real *pInput,
+					  Real       *pOutput,
+					  Real       *pWork) const;
+		void SetMode(Mode mode);
 
-	  public:
-		virtual double ForwardFunc( double x, unsigned int index) = 0;
-		virtual double BackwardFunc(double x, unsigned int index) = 0;
+		// 出力にまとめて適用するときの活性化の種類とパラメータ.
+		// 微分値の書き込み先(pMask)は呼び出し側で設定する.
+		virtual void GetActivation(Activation<Real> &activation) const = 0;
+
+		// 学習用なら N 件分の微分値の領域を確保する.
+		void ReserveMask(unsigned int batchNum);
+
+		Real *MaskData(void)
+		{
+			return (m_Mask.empty() ? NULL : &m_Mask[0]);
+		}
+
+	  protected:
+		// 前方出力時の微分値(推論専用なら空).
+		// 後方出力は出力差分にそのままかけるので, ReLU でも 0/1 を実数で持つ.
+		std::vector<Real>	m_Mask;
 	};
 	//----------------------------------------------------------------------
 	/// ReLU層
@@ -257,33 +410,18 @@ class NeuralNet
 	  public:
 		ReLULayer(unsigned int inputNum) :
 		ActivateLayer(inputNum, LayerType::ReLU)
-		{
-			m_Mask.resize(inputNum);
-		}
+		{}
 		ReLULayer(unsigned int inputNum, LayerType type) :
 		ActivateLayer(inputNum, type)
-		{
-			m_Mask.resize(inputNum);
-		}
+		{}
 		virtual ~ReLULayer() {}
 
-	  protected:
-		double ForwardFunc(double x, unsigned int index)
+		void GetActivation(Activation<Real> &activation) const
 		{
-			if (x < 0.0)
-			{
-				m_Mask[index]	= false;
-				return (0.0);
-			}
-
-			m_Mask[index]	= true;
-			return (x);
+			activation.type		= ActivationReLU;
+			activation.alpha	= 0;
+			activation.pAlpha	= NULL;
 		}
-		double BackwardFunc(double x, unsigned int index)
-		{
-			return (m_Mask[index] ? x : 0.0);
-		}
-		std::vector<bool>	m_Mask;
 	};
 	//----------------------------------------------------------------------
 	/// Randomized ReLU層
@@ -301,63 +439,52 @@ class NeuralNet
 		{
 			Learn(alpha);
 		}
-		double GetAlpha(unsigned int index) const {return (m_Alpha[index]);}
-		void   SetAlpha(unsigned int index, double alpha)
+		Real GetAlpha(unsigned int index) const {return (m_Alpha[index]);}
+		void SetAlpha(unsigned int index, Real alpha)
 		{
 			m_Alpha[index]	= alpha;
 		}
+		// 学習時のアルファの乱数系列を固定する.
+		void SetSeed(unsigned int seed) {m_Random.seed(seed);}
+		// 乱数系列の状態(学習状態の保存用).
+		const std::mt19937 &GetRandom(void) const {return (m_Random);}
+		void SetRandom(const std::mt19937 &random) {m_Random = random;}
+		void GetActivation(Activation<Real> &activation) const
+		{
+			activation.type		= ActivationLeaky;
+			activation.alpha	= 0;
+			activation.pAlpha	= &m_Alpha[0];
+		}
 	  private:
-		double	GetRandomAlpha(void);
+		std::mt19937	m_Random;
+
+		Real	GetRandomAlpha(void);
 		
 	  protected:
-		double ForwardFunc(double x, unsigned int index)
-		{
-			if (x < 0.0)
-			{
-				m_Mask[index]	= false;
-				return (x * m_Alpha[index]);
-			}
-
-			m_Mask[index]	= true;
-			return (x);
-		}
-		double BackwardFunc(double x, unsigned int index)
-		{
-			return (m_Mask[index] ? x : x * m_Alpha[index]);
-		}
-		std::vector<double>	m_Alpha;
+		std::vector<Real>	m_Alpha;
 	};
 	//----------------------------------------------------------------------
 	/// Leaky ReLU層
 	class LReLULayer : public ReLULayer
 	{
 	  public:
-		LReLULayer(unsigned int inputNum, double alpha) :
+		LReLULayer(unsigned int inputNum, Real alpha) :
 		ReLULayer(inputNum, LayerType::LReLU),
 		m_Alpha(alpha)
 		{}
 		~LReLULayer() {}
 
-		double GetAlpha(void) const   {return (m_Alpha);}
-		void   SetAlpha(double alpha) {m_Alpha	= alpha;}
-	
-	  protected:
-		double ForwardFunc(double x, unsigned int index)
+		Real GetAlpha(void) const   {return (m_Alpha);}
+		void SetAlpha(Real alpha)   {m_Alpha	= alpha;}
+		void GetActivation(Activation<Real> &activation) const
 		{
-			if (x < 0.0)
-			{
-				m_Mask[index]	= false;
-				return (x * m_Alpha);
-			}
-
-			m_Mask[index]	= true;
-			return (x);
+			activation.type		= ActivationLeaky;
+			activation.alpha	= m_Alpha;
+			activation.pAlpha	= NULL;
 		}
-		double BackwardFunc(double x, unsigned int index)
-		{
-			return (m_Mask[index] ? x : x * m_Alpha);
-		}
-		double	m_Alpha;
+	
+	  protected:
+		Real	m_Alpha;
 	};
 	
 	//----------------------------------------------------------------------
@@ -367,23 +494,15 @@ class NeuralNet
 	  public:
 		SigmoidLayer(unsigned int inputNum) :
 		ActivateLayer(inputNum, LayerType::Sigmoid)
-		{
-			m_Mask.resize(inputNum);
-		}
+		{}
 		~SigmoidLayer() {}
 
-	  protected:
-		double ForwardFunc(double x, unsigned int index)
-		{
-			m_Mask[index]	= 1.0 / (1.0 + exp(-x));
-			return (m_Mask[index]);
-		}
-		double BackwardFunc(double x, unsigned int index)
+		void GetActivation(Activation<Real> &activation) const
 		{
-			return (x * (1.0 - m_Mask[index]) * m_Mask[index]);
+			activation.type		= ActivationSigmoid;
+			activation.alpha	= 0;
+			activation.pAlpha	= NULL;
 		}
-	  private:
-		std::vector<double>	m_Mask;
 	};
 
 	//----------------------------------------------------------------------
@@ -396,10 +515,19 @@ class NeuralNet
 		{}
 		~SoftMaxLayer() {}
 
-		void Forward(const std::vector<double> &input,
-					 std::vector<double>       &output);
-		void Backward(const std::vector<double> &delta,
-					  std::vector<double>       &output);
+		void Forward(const Real *pInput,
+					 Real       *pOutput);
+		void Backward(const Real *pDelta,
+					  Real       *pOutput);
+		void Evaluate(const Real *pInput,
+					  Real       *pOutput,
+					  Real       *pWork) const;
+		void ForwardBatch( const Real   *pInput,
+						   Real         *pOutput,
+						   unsigned int batchNum);
+		void BackwardBatch(const Real   *pDelta,
+						   Real         *pOutput,
+						   unsigned int batchNum);
 	};
 
 	//----------------------------------------------------------------------
@@ -407,7 +535,7 @@ class NeuralNet
 	class FilterLayer : public Layer
 	{
 	  private:
-		const double	m_PaddingValue	= 0.0;
+		const Real	m_PaddingValue	= 0;
 
 	  public:
 		FilterLayer(unsigned int width,
@@ -470,13 +598,15 @@ class NeuralNet
 				   +w*(m_HMax)
 				   +h);
 		}
+		// フィルタはフィルタ毎に(チャンネル, x, y)順で並べる.
+		// (行列積で f x (c*F*F) の行列としてそのまま使える)
 		int FilterIndex(unsigned int x,
 						unsigned int y,
 						unsigned int f,
 						unsigned int c) const
 		{
-			return (c*(m_FilterNum*m_FilterSize*m_FilterSize)
-				   +f*(m_FilterSize*m_FilterSize)
+			return (f*(m_Channel*m_FilterSize*m_FilterSize)
+				   +c*(m_FilterSize*m_FilterSize)
 				   +x*(m_FilterSize)
 				   +y);
 		}
@@ -497,6 +627,14 @@ class NeuralNet
 	class ConvolutionLayer : public FilterLayer
 	{
 	  public:
+		// 計算方式.
+		typedef enum Engine
+		{
+			DirectEngine,		// 直接ループ
+			GemmEngine,			// im2col + 行列積
+			WinogradEngine,		// Winograd F(2x2,3x3)(3x3, ストライド1のみ)
+		} Engine;
+
 		ConvolutionLayer(unsigned int width,
 						 unsigned int height,
 						 unsigned int channel,
@@ -506,245 +644,231 @@ class NeuralNet
 						 unsigned int padding);
 		~ConvolutionLayer() {}
 
-		void Forward(const std::vector<double> &input,
-					 std::vector<double>       &output);
-		void Backward(const std::vector<double> &delta,
-					  std::vector<double>       &output);
-		void Learn(double learnRatio);
-		void LearnAdam(double alpha,
-					   double beta1,
-					   double beta2,
-					   double epsilon);
-		void LearnAdamReset(void)
-		{
-			// フィルタ数ループ
-			for (unsigned int f = 0; f < m_FilterNum; ++f)
-			{
-				// チャンネル数ループ
-				for (unsigned int c = 0; c < m_Channel; ++c)
-				{
-					// フィルタ計算.
-					for (unsigned int i = 0; i < m_FilterSize; ++i)
-					{
-						for (unsigned int j = 0; j < m_FilterSize; ++j)
-						{
-							MomentFilterAt(  i, j, f, c)	= 0.0;
-							VelocityFilterAt(i, j, f, c)	= 0.0;
-						}
-					}
-					MomentBiasAt(  f, c)	= 0.0;
-					VelocityBiasAt(f, c)	= 0.0;
-				}
-			}
-		}
-		void DeltaNormalize(void)
-		{
-			double	total;
-
-			total	= 0.0;
-			for (unsigned int i = 0; i < m_DeltaFilter.size(); ++i)
-				total	+= m_DeltaFilter[i] * m_DeltaFilter[i];
-
-			if (total > 0.0)
-			{
-				for (unsigned int i = 0; i < m_DeltaFilter.size(); ++i)
-					m_DeltaFilter[i]	/= total;
-			}
-
-			total	= 0.0;
-			for (unsigned int i = 0; i < m_DeltaBias.size(); ++i)
-				total	+= m_DeltaBias[i] * m_DeltaBias[i];
-
-			if (total > 0.0)
-			{
-				for (unsigned int i = 0; i < m_DeltaBias.size(); ++i)
-					m_DeltaBias[i]	/= total;
-			}
-		}
-
-		double GetFilter(unsigned int x,
-						 unsigned int y,
-						 unsigned int f,
-						 unsigned int c) const
+		void Forward(const Real *pInput,
+					 Real       *pOutput);
+		void Backward(const Real *pDelta,
+					  Real       *pOutput);
+		void Evaluate(const Real *pInput,
+					  Real       *pOutput,
+					  Real       *pWork) const;
+		unsigned int GetWorkNum(void) const;
+		void ForwardBatch( const Real   *pInput,
+						   Real         *pOutput,
+						   unsigned int batchNum);
+		void BackwardBatch(const Real   *pDelta,
+						   Real         *pOutput,
+						   unsigned int batchNum);
+		void SetMode(Mode mode);
+		void ParamChanged(void) {m_WinogradValid	= false;}
+
+		void   SetEngine(Engine engine);
+		Engine GetEngine(void) const {return (m_Engine);}
+
+		// Winograd 変換後フィルタの作成(Evaluate の前に済ませておく).
+		void   UpdateWinogradFilter(void);
+
+		Real GetFilter(unsigned int x,
+					   unsigned int y,
+					   unsigned int f,
+					   unsigned int c) const
 		{
 			return (FilterAt(x, y, f, c));
 		}
-		void   SetFilter(unsigned int x,
-						 unsigned int y,
-						 unsigned int f,
-						 unsigned int c,
-						 double       v)
+		void SetFilter(unsigned int x,
+					   unsigned int y,
+					   unsigned int f,
+					   unsigned int c,
+					   Real         v)
 		{
 			FilterAt(x, y, f, c)	= v;
+			m_WinogradValid			= false;
 		}
-		double GetBias(unsigned int f, unsigned int c) const
+		Real GetBias(unsigned int f, unsigned int c) const
 		{
 			return (BiasAt(f, c));
 		}
-		void   SetBias(unsigned int f, unsigned int c, double b)
+		void SetBias(unsigned int f, unsigned int c, Real b)
 		{
 			BiasAt(f, c)	= b;
 		}
 		
 	  protected:
-		std::vector<double>	m_Input;
-		std::vector<double>	m_Filter;
-		std::vector<double>	m_Bias;
-		std::vector<double>	m_MomentFilter;
-		std::vector<double>	m_VelocityFilter;
-		std::vector<double>	m_MomentBias;
-		std::vector<double>	m_VelocityBias;
-		std::vector<double>	m_DeltaFilter;
-		std::vector<double>	m_DeltaBias;
+		Engine				m_Engine;
+		std::vector<Real>	m_Column;
+		std::vector<Real>	m_DeltaColumn;
+		std::vector<Real>	m_WinogradFilter;
+		std::vector<Real>	m_WinogradBackFilter;
+		bool				m_WinogradValid;
+
+		const Real			*m_pInput;		// 直前の前方出力の入力(参照)
+
+		// 学習する値の領域の中の位置(フィルタ, バイアスの順).
+		Real				*m_pFilter;
+		Real				*m_pBias;
+		Real				*m_pMomentFilter;
+		Real				*m_pVelocityFilter;
+		Real				*m_pMomentBias;
+		Real				*m_pVelocityBias;
+		Real				*m_pDeltaFilter;
+		Real				*m_pDeltaBias;
+
+		void UpdateParamView(void);
+		void ForwardEngine( const Real *pInput,
+							Real       *pOutput);
+		void BackwardEngine(const Real *pDelta,
+							Real       *pOutput);
+		void ForwardDirect(const Real *pInput,
+						   Real       *pOutput) const;
+		void ForwardGemm(  const Real *pInput,
+						   Real       *pOutput,
+						   Real       *pColumn) const;
+		void BackwardDirect(const Real *pDelta,
+							Real       *pOutput);
+		void BackwardGemm(  const Real *pDelta,
+							Real       *pOutput);
+		void ForwardWinograd( const Real *pInput,
+							  Real       *pOutput) const;
+		void BackwardWinograd(const Real *pDelta,
+							  Real       *pOutput);
 
 		unsigned int BiasIndex(unsigned int f,
 							   unsigned int c) const
 		{
 			return (f*m_Channel+c);
 		}
-		double &InputAt(unsigned int i)
+		const Real &InputAt(unsigned int i) const
 		{
-			return (m_Input[i]);
+			return (m_pInput[i]);
 		}
-		const double &InputAt(unsigned int i) const
+		const Real &InputAt(unsigned int w,
+							unsigned int h,
+							unsigned int c) const
 		{
-			return (m_Input[i]);
+			return (m_pInput[InputIndex(w, h, c)]);
 		}
-		double &InputAt(unsigned int w,
-						unsigned int h,
-						unsigned int c)
+		Real &FilterAt(unsigned int x,
+					   unsigned int y,
+					   unsigned int f,
+					   unsigned int c)
 		{
-			return (m_Input[InputIndex(w, h, c)]);
+			return (m_pFilter[FilterIndex(x, y, f, c)]);
 		}
-		const double &InputAt(unsigned int w,
-							  unsigned int h,
-							  unsigned int c) const
+		const Real &FilterAt(unsigned int x,
+							 unsigned int y,
+							 unsigned int f,
+							 unsigned int c) const
 		{
-			return (m_Input[InputIndex(w, h, c)]);
+			return (m_pFilter[FilterIndex(x, y, f, c)]);
 		}
-		double &FilterAt(unsigned int x,
-						 unsigned int y,
-						 unsigned int f,
-						 unsigned int c)
+		Real &FilterBackAt(unsigned int x,
+						   unsigned int y,
+						   unsigned int f,
+						   unsigned int c)
 		{
-			return (m_Filter[FilterIndex(x, y, f, c)]);
+			return (m_pFilter[FilterBackIndex(x, y, f, c)]);
 		}
-		const double &FilterAt(unsigned int x,
-							   unsigned int y,
-							   unsigned int f,
-							   unsigned int c) const
+		const Real &FilterBackAt(unsigned int x,
+								 unsigned int y,
+								 unsigned int f,
+								 unsigned int c) const
 		{
-			return (m_Filter[FilterIndex(x, y, f, c)]);
+			return (m_pFilter[FilterBackIndex(x, y, f, c)]);
 		}
-		double &FilterBackAt(unsigned int x,
+		Real &BiasAt(unsigned int f,
+					 unsigned int c)
+		{
+			return (m_pBias[BiasIndex(f, c)]);
+		}
+		const Real &BiasAt(unsigned int f,
+						   unsigned int c) const
+		{
+			return (m_pBias[BiasIndex(f, c)]);
+		}
+		Real &MomentFilterAt(unsigned int x,
 							 unsigned int y,
 							 unsigned int f,
 							 unsigned int c)
 		{
-			return (m_Filter[FilterBackIndex(x, y, f, c)]);
+			return (m_pMomentFilter[FilterIndex(x, y, f, c)]);
 		}
-		const double &FilterBackAt(unsigned int x,
+		const Real &MomentFilterAt(unsigned int x,
 								   unsigned int y,
 								   unsigned int f,
 								   unsigned int c) const
 		{
-			return (m_Filter[FilterBackIndex(x, y, f, c)]);
-		}
-		double &BiasAt(unsigned int f,
-					   unsigned int c)
-		{
-			return (m_Bias[BiasIndex(f, c)]);
-		}
-		const double &BiasAt(unsigned int f,
-							 unsigned int c) const
-		{
-			return (m_Bias[BiasIndex(f, c)]);
+			return (m_pMomentFilter[FilterIndex(x, y, f, c)]);
 		}
-		double &MomentFilterAt(unsigned int x,
+		Real &VelocityFilterAt(unsigned int x,
 							   unsigned int y,
 							   unsigned int f,
 							   unsigned int c)
 		{
-			return (m_MomentFilter[FilterIndex(x, y, f, c)]);
+			return (m_pVelocityFilter[FilterIndex(x, y, f, c)]);
 		}
-		const double &MomentFilterAt(unsigned int x,
+		const Real &VelocityFilterAt(unsigned int x,
 									 unsigned int y,
 									 unsigned int f,
 									 unsigned int c) const
 		{
-			return (m_MomentFilter[FilterIndex(x, y, f, c)]);
+			return (m_pVelocityFilter[FilterIndex(x, y, f, c)]);
 		}
-		double &VelocityFilterAt(unsigned int x,
-								 unsigned int y,
-								 unsigned int f,
-								 unsigned int c)
-		{
-			return (m_VelocityFilter[FilterIndex(x, y, f, c)]);
-		}
-		const double &VelocityFilterAt(unsigned int x,
-									   unsigned int y,
-									   unsigned int f,
-									   unsigned int c) const
-		{
-			return (m_VelocityFilter[FilterIndex(x, y, f, c)]);
-		}
-		double &MomentBiasAt(unsigned int f,
-							unsigned int c)
+		Real &MomentBiasAt(unsigned int f,
+						   unsigned int c)
 		{
-			return (m_MomentBias[BiasIndex(f, c)]);
+			return (m_pMomentBias[BiasIndex(f, c)]);
 		}
-		const double &MomentBiasAt(unsigned int f,
-								  unsigned int c) const
+		const Real &MomentBiasAt(unsigned int f,
+								 unsigned int c) const
 		{
-			return (m_MomentBias[BiasIndex(f, c)]);
+			return (m_pMomentBias[BiasIndex(f, c)]);
 		}
-		double &VelocityBiasAt(unsigned int f,
-							   unsigned int c)
-		{
-			return (m_VelocityBias[BiasIndex(f, c)]);
-		}
-		const double &VelocityBiasAt(unsigned int f,
-									 unsigned int c) const
+		Real &VelocityBiasAt(unsigned int f,
+							 unsigned int c)
 		{
-			return (m_VelocityBias[BiasIndex(f, c)]);
+			return (m_pVelocityBias[BiasIndex(f, c)]);
 		}
-		double &DeltaFilterAt(unsigned int x,
-							  unsigned int y,
-							  unsigned int f,
-							  unsigned int c)
+		const Real &VelocityBiasAt(unsigned int f,
+								   unsigned int c) const
 		{
-			return (m_DeltaFilter[FilterIndex(x, y, f, c)]);
+			return (m_pVelocityBias[BiasIndex(f, c)]);
 		}
-		const double &DeltaFilterAt(unsigned int x,
-									unsigned int y,
-									unsigned int f,
-									unsigned int c) const
+		Real &DeltaFilterAt(unsigned int x,
+							unsigned int y,
+							unsigned int f,
+							unsigned int c)
 		{
-			return (m_DeltaFilter[FilterIndex(x, y, f, c)]);
+			return (m_pDeltaFilter[FilterIndex(x, y, f, c)]);
 		}
-		double &DeltaFilterBackAt(unsigned int x,
+		const Real &DeltaFilterAt(unsigned int x,
 								  unsigned int y,
 								  unsigned int f,
-								  unsigned int c)
+								  unsigned int c) const
 		{
-			return (m_DeltaFilter[FilterBackIndex(x, y, f, c)]);
+			return (m_pDeltaFilter[FilterIndex(x, y, f, c)]);
 		}
-		const double &DeltaFilterBackAt(unsigned int x,
-										unsigned int y,
-										unsigned int f,
-										unsigned int c) const
+		Real &DeltaFilterBackAt(unsigned int x,
+								unsigned int y,
+								unsigned int f,
+								unsigned int c)
 		{
-			return (m_DeltaFilter[FilterBackIndex(x, y, f, c)]);
+			return (m_pDeltaFilter[FilterBackIndex(x, y, f, c)]);
 		}
-		double &DeltaBiasAt(unsigned int f,
-							unsigned int c)
+		const Real &DeltaFilterBackAt(unsigned int x,
+									  unsigned int y,
+									  unsigned int f,
+									  unsigned int c) const
 		{
-			return (m_DeltaBias[BiasIndex(f, c)]);
+			return (m_pDeltaFilter[FilterBackIndex(x, y, f, c)]);
 		}
-		const double &DeltaBiasAt(unsigned int f,
-								  unsigned int c) const
+		Real &DeltaBiasAt(unsigned int f,
+						  unsigned int c)
 		{
-			return (m_DeltaBias[BiasIndex(f, c)]);
+			return (m_pDeltaBias[BiasIndex(f, c)]);
+		}
+		const Real &DeltaBiasAt(unsigned int f,
+								unsigned int c) const
+		{
+			return (m_pDeltaBias[BiasIndex(f, c)]);
 		}
 	};
 	//----------------------------------------------------------------------
@@ -793,13 +917,29 @@ class NeuralNet
 		}
 		~MaxPoolingLayer() {}
 
-		void Forward(const std::vector<double> &input,
-					 std::vector<double>       &output);
-		void Backward(const std::vector<double> &delta,
-					  std::vector<double>       &output);
+		void Forward(const Real *pInput,
+					 Real       *pOutput);
+		void Backward(const Real *pDelta,
+					  Real       *pOutput);
+		void Evaluate(const Real *pInput,
+					  Real       *pOutput,
+					  Real       *pWork) const;
+		void ForwardBatch( const Real   *pInput,
+						   Real         *pOutput,
+						   unsigned int batchNum);
+		void BackwardBatch(const Real   *pDelta,
+						   Real         *pOutput,
+						   unsigned int batchNum);
 
 	  private:
-		std::vector<unsigned int>	m_Mask;
+		std::vector<unsigned int>	m_Mask;		// 出力ごとに選んだ入力番号(1 件ごとに出力数)
+
+		void ForwardSample( const Real   *pInput,
+							Real         *pOutput,
+							unsigned int *pMask) const;
+		void BackwardSample(const Real         *pDelta,
+							Real               *pOutput,
+							const unsigned int *pMask);
 	};
 
 	//----------------------------------------------------------------------
@@ -808,13 +948,90 @@ class NeuralNet
 	std::vector<std::shared_ptr<Layer>>	m_Layer;
 
 	// 入力値.
-	std::vector<double>	m_Input;
+	std::vector<Real>	m_Input;
+
+	// 入力が 0/1 のとき値が 1 の入力番号(先頭層の疎入力用).
+	bool						m_SparseInput;
+	std::vector<unsigned int>	m_Active;
 
 	// 出力値.
-	std::vector<double>	m_Output;
+	std::vector<Real>	m_Output;
 
 	// 損失値.
-	std::vector<double>	m_Loss;
+	std::vector<Real>	m_Loss;
+
+	// まとめて計算する N 件の入力値・出力値・損失値(1 件を 1 行とする行列).
+	unsigned int		m_BatchNum;
+	std::vector<Real>	m_BatchInput;
+	std::vector<Real>	m_BatchOutput;
+	std::vector<Real>	m_BatchLoss;
+
+	// 先頭の全結合層の活性化前出力(差分評価用, 局面ごとに積む).
+	std::vector<Real>	m_Accumulator;
+	unsigned int		m_AccumulatorDepth;
+
+	// 動作モード(推論専用なら学習用の状態を持たない).
+	Mode				m_Mode;
+
+	// Sigmoid・Soft-Max の exp の計算精度.
+	ActivationAccuracy	m_Accuracy;
+
+	// 全層の学習する値と差分・Adam の状態を並べた平坦な領域.
+	// [値|差分|モーメント|速度] の順に m_ParamNum 要素ずつ(推論専用なら値だけ).
+	// 各層の先頭は 64 バイト境界にそろえ, 間の詰め物は 0 のままにする.
+	std::vector<Real>	m_ParamArena;
+	Real				*m_pParam;
+	unsigned int		m_ParamNum;
+	// 値の参照先(通常は m_pParam. ShareParam すると共有元のネットの値).
+	Real				*m_pValue;
+	// モーメント・速度(続けて並ぶ)の参照先(通常は m_pParam の後半.
+	// 状態も ShareParam すると共有元のネットのもの. 推論専用なら NULL).
+	Real				*m_pState;
+	// 値の更新回数(Adam のバイアス補正に使う).
+	unsigned int		m_LearnStep;
+
+	// 差分のノルムの扱いと, 直前の更新で求めたノルム.
+	NormMode			m_NormMode;
+	double				m_NormLimit;
+	double				m_DeltaNorm;
+
+	Real   DeltaScale(void);
+
+	// 前の層に融合した層(Compile).
+	std::vector<bool>	m_Absorbed;
+
+	// 層の間の作業領域(index 番目の層の入力, 層の追加時に確保).
+	// 先頭の入力と最後の出力は m_Input/m_Output か呼び出し側の配列, 最後の差分は m_Loss を使う.
+	// 各層は入力を参照するので, 後方出力まで書き換えない.
+	std::vector<std::vector<Real>>	m_Activation;
+	std::vector<std::vector<Real>>	m_Delta;
+
+	bool IsAbsorbed(unsigned int index) const
+	{
+		return ((index < m_Absorbed.size()) && m_Absorbed[index]);
+	}
+	// 融合した層を飛ばした次の層の番号.
+	unsigned int NextLayer(unsigned int index) const
+	{
+		while (IsAbsorbed(++index))
+			;
+
+		return (index);
+	}
+	void PlanParam(void);
+	bool IsSameStructure(const NeuralNet &net) const;
+	bool ReadTrainingState(const std::vector<char> &data, unsigned int &index);
+	void PlanWorkspace(void);
+	void PlanBatchWorkspace(unsigned int batchNum);
+	void ForwardLayers(const Real *pInput, Real *pOutput, bool sparse);
+	void ForwardLayersBatch(const Real *pInput, Real *pOutput, unsigned int batchNum);
+	void PlanContext(ExecutionContext &context) const;
+	void EvaluateLayers(const Real       *pInput,
+						Real             *pOutput,
+						bool             sparse,
+						ExecutionContext &context) const;
+	static bool FindActiveInput(const std::vector<double>  &input,
+								std::vector<unsigned int> &active);
 	
 	static void WriteIntData(std::vector<char> &data,
 							 unsigned int      value)
@@ -824,13 +1041,26 @@ class NeuralNet
 		for (int i = 0; i < sizeof(value); ++i)
 			data.push_back(*pChar++);
 	}
-	static void WriteDoubleData(std::vector<char> &data,
-								double            value)
+	static void WriteRealData(std::vector<char> &data,
+							  Real              value,
+							  Precision         precision)
 	{
-		char *pChar	= (char *)&value;
+		if (precision == Precision::SinglePrecision)
+		{
+			float	single	= (float)value;
+			char	*pChar	= (char *)&single;
 
-		for (int i = 0; i < sizeof(value); ++i)
-			data.push_back(*pChar++);
+			for (int i = 0; i < sizeof(single); ++i)
+				data.push_back(*pChar++);
+		}
+		else
+		{
+			double	full	= value;
+			char	*pChar	= (char *)&full;
+
+			for (int i = 0; i < sizeof(full); ++i)
+				data.push_back(*pChar++);
+		}
 	}
 	static unsigned int ReadIntData(const std::vector<char> &data,
 									unsigned int            &index)
@@ -845,9 +1075,23 @@ class NeuralNet
 
 		return (value);
 	}
-	static double ReadDoubleData(const std::vector<char> &data,
-								 unsigned int            &index)
+	static Real ReadRealData(const std::vector<char> &data,
+							 unsigned int            &index,
+							 Precision               precision)
 	{
+		if (precision == Precision::SinglePrecision)
+		{
+			float	value;
+			char	*pChar	= (char *)&value;
+
+			for (int i = 0; i < sizeof(value); ++i)
+				pChar[i]	=  data[index+i];
+
+			index	+= sizeof(value);
+
+			return (value);
+		}
+
 		double	value;
 		char	*pChar	= (char *)&value;
 
@@ -856,20 +1100,23 @@ class NeuralNet
 
 		index	+= sizeof(value);
 
-		return (value);
+		return ((Real)value);
 	}
 	bool CheckAddLayerConnect(void)
 	{
-		if (m_Layer.size() < 2)
-			return (true);
-
-		if (m_Layer[m_Layer.size()-2]->GetOutputNum()
-		!=  m_Layer[m_Layer.size()-1]->GetInputNum())
+		if ((m_Layer.size() >= 2)
+		&&  (m_Layer[m_Layer.size()-2]->GetOutputNum()
+		!=   m_Layer[m_Layer.size()-1]->GetInputNum()))
 		{
 			m_Layer.pop_back();
 			
 			return (false);
 		}
+
+		PlanParam();
+		m_Layer[m_Layer.size()-1]->SetMode(m_Mode);
+		m_Layer[m_Layer.size()-1]->SetAccuracy(m_Accuracy);
+		PlanWorkspace();
 		
 		return (true);
 	}
@@ -905,6 +1152,7 @@ class NeuralNet
 							  unsigned int padding);
 
 	void   SetInput( const std::vector<double> &input);
+	void   SetSparseInput(const std::vector<unsigned int> &active);
 	void   GetOutput(std::vector<double> &output) const;
 
 	double CalcSquareLoss(      const std::vector<double> &teacher);
@@ -913,13 +1161,102 @@ class NeuralNet
 	void   Forward( void);
 	void   Backward(void);
 
-	void   Learn(    double learnRatio = 0.001);
-	void   LearnAdam(double alpha   = 0.001,
-					 double beta1   = 0.9,
-					 double beta2   = 0.999,
-					 double epsilon = 1.0e-8);
+	// 呼び出し側の配列を直接読み書きする(推論用, 入出力の複製なし).
+	void   Forward(const Real *pInput, Real *pOutput);
+
+	// N 件をまとめて計算する. 重み差分には N 件分を加算する.
+	void   SetInputBatch( const std::vector<std::vector<double>> &input);
+	void   GetOutputBatch(std::vector<std::vector<double>> &output) const;
+	unsigned int GetBatchNum(void) const {return (m_BatchNum);}
+
+	double CalcSquareLossBatch(      const std::vector<std::vector<double>> &teacher);
+	double CalcCrossEntropyLossBatch(const std::vector<std::vector<double>> &teacher,
+									 double                                 *pSampleLoss = NULL);
+
+	void   ForwardBatch( void);
+	void   BackwardBatch(void);
+
+	// 入力・出力は batchNum x GetInputNum(), batchNum x GetOutputNum() の行列(推論用).
+	void   ForwardBatch(const Real *pInput, Real *pOutput, unsigned int batchNum);
+
+	// 重みを共有した推論(ネットの状態を書き換えない).
+	// 実行状態をスレッドごとに分ければ複数スレッドから同時に呼べる.
+	// その間は層の追加・読み込み・学習・Compile をしないこと.
+	void   Evaluate(const Real *pInput, Real *pOutput, ExecutionContext &context) const;
+	void   Evaluate(const std::vector<double> &input,
+					std::vector<double>       &output,
+					ExecutionContext          &context) const;
+
+	// 全結合層・畳み込み層に後続の活性化層・Soft-Max 層を融合する.
+	// Evaluate 用に Winograd 変換後フィルタもここで作る.
+	void   Compile(  void);
+	void   Decompile(void);
+
+	// 先頭が全結合層で入力が 0/1 のとき, 入力の変化分だけで 1 層目を更新して評価する.
+	// 推論専用. 重みを変えたら ResetAccumulator からやり直すこと.
+	bool   ResetAccumulator(const std::vector<unsigned int> &active);
+	bool   PushAccumulator( const std::vector<unsigned int> &added,
+							const std::vector<unsigned int> &removed);
+	void   PopAccumulator(  void);
+	void   ForwardAccumulator(void);
+	unsigned int GetAccumulatorDepth(void) const {return (m_AccumulatorDepth);}
+
+	// 値の更新は全層の平坦な領域を 1 回の走査で処理する.
+	// Learn はモーメンタム付き SGD(モーメンタムは Adam のモーメントの領域を使う),
+	// LearnAdam は更新回数でバイアス補正し, weightDecay を指定すると AdamW になる.
+	void   Learn(    double learnRatio  = 0.001,
+					 double momentum    = 0.0,
+					 double weightDecay = 0.0);
+	void   LearnAdam(double alpha       = 0.001,
+					 double beta1       = 0.9,
+					 double beta2       = 0.999,
+					 double epsilon     = 1.0e-8,
+					 double weightDecay = 0.0);
+	// モーメント・速度と更新回数を 0 に戻す.
 	void   LearnAdamReset(void);
-	void   DeltaNormalize(void);
+	unsigned int GetLearnStep(void) const {return (m_LearnStep);}
+	// 状態を共有した複製で更新したときに, 共有元の更新回数を進める.
+	void   SetLearnStep(unsigned int learnStep) {m_LearnStep = learnStep;}
+
+	// Learn 系の前に全層の差分の L2 ノルムを 1 回の走査で求め,
+	// 上限で切る・そろえる倍率は更新の走査の中で差分にかける.
+	// GetDeltaNorm は直前の更新で求めたノルム(倍率をかける前. 学習の監視用).
+	void   SetDeltaNormLimit(NormMode mode, double limit);
+	NormMode GetDeltaNormMode( void) const {return (m_NormMode);}
+	double   GetDeltaNormLimit(void) const {return (m_NormLimit);}
+	double   GetDeltaNorm(     void) const {return (m_DeltaNorm);}
+
+	// 全層の学習する値(重み・バイアス)・差分の平坦な配列(GetParamNum() 要素).
+	// 層の順に並び, 各層の先頭は 64 バイト境界. 差分は学習用のときだけ(推論専用なら NULL).
+	// 値を直接書き換えたら ParamChanged を呼ぶこと.
+	unsigned int GetParamNum(void) const {return (m_ParamNum);}
+	Real       *GetParam(void)       {return (m_pValue);}
+	const Real *GetParam(void) const {return (m_pValue);}
+	Real       *GetDeltaParam(void)
+	{
+		return ((m_Mode == Mode::TrainingMode) ? m_pParam + m_ParamNum : NULL);
+	}
+	const Real *GetDeltaParam(void) const
+	{
+		return ((m_Mode == Mode::TrainingMode) ? m_pParam + m_ParamNum : NULL);
+	}
+	void   ParamChanged(void);
+
+	// 同じ構成・値(RReLU のアルファも含む)・exp の計算精度のネットを mode で作り直す.
+	// 今の層は捨てる. 学習状態は複写しない(融合もしないので必要なら Compile する).
+	bool   Clone(const NeuralNet &net, Mode mode);
+	// 同じ構成のネットの値を複写する(RReLU のアルファも含む)・差分を加算する.
+	// 構成が違えば何もせず false.
+	bool   CopyParam(    const NeuralNet &net);
+	bool   AddDeltaParam(const NeuralNet &net);
+	// 同じ構成のネットのモーメント・速度・更新回数と RReLU の乱数を複写する(学習用どうし).
+	bool   CopyTrainingState(const NeuralNet &net);
+
+	// 同じ構成のネットの値(重み・バイアス)をこのネットの値として直接使う.
+	// 差分は自分のものを使うので, Learn 系は共有元の値を更新する.
+	// shareState なら Adam のモーメント・速度も共有元のものを使う(更新回数は自分のもの).
+	// 共有元の層の追加・SetMode・破棄の後は使わないこと(SetMode で共有をやめる).
+	bool   ShareParam(NeuralNet &net, bool shareState = false);
 	
 	unsigned int GetInputNum(void) const
 	{
@@ -937,8 +1274,35 @@ class NeuralNet
 		return (m_Layer[m_Layer.size()-1]->GetOutputNum());
 	}
 	
-	void    Save(std::vector<char>       &data);
-	void    Load(const std::vector<char> &data);
+	// 既定では内部の数値型と同じ精度で保存する.
+	// 読み込み時は保存精度を判別して内部の数値型に変換する.
+#ifdef NEURAL_NET_FLOAT
+	void    Save(std::vector<char>       &data,
+				 Precision               precision = Precision::SinglePrecision) const;
+#else
+	void    Save(std::vector<char>       &data,
+				 Precision               precision = Precision::DoublePrecision) const;
+#endif
+	unsigned int Load(const std::vector<char> &data,
+					  Mode                    mode = Mode::TrainingMode);
+
+	// 学習を途中から続けるための状態(モーメント・速度・更新回数・RReLU の乱数)を
+	// Save の後ろに付け足す. 学習用で Load すると付いている状態も戻す(なければ 0 から).
+	// Load の戻り値は学習状態まで読んだバイト数(その後ろは呼び出し側が付け足した状態).
+	void    SaveTrainingState(std::vector<char> &data) const;
+
+	// 推論専用にすると Backward・Learn 系は何もしない.
+	void    SetMode(Mode mode);
+	Mode    GetMode(void) const {return (m_Mode);}
+
+	// Sigmoid・Soft-Max の exp の計算精度(既定は AccuracyExact).
+	// 学習は標準ライブラリのまま, 対局の推論だけ AccuracyFast にする, といった使い分けをする.
+	void    SetAccuracy(ActivationAccuracy accuracy);
+	ActivationAccuracy GetAccuracy(void) const {return (m_Accuracy);}
+
+	// 学習で使う乱数(RReLU のアルファ)の種を固定する.
+	// 並列学習(ParallelTrainer)と合わせるとスレッド数が同じなら結果が毎回同じになる.
+	void    SetRandomSeed(unsigned int seed);
 };
 
 #endif /* NEURAL_NET_H_ */
@@ -0,0 +1,3051 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include "NeuralNetKernel.h"
+
+// AVX2/FMA が使えるビルド(/arch:AVX2, -mavx2 -mfma)のみベクトル化する.
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define NEURAL_NET_AVX2
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	//----------------------------------------------------------------------
+	/// SIMD演算(スカラー版, ベクトル版の端数処理にも使う)
+	template <typename T>
+	struct ScalarTraits
+	{
+		typedef T	Vec;
+
+		static const unsigned int	Width	= 1;
+
+		static Vec  Zero(void)                  {return (0);}
+		static Vec  Set(T v)                    {return (v);}
+		static Vec  Load(const T *p)            {return (*p);}
+		static void Store(T *p, Vec v)          {*p	= v;}
+		static Vec  Add(Vec a, Vec b)           {return (a + b);}
+		static Vec  Sub(Vec a, Vec b)           {return (a - b);}
+		static Vec  Mul(Vec a, Vec b)           {return (a * b);}
+		static Vec  Div(Vec a, Vec b)           {return (a / b);}
+		static Vec  Sqrt(Vec a)                 {return ((T)sqrt(a));}
+		static Vec  Max(Vec a, Vec b)           {return ((a > b) ? a : b);}
+		static Vec  Min(Vec a, Vec b)           {return ((a < b) ? a : b);}
+		static Vec  LessZero(Vec a)             {return ((a < 0) ? (T)1 : (T)0);}
+		static Vec  Select(Vec m, Vec a, Vec b) {return ((m != 0) ? a : b);}
+		static Vec  Fmadd(Vec a, Vec b, Vec c)  {return (a * b + c);}
+		static Vec  Round(Vec a)                {return ((T)floor(a + (T)0.5));}
+		static Vec  Pow2n(Vec n)                {return ((T)ldexp((T)1, (int)n));}
+		static T    Sum(Vec v)                  {return (v);}
+		static T    Max(Vec v)                  {return (v);}
+	};
+
+	//----------------------------------------------------------------------
+	/// SIMD演算(AVX2 が使えなければスカラー版)
+	template <typename T>
+	struct SimdTraits : public ScalarTraits<T>
+	{
+	};
+
+#ifdef NEURAL_NET_AVX2
+	//----------------------------------------------------------------------
+	/// SIMD演算(AVX2 倍精度版)
+	template <>
+	struct SimdTraits<double>
+	{
+		typedef __m256d	Vec;
+
+		static const unsigned int	Width	= 4;
+
+		static Vec  Zero(void)                  {return (_mm256_setzero_pd());}
+		static Vec  Set(double v)               {return (_mm256_set1_pd(v));}
+		static Vec  Load(const double *p)       {return (_mm256_loadu_pd(p));}
+		static void Store(double *p, Vec v)     {_mm256_storeu_pd(p, v);}
+		static Vec  Add(Vec a, Vec b)           {return (_mm256_add_pd(a, b));}
+		static Vec  Sub(Vec a, Vec b)           {return (_mm256_sub_pd(a, b));}
+		static Vec  Mul(Vec a, Vec b)           {return (_mm256_mul_pd(a, b));}
+		static Vec  Div(Vec a, Vec b)           {return (_mm256_div_pd(a, b));}
+		static Vec  Sqrt(Vec a)                 {return (_mm256_sqrt_pd(a));}
+		static Vec  Max(Vec a, Vec b)           {return (_mm256_max_pd(a, b));}
+		static Vec  Min(Vec a, Vec b)           {return (_mm256_min_pd(a, b));}
+		static Vec  LessZero(Vec a)             {return (_mm256_cmp_pd(a, Zero(), _CMP_LT_OQ));}
+		static Vec  Select(Vec m, Vec a, Vec b) {return (_mm256_blendv_pd(b, a, m));}
+		static Vec  Fmadd(Vec a, Vec b, Vec c)  {return (_mm256_fmadd_pd(a, b, c));}
+		static Vec  Round(Vec a)
+		{
+			return (_mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+		}
+		// 整数値の n から 2^n を作る(指数部に直接書く).
+		static Vec  Pow2n(Vec n)
+		{
+			const __m256i	e	= _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+
+			return (_mm256_castsi256_pd(_mm256_slli_epi64(
+						_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52)));
+		}
+		static double Sum(Vec v)
+		{
+			__m128d	s	= _mm_add_pd(_mm256_castpd256_pd128(v),
+									 _mm256_extractf128_pd(v, 1));
+
+			return (_mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s))));
+		}
+		static double Max(Vec v)
+		{
+			__m128d	s	= _mm_max_pd(_mm256_castpd256_pd128(v),
+									 _mm256_extractf128_pd(v, 1));
+
+			return (_mm_cvtsd_f64(_mm_max_sd(s, _mm_unpackhi_pd(s, s))));
+		}
+	};
+
+	//----------------------------------------------------------------------
+	/// SIMD演算(AVX2 単精度版)
+	template <>
+	struct SimdTraits<float>
+	{
+		typedef __m256	Vec;
+
+		static const unsigned int	Width	= 8;
+
+		static Vec  Zero(void)                  {return (_mm256_setzero_ps());}
+		static Vec  Set(float v)                {return (_mm256_set1_ps(v));}
+		static Vec  Load(const float *p)        {return (_mm256_loadu_ps(p));}
+		static void Store(float *p, Vec v)      {_mm256_storeu_ps(p, v);}
+		static Vec  Add(Vec a, Vec b)           {return (_mm256_add_ps(a, b));}
+		static Vec  Sub(Vec a, Vec b)           {return (_mm256_sub_ps(a, b));}
+		static Vec  Mul(Vec a, Vec b)           {return (_mm256_mul_ps(a, b));}
+		static Vec  Div(Vec a, Vec b)           {return (_mm256_div_ps(a, b));}
+		static Vec  Sqrt(Vec a)                 {return (_mm256_sqrt_ps(a));}
+		static Vec  Max(Vec a, Vec b)           {return (_mm256_max_ps(a, b));}
+		static Vec  Min(Vec a, Vec b)           {return (_mm256_min_ps(a, b));}
+		static Vec  LessZero(Vec a)             {return (_mm256_cmp_ps(a, Zero(), _CMP_LT_OQ));}
+		static Vec  Select(Vec m, Vec a, Vec b) {return (_mm256_blendv_ps(b, a, m));}
+		static Vec  Fmadd(Vec a, Vec b, Vec c)  {return (_mm256_fmadd_ps(a, b, c));}
+		static Vec  Round(Vec a)
+		{
+			return (_mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+		}
+		// 整数値の n から 2^n を作る(指数部に直接書く).
+		static Vec  Pow2n(Vec n)
+		{
+			const __m256i	e	= _mm256_cvtps_epi32(n);
+
+			return (_mm256_castsi256_ps(_mm256_slli_epi32(
+						_mm256_add_epi32(e, _mm256_set1_epi32(127)), 23)));
+		}
+		static float Sum(Vec v)
+		{
+			__m128	s	= _mm_add_ps(_mm256_castps256_ps128(v),
+									 _mm256_extractf128_ps(v, 1));
+
+			s	= _mm_add_ps(s, _mm_movehl_ps(s, s));
+
+			return (_mm_cvtss_f32(_mm_add_ss(s, _mm_movehdup_ps(s))));
+		}
+		static float Max(Vec v)
+		{
+			__m128	s	= _mm_max_ps(_mm256_castps256_ps128(v),
+									 _mm256_extractf128_ps(v, 1));
+
+			s	= _mm_max_ps(s, _mm_movehl_ps(s, s));
+
+			return (_mm_cvtss_f32(_mm_max_ss(s, _mm_movehdup_ps(s))));
+		}
+	};
+#endif
+
+	//----------------------------------------------------------------------
+	/// 高速 exp の引数の範囲(2^n が正規化数に収まるところで飽和させる)
+	template <typename T>
+	struct FastExpRange;
+
+	template <>
+	struct FastExpRange<double>
+	{
+		static double Min(void) {return (-708.0);}
+		static double Max(void) {return ( 709.0);}
+	};
+
+	template <>
+	struct FastExpRange<float>
+	{
+		static float Min(void) {return (-87.0f);}
+		static float Max(void) {return ( 88.0f);}
+	};
+
+	//----------------------------------------------------------------------
+	/**
+	 * 高速 exp(近似)
+	 * -x = n*ln2 + r (|r| <= ln2/2) に分け, exp(r) を 5 次の多項式(Cephes expf)で求めて 2^n 倍する
+	 * -相対誤差は範囲内で倍精度なら 2e-9 程度(多項式の近似誤差),
+	 *  単精度なら 6e-7 程度(丸め誤差が支配的)
+	 * -範囲外は FastExpRange で飽和する(非正規化数・無限大は返さない)
+	 */
+	//----------------------------------------------------------------------
+	template <typename S, typename T>
+	typename S::Vec FastExp(typename S::Vec x)
+	{
+		typedef typename S::Vec		Vec;
+
+		x	= S::Min(S::Max(x, S::Set(FastExpRange<T>::Min())), S::Set(FastExpRange<T>::Max()));
+
+		const Vec	n	= S::Round(S::Mul(x, S::Set((T)1.44269504088896341)));
+		Vec			r	= S::Sub(x, S::Mul(n, S::Set((T)0.693359375)));
+		Vec			p;
+
+		r	= S::Sub(r, S::Mul(n, S::Set((T)-2.12194440e-4)));
+
+		p	= S::Set((T)1.9875691500e-4);
+		p	= S::Fmadd(p, r, S::Set((T)1.3981999507e-3));
+		p	= S::Fmadd(p, r, S::Set((T)8.3334519073e-3));
+		p	= S::Fmadd(p, r, S::Set((T)4.1665795894e-2));
+		p	= S::Fmadd(p, r, S::Set((T)1.6666665459e-1));
+		p	= S::Fmadd(p, r, S::Set((T)5.0000001201e-1));
+		p	= S::Fmadd(p, S::Mul(r, r), S::Add(r, S::Set((T)1)));
+
+		return (S::Mul(p, S::Pow2n(n)));
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 高速ロジスティック関数 1 / (1 + exp(-x))
+	 */
+	//----------------------------------------------------------------------
+	template <typename S, typename T>
+	typename S::Vec FastSigmoid(typename S::Vec x)
+	{
+		const typename S::Vec	one	= S::Set((T)1);
+
+		return (S::Div(one, S::Add(one, FastExp<S, T>(S::Sub(S::Zero(), x)))));
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 活性化(範囲指定)
+	 * -pInput を活性化して pOutput に書き, 後方出力用の微分値を pMask に書く
+	 *  (pInput == pOutput なら置き換え)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void ActivateRangeImpl(T                   *pOutput,
+						   const T             *pInput,
+						   unsigned int        begin,
+						   unsigned int        end,
+						   const Activation<T> &activation)
+	{
+		typedef SimdTraits<T>		S;
+		typedef typename S::Vec		Vec;
+
+		T				*pMask	= activation.pMask;
+		const T			*pAlpha	= activation.pAlpha;
+		const Vec		zero	= S::Zero();
+		const Vec		one		= S::Set(1);
+		unsigned int	o		= begin;
+
+		switch (activation.type)
+		{
+		  case ActivationReLU:
+			for (; o + S::Width <= end; o += S::Width)
+			{
+				const Vec	x	= S::Load(pInput + o);
+				const Vec	m	= S::LessZero(x);
+
+				S::Store(pOutput + o, S::Select(m, zero, x));
+				if (pMask != NULL)
+					S::Store(pMask + o, S::Select(m, zero, one));
+			}
+			for (; o < end; ++o)
+			{
+				const T	x	= pInput[o];
+
+				if (pMask != NULL)
+					pMask[o]	= (x < 0) ? 0 : 1;
+				pOutput[o]	= (x < 0) ? 0 : x;
+			}
+			break;
+
+		  case ActivationLeaky:
+			for (; o + S::Width <= end; o += S::Width)
+			{
+				const Vec	x	= S::Load(pInput + o);
+				const Vec	a	= (pAlpha != NULL) ? S::Load(pAlpha + o) : S::Set(activation.alpha);
+				const Vec	m	= S::LessZero(x);
+
+				S::Store(pOutput + o, S::Select(m, S::Mul(x, a), x));
+				if (pMask != NULL)
+					S::Store(pMask + o, S::Select(m, a, one));
+			}
+			for (; o < end; ++o)
+			{
+				const T	a	= (pAlpha != NULL) ? pAlpha[o] : activation.alpha;
+				const T	x	= pInput[o];
+
+				if (pMask != NULL)
+					pMask[o]	= (x < 0) ? a : 1;
+				pOutput[o]	= (x < 0) ? x * a : x;
+			}
+			break;
+
+		  case ActivationSigmoid:
+			// ベクトル化できないビルドでは標準ライブラリの方が速い.
+			if ((activation.accuracy == AccuracyFast) && (S::Width > 1))
+			{
+				typedef ScalarTraits<T>		R;
+
+				for (; o + S::Width <= end; o += S::Width)
+				{
+					const Vec	y	= FastSigmoid<S, T>(S::Load(pInput + o));
+
+					S::Store(pOutput + o, y);
+					if (pMask != NULL)
+						S::Store(pMask + o, S::Mul(S::Sub(one, y), y));
+				}
+				for (; o < end; ++o)
+				{
+					const T	y	= FastSigmoid<R, T>(pInput[o]);
+
+					if (pMask != NULL)
+						pMask[o]	= (1 - y) * y;
+					pOutput[o]	= y;
+				}
+				break;
+			}
+
+			for (; o < end; ++o)
+			{
+				const T	y	= 1 / (1 + exp(-pInput[o]));
+
+				if (pMask != NULL)
+					pMask[o]	= (1 - y) * y;
+				pOutput[o]	= y;
+			}
+			break;
+
+		  default:
+			break;
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Soft-Max(高速版)
+	 * -1 回目の走査で最大値と exp の総和を同時に求め(最大値が増えたら総和を縮める),
+	 *  2 回目の走査で exp を取り直して総和で割る
+	 * -最大値・総和はレーンごとに持ち, 最後にまとめる
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void FastSoftMaxImpl(T            *pOutput,
+						 const T      *pInput,
+						 unsigned int num)
+	{
+		typedef SimdTraits<T>		S;
+		typedef ScalarTraits<T>		R;
+		typedef typename S::Vec		Vec;
+
+		unsigned int	i			= 0;
+		T				maxValue	= pInput[0];
+		T				total		= 0;
+
+		if (num >= S::Width)
+		{
+			Vec	maxVec		= S::Load(pInput);
+			Vec	totalVec	= S::Set(1);
+
+			for (i = S::Width; i + S::Width <= num; i += S::Width)
+			{
+				const Vec	x		= S::Load(pInput + i);
+				const Vec	newMax	= S::Max(maxVec, x);
+
+				totalVec	= S::Fmadd(totalVec,
+									   FastExp<S, T>(S::Sub(maxVec, newMax)),
+									   FastExp<S, T>(S::Sub(x, newMax)));
+				maxVec		= newMax;
+			}
+
+			maxValue	= S::Max(maxVec);
+			total		= S::Sum(S::Mul(totalVec, FastExp<S, T>(S::Sub(maxVec, S::Set(maxValue)))));
+		}
+
+		// 端数.
+		for (; i < num; ++i)
+		{
+			if (pInput[i] > maxValue)
+			{
+				total		= total * FastExp<R, T>(maxValue - pInput[i]) + 1;
+				maxValue	= pInput[i];
+			}
+			else
+				total	+= FastExp<R, T>(pInput[i] - maxValue);
+		}
+
+		const T			inverse		= 1 / total;
+		const Vec		maxVec		= S::Set(maxValue);
+		const Vec		inverseVec	= S::Set(inverse);
+		unsigned int	o			= 0;
+
+		for (; o + S::Width <= num; o += S::Width)
+			S::Store(pOutput + o, S::Mul(FastExp<S, T>(S::Sub(S::Load(pInput + o), maxVec)), inverseVec));
+
+		for (; o < num; ++o)
+			pOutput[o]	= FastExp<R, T>(pInput[o] - maxValue) * inverse;
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Soft-Max
+	 * -オーバーフロー対策に最大値を引いてから指数を取り, 総和で割る
+	 * -高速版は FastSoftMaxImpl(ベクトル化できないビルドでは使わない)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void SoftMaxImpl(T                  *pOutput,
+					 const T            *pInput,
+					 unsigned int       num,
+					 ActivationAccuracy accuracy)
+	{
+		if ((accuracy == AccuracyFast) && (SimdTraits<T>::Width > 1))
+		{
+			FastSoftMaxImpl(pOutput, pInput, num);
+			return;
+		}
+
+		T	maxValue	= pInput[0];
+		T	total		= 0;
+
+		for (unsigned int i = 1; i < num; ++i)
+		{
+			if (pInput[i] > maxValue)
+				maxValue	= pInput[i];
+		}
+
+		for (unsigned int o = 0; o < num; ++o)
+		{
+			pOutput[o]	=  exp(pInput[o]-maxValue);
+			total		+= pOutput[o];
+		}
+
+		for (unsigned int o = 0; o < num; ++o)
+			pOutput[o]	/= total;
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 微分値の乗算(活性化の後方出力)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void MultiplyMaskImpl(T            *pOutput,
+						  const T      *pDelta,
+						  const T      *pMask,
+						  unsigned int num)
+	{
+		typedef SimdTraits<T>		S;
+
+		unsigned int	o	= 0;
+
+		for (; o + S::Width <= num; o += S::Width)
+			S::Store(pOutput + o, S::Mul(S::Load(pDelta + o), S::Load(pMask + o)));
+
+		for (; o < num; ++o)
+			pOutput[o]	= pDelta[o] * pMask[o];
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 勾配降下の更新(S::Width 要素分)
+	 * -モーメンタムがあれば pMoment = momentum * pMoment + pDelta を差分の代わりに使う
+	 * -keep は重み減衰(1 - ratio * weightDecay). 減衰なしなら 1 で結果は変わらない
+	 * -scale は差分にかける倍率(ノルムの切り詰め. なければ 1)
+	 */
+	//----------------------------------------------------------------------
+	template <typename S, typename T>
+	inline void SgdUpdateAt(T *pParam,
+							T *pDelta,
+							T *pMoment,
+							T ratio,
+							T momentum,
+							T keep,
+							T scale)
+	{
+		typename S::Vec	step	= S::Mul(S::Set(scale), S::Load(pDelta));
+
+		if (pMoment != NULL)
+		{
+			step	= S::Fmadd(S::Set(momentum), S::Load(pMoment), step);
+			S::Store(pMoment, step);
+		}
+
+		S::Store(pParam, S::Add(S::Mul(S::Set(keep),  S::Load(pParam)),
+								S::Mul(S::Set(ratio), step)));
+		S::Store(pDelta, S::Zero());
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 勾配降下の更新(平坦な配列)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void SgdUpdateImpl(T            *pParam,
+					   T            *pDelta,
+					   T            *pMoment,
+					   T            ratio,
+					   T            momentum,
+					   T            weightDecay,
+					   T            scale,
+					   unsigned int num)
+	{
+		typedef SimdTraits<T>		S;
+		typedef ScalarTraits<T>		R;
+
+		const T			keep	= 1 - ratio * weightDecay;
+		unsigned int	i		= 0;
+
+		for (; i + S::Width <= num; i += S::Width)
+		{
+			SgdUpdateAt<S>(pParam + i,
+						   pDelta + i,
+						   (pMoment != NULL) ? pMoment + i : NULL,
+						   ratio,
+						   momentum,
+						   keep,
+						   scale);
+		}
+
+		for (; i < num; ++i)
+		{
+			SgdUpdateAt<R>(pParam + i,
+						   pDelta + i,
+						   (pMoment != NULL) ? pMoment + i : NULL,
+						   ratio,
+						   momentum,
+						   keep,
+						   scale);
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/// Adam の 1 回分の係数(バイアス補正・重み減衰を含む)
+	template <typename T>
+	struct AdamCoef
+	{
+		T	beta1;
+		T	rest1;			// 1 - beta1
+		T	beta2;
+		T	rest2;			// 1 - beta2
+		T	rate;			// alpha / (1 - beta1^t)
+		T	correct2;		// 1 / (1 - beta2^t)
+		T	epsilon;
+		T	keep;			// 1 - alpha * weightDecay
+		T	scale;			// 差分にかける倍率(ノルムの切り詰め)
+	};
+
+	//----------------------------------------------------------------------
+	/**
+	 * Adam の更新(S::Width 要素分)
+	 * -割り算は 1 要素 1 回だけ
+	 */
+	//----------------------------------------------------------------------
+	template <typename S, typename T>
+	inline void AdamUpdateAt(T                   *pParam,
+							 T                   *pDelta,
+							 T                   *pMoment,
+							 T                   *pVelocity,
+							 const AdamCoef<T>   &coef)
+	{
+		typedef typename S::Vec	Vec;
+
+		const Vec	g	= S::Mul(S::Set(coef.scale), S::Load(pDelta));
+		const Vec	m	= S::Fmadd(S::Set(coef.beta1),
+								   S::Load(pMoment),
+								   S::Mul(S::Set(coef.rest1), g));
+		const Vec	v	= S::Fmadd(S::Set(coef.beta2),
+								   S::Load(pVelocity),
+								   S::Mul(S::Mul(S::Set(coef.rest2), g), g));
+		const Vec	d	= S::Add(S::Sqrt(S::Mul(S::Set(coef.correct2), v)),
+								 S::Set(coef.epsilon));
+
+		S::Store(pMoment,   m);
+		S::Store(pVelocity, v);
+		S::Store(pParam,    S::Add(S::Mul(S::Set(coef.keep), S::Load(pParam)),
+								   S::Div(S::Mul(S::Set(coef.rate), m), d)));
+		S::Store(pDelta,    S::Zero());
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Adam の更新(平坦な配列)
+	 * -バイアス補正は更新回数 step(1 から)で 1 - beta^step
+	 * -重み減衰は勾配と切り離して値に直接かける(AdamW)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void AdamUpdateImpl(T            *pParam,
+						T            *pDelta,
+						T            *pMoment,
+						T            *pVelocity,
+						T            alpha,
+						T            beta1,
+						T            beta2,
+						T            epsilon,
+						T            weightDecay,
+						T            scale,
+						unsigned int step,
+						unsigned int num)
+	{
+		typedef SimdTraits<T>		S;
+		typedef ScalarTraits<T>		R;
+
+		const double	t	= (step > 0) ? (double)step : 1.0;
+		AdamCoef<T>		coef;
+
+		coef.beta1		= beta1;
+		coef.rest1		= 1 - beta1;
+		coef.beta2		= beta2;
+		coef.rest2		= 1 - beta2;
+		coef.rate		= (T)(alpha / (1.0 - pow((double)beta1, t)));
+		coef.correct2	= (T)(1.0 / (1.0 - pow((double)beta2, t)));
+		coef.epsilon	= epsilon;
+		coef.keep		= 1 - alpha * weightDecay;
+		coef.scale		= scale;
+
+		unsigned int	i	= 0;
+
+		for (; i + S::Width <= num; i += S::Width)
+			AdamUpdateAt<S>(pParam + i, pDelta + i, pMoment + i, pVelocity + i, coef);
+
+		for (; i < num; ++i)
+			AdamUpdateAt<R>(pParam + i, pDelta + i, pMoment + i, pVelocity + i, coef);
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 二乗和
+	 * -レーンごとに足し, 一定要素ごとに倍精度の合計へ移す(単精度の桁落ちを抑える)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	double SquareSumImpl(const T      *pInput,
+						 unsigned int num)
+	{
+		typedef SimdTraits<T>		S;
+
+		const unsigned int	block	= 1024;
+		double				total	= 0.0;
+		unsigned int		i		= 0;
+
+		while (i + S::Width <= num)
+		{
+			const unsigned int	end	= (num - i > block) ? i + block : num;
+			typename S::Vec		sum	= S::Zero();
+
+			for (; i + S::Width <= end; i += S::Width)
+			{
+				const typename S::Vec	v	= S::Load(pInput + i);
+
+				sum	= S::Fmadd(v, v, sum);
+			}
+
+			total	+= S::Sum(sum);
+		}
+
+		for (; i < num; ++i)
+			total	+= (double)pInput[i] * pInput[i];
+
+		return (total);
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 配列の加算
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void AddArrayImpl(T            *pOutput,
+					  const T      *pInput,
+					  unsigned int num)
+	{
+		typedef SimdTraits<T>		S;
+
+		unsigned int	i	= 0;
+
+		for (; i + S::Width <= num; i += S::Width)
+			S::Store(pOutput + i, S::Add(S::Load(pOutput + i), S::Load(pInput + i)));
+
+		for (; i < num; ++i)
+			pOutput[i]	+= pInput[i];
+	}
+
+	// 同時に処理する入力行数(レジスタタイル).
+	const unsigned int	AFFINE_ROWS		= 4;
+
+	// L1 に載せる出力方向のブロック長.
+	const unsigned int	AFFINE_BLOCK	= 2048;
+
+	//----------------------------------------------------------------------
+	/**
+	 * Affine前方出力
+	 * -入力 AFFINE_ROWS 行ぶんの重みをまとめて出力ブロックに積算する
+	 *  (重み行は連続アクセス, 出力ブロックは L1 に載ったまま)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void AffineForwardImpl(T                   *pOutput,
+						   const T             *pInput,
+						   const T             *pWeight,
+						   const T             *pBias,
+						   unsigned int        inputNum,
+						   unsigned int        outputNum,
+						   const Activation<T> *pActivation)
+	{
+		typedef SimdTraits<T>		S;
+		typedef typename S::Vec		Vec;
+
+		memcpy(pOutput, pBias, sizeof(T) * outputNum);
+
+		for (unsigned int ob = 0; ob < outputNum; ob += AFFINE_BLOCK)
+		{
+			const unsigned int	oe	= (ob + AFFINE_BLOCK < outputNum)
+									? ob + AFFINE_BLOCK : outputNum;
+			unsigned int		i	= 0;
+
+			for (; i + AFFINE_ROWS <= inputNum; i += AFFINE_ROWS)
+			{
+				Vec		x[AFFINE_ROWS];
+				const T	*pW[AFFINE_ROWS];
+
+				for (unsigned int r = 0; r < AFFINE_ROWS; ++r)
+				{
+					x[r]	= S::Set(pInput[i+r]);
+					pW[r]	= pWeight + (i+r)*outputNum;
+				}
+
+				unsigned int	o	= ob;
+
+				for (; o + S::Width <= oe; o += S::Width)
+				{
+					Vec	acc	= S::Load(pOutput + o);
+
+					for (unsigned int r = 0; r < AFFINE_ROWS; ++r)
+						acc	= S::Fmadd(x[r], S::Load(pW[r] + o), acc);
+
+					S::Store(pOutput + o, acc);
+				}
+
+				for (; o < oe; ++o)
+				{
+					for (unsigned int r = 0; r < AFFINE_ROWS; ++r)
+						pOutput[o]	+= pInput[i+r] * pW[r][o];
+				}
+			}
+
+			// 端数行
+			for (; i < inputNum; ++i)
+			{
+				const T	*pW	= pWeight + i*outputNum;
+
+				for (unsigned int o = ob; o < oe; ++o)
+					pOutput[o]	+= pInput[i] * pW[o];
+			}
+
+			// 出力ブロックが L1 にあるうちに活性化する.
+			if (pActivation != NULL)
+				ActivateRangeImpl(pOutput, pOutput, ob, oe, *pActivation);
+		}
+
+		if ((pActivation != NULL) && pActivation->softMax)
+			SoftMaxImpl(pOutput, pOutput, outputNum, pActivation->accuracy);
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Affine後方出力
+	 * -入力 AFFINE_ROWS 行ぶんの重みと差分を一度に走査し,
+	 *  入力差分(内積)と重み差分(外積)を同時に求める
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void AffineBackwardImpl(T            *pOutput,
+							T            *pDeltaWeight,
+							T            *pDeltaBias,
+							const T      *pDelta,
+							const T      *pInput,
+							const T      *pWeight,
+							unsigned int inputNum,
+							unsigned int outputNum)
+	{
+		typedef SimdTraits<T>		S;
+		typedef typename S::Vec		Vec;
+
+		memset(pOutput, 0, sizeof(T) * inputNum);
+
+		for (unsigned int ob = 0; ob < outputNum; ob += AFFINE_BLOCK)
+		{
+			const unsigned int	oe	= (ob + AFFINE_BLOCK < outputNum)
+									? ob + AFFINE_BLOCK : outputNum;
+			unsigned int		i	= 0;
+
+			for (; i + AFFINE_ROWS <= inputNum; i += AFFINE_ROWS)
+			{
+				Vec		acc[AFFINE_ROWS];
+				Vec		x[AFFINE_ROWS];
+				const T	*pW[AFFINE_ROWS];
+				T		*pDW[AFFINE_ROWS];
+
+				for (unsigned int r = 0; r < AFFINE_ROWS; ++r)
+				{
+					acc[r]	= S::Zero();
+					x[r]	= S::Set(pInput[i+r]);
+					pW[r]	= pWeight      + (i+r)*outputNum;
+					pDW[r]	= pDeltaWeight + (i+r)*outputNum;
+				}
+
+				unsigned int	o	= ob;
+
+				for (; o + S::Width <= oe; o += S::Width)
+				{
+					const Vec	d	= S::Load(pDelta + o);
+
+					for (unsigned int r = 0; r < AFFINE_ROWS; ++r)
+					{
+						acc[r]	= S::Fmadd(d, S::Load(pW[r] + o), acc[r]);
+						S::Store(pDW[r] + o,
+								 S::Fmadd(x[r], d, S::Load(pDW[r] + o)));
+					}
+				}
+
+				for (unsigned int r = 0; r < AFFINE_ROWS; ++r)
+				{
+					T	sum	= S::Sum(acc[r]);
+
+					for (unsigned int t = o; t < oe; ++t)
+					{
+						sum			+= pDelta[t] * pW[r][t];
+						pDW[r][t]	+= pInput[i+r] * pDelta[t];
+					}
+
+					pOutput[i+r]	+= sum;
+				}
+			}
+
+			// 端数行
+			for (; i < inputNum; ++i)
+			{
+				const T	*pW		= pWeight      + i*outputNum;
+				T		*pDW	= pDeltaWeight + i*outputNum;
+				T		sum		= 0;
+
+				for (unsigned int o = ob; o < oe; ++o)
+				{
+					sum		+= pDelta[o] * pW[o];
+					pDW[o]	+= pInput[i] * pDelta[o];
+				}
+
+				pOutput[i]	+= sum;
+			}
+		}
+
+		for (unsigned int o = 0; o < outputNum; ++o)
+			pDeltaBias[o]	+= pDelta[o];
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Affine出力の差分更新(0/1 疎入力)
+	 * -0 から 1 になった入力の重み行を足し, 1 から 0 になった行を引く
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void AffineUpdateSparseImpl(T                  *pOutput,
+								const unsigned int *pAdd,
+								unsigned int       addNum,
+								const unsigned int *pRemove,
+								unsigned int       removeNum,
+								const T            *pWeight,
+								unsigned int       outputNum)
+	{
+		typedef SimdTraits<T>		S;
+
+		for (unsigned int ob = 0; ob < outputNum; ob += AFFINE_BLOCK)
+		{
+			const unsigned int	oe	= (ob + AFFINE_BLOCK < outputNum)
+									? ob + AFFINE_BLOCK : outputNum;
+
+			for (unsigned int a = 0; a < addNum; ++a)
+			{
+				const T			*pW	= pWeight + pAdd[a]*outputNum;
+				unsigned int	o	= ob;
+
+				for (; o + S::Width <= oe; o += S::Width)
+					S::Store(pOutput + o, S::Add(S::Load(pOutput + o), S::Load(pW + o)));
+
+				for (; o < oe; ++o)
+					pOutput[o]	+= pW[o];
+			}
+			for (unsigned int r = 0; r < removeNum; ++r)
+			{
+				const T			*pW	= pWeight + pRemove[r]*outputNum;
+				unsigned int	o	= ob;
+
+				for (; o + S::Width <= oe; o += S::Width)
+					S::Store(pOutput + o, S::Sub(S::Load(pOutput + o), S::Load(pW + o)));
+
+				for (; o < oe; ++o)
+					pOutput[o]	-= pW[o];
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Affine前方出力(0/1 疎入力)
+	 * -値が 1 の入力の重み行だけをバイアスに足す
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void AffineForwardSparseImpl(T                   *pOutput,
+								 const unsigned int  *pActive,
+								 unsigned int        activeNum,
+								 const T             *pWeight,
+								 const T             *pBias,
+								 unsigned int        outputNum,
+								 const Activation<T> *pActivation)
+	{
+		memcpy(pOutput, pBias, sizeof(T) * outputNum);
+
+		AffineUpdateSparseImpl(pOutput, pActive, activeNum, NULL, 0, pWeight, outputNum);
+
+		if (pActivation != NULL)
+		{
+			ActivateRangeImpl(pOutput, pOutput, 0, outputNum, *pActivation);
+
+			if (pActivation->softMax)
+				SoftMaxImpl(pOutput, pOutput, outputNum, pActivation->accuracy);
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Affine後方出力(0/1 疎入力)
+	 * -値が 1 の入力の重み差分行とバイアス差分に出力差分を足す
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void AffineBackwardSparseImpl(T                  *pDeltaWeight,
+								  T                  *pDeltaBias,
+								  const T            *pDelta,
+								  const unsigned int *pActive,
+								  unsigned int       activeNum,
+								  unsigned int       outputNum)
+	{
+		typedef SimdTraits<T>		S;
+
+		for (unsigned int a = 0; a <= activeNum; ++a)
+		{
+			// 最後の 1 回はバイアス差分.
+			T				*pDW	= (a < activeNum)
+									? pDeltaWeight + pActive[a]*outputNum : pDeltaBias;
+			unsigned int	o		= 0;
+
+			for (; o + S::Width <= outputNum; o += S::Width)
+				S::Store(pDW + o, S::Add(S::Load(pDW + o), S::Load(pDelta + o)));
+
+			for (; o < outputNum; ++o)
+				pDW[o]	+= pDelta[o];
+		}
+	}
+
+	// 行列積のマイクロカーネルの行数.
+	const unsigned int	GEMM_MR	= 6;
+
+	// 行列積のブロックサイズ(MC:A の行, KC:内積方向, NC:B の列).
+	const unsigned int	GEMM_MC	= 96;
+	const unsigned int	GEMM_KC	= 256;
+	const unsigned int	GEMM_NC	= 1024;
+
+	//----------------------------------------------------------------------
+	/**
+	 * A のパック
+	 * -GEMM_MR 行ごとに k 方向へ並べ替える(端数行は 0 埋め)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void PackA(T            *pPack,
+			   const T      *pA,
+			   unsigned int rowStride,
+			   unsigned int colStride,
+			   unsigned int mc,
+			   unsigned int kc)
+	{
+		for (unsigned int i = 0; i < mc; i += GEMM_MR)
+		{
+			const unsigned int	rows	= (mc - i < GEMM_MR) ? mc - i : GEMM_MR;
+
+			for (unsigned int p = 0; p < kc; ++p)
+			{
+				for (unsigned int r = 0; r < GEMM_MR; ++r)
+				{
+					*pPack++	= (r < rows)
+								? pA[(i+r)*rowStride + p*colStride] : 0;
+				}
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * B のパック
+	 * -nr 列ごとに k 方向へ並べ替える(端数列は 0 埋め)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void PackB(T            *pPack,
+			   const T      *pB,
+			   unsigned int rowStride,
+			   unsigned int colStride,
+			   unsigned int kc,
+			   unsigned int nc,
+			   unsigned int nr)
+	{
+		for (unsigned int j = 0; j < nc; j += nr)
+		{
+			const unsigned int	cols	= (nc - j < nr) ? nc - j : nr;
+
+			for (unsigned int p = 0; p < kc; ++p)
+			{
+				if ((cols == nr) && (colStride == 1))
+				{
+					memcpy(pPack, pB + p*rowStride + j, sizeof(T) * nr);
+					pPack	+= nr;
+					continue;
+				}
+
+				for (unsigned int c = 0; c < nr; ++c)
+				{
+					*pPack++	= (c < cols)
+								? pB[p*rowStride + (j+c)*colStride] : 0;
+				}
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 行列積マイクロカーネル
+	 * -GEMM_MR x (2ベクトル) の C をレジスタに保持して kc 回積算する
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void GemmMicroKernel(T            *pC,
+						 const T      *pA,
+						 const T      *pB,
+						 unsigned int ldc,
+						 unsigned int kc,
+						 unsigned int rows,
+						 unsigned int cols)
+	{
+		typedef SimdTraits<T>		S;
+		typedef typename S::Vec		Vec;
+
+		const unsigned int	nr	= 2 * S::Width;
+
+		// アキュムレータがレジスタに残るよう展開して書く.
+		Vec	c00 = S::Zero(), c01 = S::Zero();
+		Vec	c10 = S::Zero(), c11 = S::Zero();
+		Vec	c20 = S::Zero(), c21 = S::Zero();
+		Vec	c30 = S::Zero(), c31 = S::Zero();
+		Vec	c40 = S::Zero(), c41 = S::Zero();
+		Vec	c50 = S::Zero(), c51 = S::Zero();
+
+		for (unsigned int p = 0; p < kc; ++p, pA += GEMM_MR, pB += nr)
+		{
+			const Vec	b0	= S::Load(pB);
+			const Vec	b1	= S::Load(pB + S::Width);
+			Vec			a;
+
+			a	= S::Set(pA[0]);	c00 = S::Fmadd(a, b0, c00);	c01 = S::Fmadd(a, b1, c01);
+			a	= S::Set(pA[1]);	c10 = S::Fmadd(a, b0, c10);	c11 = S::Fmadd(a, b1, c11);
+			a	= S::Set(pA[2]);	c20 = S::Fmadd(a, b0, c20);	c21 = S::Fmadd(a, b1, c21);
+			a	= S::Set(pA[3]);	c30 = S::Fmadd(a, b0, c30);	c31 = S::Fmadd(a, b1, c31);
+			a	= S::Set(pA[4]);	c40 = S::Fmadd(a, b0, c40);	c41 = S::Fmadd(a, b1, c41);
+			a	= S::Set(pA[5]);	c50 = S::Fmadd(a, b0, c50);	c51 = S::Fmadd(a, b1, c51);
+		}
+
+		const Vec	acc[GEMM_MR][2]	=
+		{
+			{c00, c01}, {c10, c11}, {c20, c21},
+			{c30, c31}, {c40, c41}, {c50, c51},
+		};
+
+		if ((rows == GEMM_MR) && (cols == nr))
+		{
+			for (unsigned int r = 0; r < GEMM_MR; ++r)
+			{
+				T	*pRow	= pC + r*ldc;
+
+				S::Store(pRow,            S::Add(S::Load(pRow),            acc[r][0]));
+				S::Store(pRow + S::Width, S::Add(S::Load(pRow + S::Width), acc[r][1]));
+			}
+			return;
+		}
+
+		// 端数タイル
+		T	tile[GEMM_MR * 2 * S::Width];
+
+		for (unsigned int r = 0; r < GEMM_MR; ++r)
+		{
+			S::Store(tile + r*nr,            acc[r][0]);
+			S::Store(tile + r*nr + S::Width, acc[r][1]);
+		}
+
+		for (unsigned int r = 0; r < rows; ++r)
+		{
+			for (unsigned int c = 0; c < cols; ++c)
+				pC[r*ldc + c]	+= tile[r*nr + c];
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 行列積
+	 * -B を KC x NC, A を MC x KC のパネルにパックしてブロック単位で積算
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void MatrixMultiplyImpl(T            *pC,
+							const T      *pA,
+							const T      *pB,
+							unsigned int m,
+							unsigned int n,
+							unsigned int k,
+							bool         transA,
+							bool         transB)
+	{
+		const unsigned int	nr			= 2 * SimdTraits<T>::Width;
+		const unsigned int	aRowStride	= transA ? 1 : k;
+		const unsigned int	aColStride	= transA ? m : 1;
+		const unsigned int	bRowStride	= transB ? 1 : n;
+		const unsigned int	bColStride	= transB ? k : 1;
+
+		static thread_local std::vector<T>	packA;
+		static thread_local std::vector<T>	packB;
+
+		packA.resize(GEMM_MC * GEMM_KC);
+		packB.resize(GEMM_KC * (GEMM_NC + nr));
+
+		for (unsigned int jc = 0; jc < n; jc += GEMM_NC)
+		{
+			const unsigned int	nc	= (n - jc < GEMM_NC) ? n - jc : GEMM_NC;
+
+			for (unsigned int pc = 0; pc < k; pc += GEMM_KC)
+			{
+				const unsigned int	kc	= (k - pc < GEMM_KC) ? k - pc : GEMM_KC;
+
+				PackB(&packB[0],
+					  pB + pc*bRowStride + jc*bColStride,
+					  bRowStride,
+					  bColStride,
+					  kc,
+					  nc,
+					  nr);
+
+				for (unsigned int ic = 0; ic < m; ic += GEMM_MC)
+				{
+					const unsigned int	mc	= (m - ic < GEMM_MC) ? m - ic : GEMM_MC;
+
+					PackA(&packA[0],
+						  pA + ic*aRowStride + pc*aColStride,
+						  aRowStride,
+						  aColStride,
+						  mc,
+						  kc);
+
+					for (unsigned int jr = 0; jr < nc; jr += nr)
+					{
+						for (unsigned int ir = 0; ir < mc; ir += GEMM_MR)
+						{
+							GemmMicroKernel(pC + (ic+ir)*n + jc+jr,
+											&packA[ir*kc],
+											&packB[jr*kc],
+											n,
+											kc,
+											(mc - ir < GEMM_MR) ? mc - ir : GEMM_MR,
+											(nc - jr < nr)      ? nc - jr : nr);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 活性化(N 行)
+	 * -行ごとに微分値の書き込み先をずらし, Soft-Max も行ごとにかける
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void ActivateBatchImpl(T                   *pOutput,
+						   const T             *pInput,
+						   unsigned int        num,
+						   unsigned int        batchNum,
+						   const Activation<T> &activation)
+	{
+		Activation<T>	row	= activation;
+
+		for (unsigned int b = 0; b < batchNum; ++b)
+		{
+			row.pMask	= (activation.pMask != NULL) ? activation.pMask + b*num : NULL;
+
+			ActivateRangeImpl(pOutput + b*num, pInput + b*num, 0, num, row);
+
+			if (activation.softMax)
+				SoftMaxImpl(pOutput + b*num, pOutput + b*num, num, activation.accuracy);
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Affine前方出力(N 行)
+	 * -出力(N x O) = 入力(N x I) * 重み(I x O) + バイアス を行列積で求める
+	 *  (重みを N 件で使い回す)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void AffineForwardBatchImpl(T                   *pOutput,
+								const T             *pInput,
+								const T             *pWeight,
+								const T             *pBias,
+								unsigned int        inputNum,
+								unsigned int        outputNum,
+								unsigned int        batchNum,
+								const Activation<T> *pActivation)
+	{
+		for (unsigned int b = 0; b < batchNum; ++b)
+			memcpy(pOutput + b*outputNum, pBias, sizeof(T) * outputNum);
+
+		MatrixMultiplyImpl(pOutput,
+						   pInput,
+						   pWeight,
+						   batchNum,
+						   outputNum,
+						   inputNum,
+						   false,
+						   false);
+
+		if (pActivation != NULL)
+			ActivateBatchImpl(pOutput, pOutput, outputNum, batchNum, *pActivation);
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Affine後方出力(N 行)
+	 * -入力差分(N x I) = 差分(N x O) * 重み^T
+	 * -重み差分(I x O) += 入力^T * 差分
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void AffineBackwardBatchImpl(T            *pOutput,
+								 T            *pDeltaWeight,
+								 T            *pDeltaBias,
+								 const T      *pDelta,
+								 const T      *pInput,
+								 const T      *pWeight,
+								 unsigned int inputNum,
+								 unsigned int outputNum,
+								 unsigned int batchNum)
+	{
+		memset(pOutput, 0, sizeof(T) * inputNum * batchNum);
+
+		MatrixMultiplyImpl(pOutput,
+						   pDelta,
+						   pWeight,
+						   batchNum,
+						   inputNum,
+						   outputNum,
+						   false,
+						   true);
+
+		MatrixMultiplyImpl(pDeltaWeight,
+						   pInput,
+						   pDelta,
+						   inputNum,
+						   outputNum,
+						   batchNum,
+						   true,
+						   false);
+
+		for (unsigned int b = 0; b < batchNum; ++b)
+		{
+			for (unsigned int o = 0; o < outputNum; ++o)
+				pDeltaBias[o]	+= pDelta[b*outputNum+o];
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 出力位置 h のうち入力の範囲に入るものを求める
+	 * -iH = h*stride + offset - padding が [0, size) に入る [begin, end)
+	 */
+	//----------------------------------------------------------------------
+	void ValidRange(unsigned int &begin,
+					unsigned int &end,
+					unsigned int offset,
+					unsigned int size,
+					unsigned int outSize,
+					unsigned int stride,
+					unsigned int padding)
+	{
+		const int	lo	= (int)padding - (int)offset;
+		const int	hi	= (int)size + (int)padding - (int)offset;
+
+		begin	= (lo <= 0) ? 0 : (lo + stride - 1) / stride;
+		end		= (hi <= 0) ? 0 : (hi + stride - 1) / stride;
+
+		if (end > outSize)
+			end	= outSize;
+		if (begin > end)
+			begin	= end;
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * 畳み込み展開/逆展開
+	 * -境界判定は行単位で済ませ, 内側は連続コピーにする
+	 */
+	//----------------------------------------------------------------------
+	template <typename T, bool Inverse>
+	void Im2ColImpl(T            *pColumn,
+					T            *pInput,
+					unsigned int width,
+					unsigned int height,
+					unsigned int channel,
+					unsigned int filterSize,
+					unsigned int stride,
+					unsigned int padding)
+	{
+		const unsigned int	wMax	= ( width+2*padding-filterSize)/stride + 1;
+		const unsigned int	hMax	= (height+2*padding-filterSize)/stride + 1;
+
+		for (unsigned int c = 0; c < channel; ++c)
+		{
+			T	*pChannel	= pInput + c*width*height;
+
+			for (unsigned int i = 0; i < filterSize; ++i)
+			{
+				unsigned int	wBegin, wEnd;
+
+				ValidRange(wBegin, wEnd, i, width, wMax, stride, padding);
+
+				for (unsigned int j = 0; j < filterSize; ++j)
+				{
+					unsigned int	hBegin, hEnd;
+
+					ValidRange(hBegin, hEnd, j, height, hMax, stride, padding);
+
+					T	*pRow	= pColumn + ((c*filterSize+i)*filterSize+j)*wMax*hMax;
+
+					if (!Inverse)
+						memset(pRow, 0, sizeof(T) * wMax * hMax);
+
+					for (unsigned int w = wBegin; w < wEnd; ++w)
+					{
+						T	*pSrc	= pChannel
+									+ (w*stride+i-padding)*height
+									+ (hBegin*stride+j-padding);
+						T	*pDst	= pRow + w*hMax;
+
+						for (unsigned int h = hBegin; h < hEnd; ++h, pSrc += stride)
+						{
+							if (Inverse)
+								*pSrc		+= pDst[h];
+							else
+								pDst[h]	=  *pSrc;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Winograd F(2x2,3x3) の変換後タイル要素数(4x4).
+	const unsigned int	WINOGRAD_TILE	= 16;
+
+	// 要素積で同時に処理する出力数 x タイル数(レジスタタイル).
+	const unsigned int	WINOGRAD_OUTS	= 2;
+	const unsigned int	WINOGRAD_BLOCK	= 4;
+
+	//----------------------------------------------------------------------
+	/**
+	 * Winograd フィルタ変換 U = G g G^T
+	 * -backward 時は 180 度回転したフィルタを出力/入力を入れ替えて並べる
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void WinogradFilterTransformImpl(T            *pTransformed,
+									 const T      *pFilter,
+									 unsigned int filterNum,
+									 unsigned int channel,
+									 bool         backward)
+	{
+		for (unsigned int f = 0; f < filterNum; ++f)
+		{
+			for (unsigned int c = 0; c < channel; ++c)
+			{
+				const T	*pG	= pFilter + (f*channel+c)*9;
+				T		*pU	= backward
+							? pTransformed + (c*filterNum+f)*WINOGRAD_TILE
+							: pTransformed + (f*channel+c)*WINOGRAD_TILE;
+				T		g[3][3];
+				T		tmp[4][3];
+
+				for (unsigned int x = 0; x < 3; ++x)
+				{
+					for (unsigned int y = 0; y < 3; ++y)
+						g[x][y]	= backward ? pG[(2-x)*3+(2-y)] : pG[x*3+y];
+				}
+
+				for (unsigned int y = 0; y < 3; ++y)
+				{
+					tmp[0][y]	= g[0][y];
+					tmp[1][y]	= (g[0][y] + g[1][y] + g[2][y]) * (T)0.5;
+					tmp[2][y]	= (g[0][y] - g[1][y] + g[2][y]) * (T)0.5;
+					tmp[3][y]	= g[2][y];
+				}
+
+				for (unsigned int a = 0; a < 4; ++a)
+				{
+					pU[a*4+0]	= tmp[a][0];
+					pU[a*4+1]	= (tmp[a][0] + tmp[a][1] + tmp[a][2]) * (T)0.5;
+					pU[a*4+2]	= (tmp[a][0] - tmp[a][1] + tmp[a][2]) * (T)0.5;
+					pU[a*4+3]	= tmp[a][2];
+				}
+			}
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Winograd 入力変換 V = B^T d B
+	 * -pSrc から高さ方向 stride 間隔の 4x4 タイルを読む
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void WinogradInputTile(T            *pV,
+						   const T      *pSrc,
+						   unsigned int height)
+	{
+		const T	*pD0	= pSrc;
+		const T	*pD1	= pSrc +   height;
+		const T	*pD2	= pSrc + 2*height;
+		const T	*pD3	= pSrc + 3*height;
+		T		tmp[4][4];
+
+		for (unsigned int b = 0; b < 4; ++b)
+		{
+			tmp[0][b]	= pD0[b] - pD2[b];
+			tmp[1][b]	= pD1[b] + pD2[b];
+			tmp[2][b]	= pD2[b] - pD1[b];
+			tmp[3][b]	= pD1[b] - pD3[b];
+		}
+
+		for (unsigned int a = 0; a < 4; ++a)
+		{
+			pV[a*4+0]	= tmp[a][0] - tmp[a][2];
+			pV[a*4+1]	= tmp[a][1] + tmp[a][2];
+			pV[a*4+2]	= tmp[a][2] - tmp[a][1];
+			pV[a*4+3]	= tmp[a][1] - tmp[a][3];
+		}
+	}
+
+#ifdef NEURAL_NET_AVX2
+	//----------------------------------------------------------------------
+	/**
+	 * Winograd 入力変換(AVX2 倍精度版)
+	 * -行方向はベクトル演算, 行内は並べ替え + 符号付き加算で求める
+	 */
+	//----------------------------------------------------------------------
+	template <>
+	void WinogradInputTile<double>(double       *pV,
+								   const double *pSrc,
+								   unsigned int height)
+	{
+		const __m256d	d0		= _mm256_loadu_pd(pSrc);
+		const __m256d	d1		= _mm256_loadu_pd(pSrc +   height);
+		const __m256d	d2		= _mm256_loadu_pd(pSrc + 2*height);
+		const __m256d	d3		= _mm256_loadu_pd(pSrc + 3*height);
+		const __m256d	sign	= _mm256_set_pd(-1.0, -1.0, 1.0, -1.0);
+		__m256d			tmp[4];
+
+		tmp[0]	= _mm256_sub_pd(d0, d2);
+		tmp[1]	= _mm256_add_pd(d1, d2);
+		tmp[2]	= _mm256_sub_pd(d2, d1);
+		tmp[3]	= _mm256_sub_pd(d1, d3);
+
+		// (t0-t2, t1+t2, t2-t1, t1-t3) = (t0,t1,t2,t1) + sign * (t2,t2,t1,t3)
+		for (unsigned int a = 0; a < 4; ++a)
+		{
+			const __m256d	p1	= _mm256_permute4x64_pd(tmp[a], _MM_SHUFFLE(1, 2, 1, 0));
+			const __m256d	p2	= _mm256_permute4x64_pd(tmp[a], _MM_SHUFFLE(3, 1, 2, 2));
+
+			_mm256_storeu_pd(pV + a*4, _mm256_fmadd_pd(sign, p2, p1));
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Winograd 入力変換(AVX2 単精度版)
+	 * -1行 4 要素なので 128bit で倍精度版と同じ手順を行う
+	 */
+	//----------------------------------------------------------------------
+	template <>
+	void WinogradInputTile<float>(float        *pV,
+								  const float  *pSrc,
+								  unsigned int height)
+	{
+		const __m128	d0		= _mm_loadu_ps(pSrc);
+		const __m128	d1		= _mm_loadu_ps(pSrc +   height);
+		const __m128	d2		= _mm_loadu_ps(pSrc + 2*height);
+		const __m128	d3		= _mm_loadu_ps(pSrc + 3*height);
+		const __m128	sign	= _mm_set_ps(-1.0f, -1.0f, 1.0f, -1.0f);
+		__m128			tmp[4];
+
+		tmp[0]	= _mm_sub_ps(d0, d2);
+		tmp[1]	= _mm_add_ps(d1, d2);
+		tmp[2]	= _mm_sub_ps(d2, d1);
+		tmp[3]	= _mm_sub_ps(d1, d3);
+
+		for (unsigned int a = 0; a < 4; ++a)
+		{
+			const __m128	p1	= _mm_shuffle_ps(tmp[a], tmp[a], _MM_SHUFFLE(1, 2, 1, 0));
+			const __m128	p2	= _mm_shuffle_ps(tmp[a], tmp[a], _MM_SHUFFLE(3, 1, 2, 2));
+
+			_mm_storeu_ps(pV + a*4, _mm_fmadd_ps(sign, p2, p1));
+		}
+	}
+#endif
+
+	//----------------------------------------------------------------------
+	/**
+	 * Winograd 出力変換 Y = A^T m A
+	 * -出力範囲に入る 2x2 の部分だけ書き込む
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void WinogradOutputTile(T            *pOutput,
+							const T      *pM,
+							unsigned int w0,
+							unsigned int h0,
+							unsigned int outWidth,
+							unsigned int outHeight)
+	{
+		T	tmp[2][4];
+
+		for (unsigned int b = 0; b < 4; ++b)
+		{
+			tmp[0][b]	= pM[0*4+b] + pM[1*4+b] + pM[2*4+b];
+			tmp[1][b]	= pM[1*4+b] - pM[2*4+b] - pM[3*4+b];
+		}
+
+		for (unsigned int a = 0; a < 2; ++a)
+		{
+			if (w0 + a >= outWidth)
+				break;
+
+			T	*pRow	= pOutput + (w0+a)*outHeight + h0;
+
+			pRow[0]	= tmp[a][0] + tmp[a][1] + tmp[a][2];
+			if (h0 + 1 < outHeight)
+				pRow[1]	= tmp[a][1] - tmp[a][2] - tmp[a][3];
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Winograd 要素積(チャンネル方向の総和)
+	 * -出力 WINOGRAD_OUTS x タイル WINOGRAD_BLOCK ぶん
+	 *  m[o][t] = sum_c U[o][c] (.) V[t][c] を求める
+	 * -タイル要素をベクトル幅ずつ処理し, 累積はレジスタに置く
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void WinogradProduct(T            *pM,
+						 const T      *pU,
+						 const T      *pV,
+						 unsigned int channel)
+	{
+		typedef SimdTraits<T>		S;
+		typedef typename S::Vec		Vec;
+
+		const unsigned int	stride	= channel*WINOGRAD_TILE;
+
+		for (unsigned int v = 0; v < WINOGRAD_TILE; v += S::Width)
+		{
+			const T	*pUv	= pU + v;
+			const T	*pVv	= pV + v;
+			Vec		m00		= S::Zero();
+			Vec		m01		= S::Zero();
+			Vec		m02		= S::Zero();
+			Vec		m03		= S::Zero();
+			Vec		m10		= S::Zero();
+			Vec		m11		= S::Zero();
+			Vec		m12		= S::Zero();
+			Vec		m13		= S::Zero();
+
+			for (unsigned int c = 0; c < channel; ++c)
+			{
+				const Vec	u0	= S::Load(pUv);
+				const Vec	u1	= S::Load(pUv + stride);
+				const Vec	v0	= S::Load(pVv);
+				const Vec	v1	= S::Load(pVv +   stride);
+				const Vec	v2	= S::Load(pVv + 2*stride);
+				const Vec	v3	= S::Load(pVv + 3*stride);
+
+				m00	= S::Fmadd(u0, v0, m00);
+				m01	= S::Fmadd(u0, v1, m01);
+				m02	= S::Fmadd(u0, v2, m02);
+				m03	= S::Fmadd(u0, v3, m03);
+				m10	= S::Fmadd(u1, v0, m10);
+				m11	= S::Fmadd(u1, v1, m11);
+				m12	= S::Fmadd(u1, v2, m12);
+				m13	= S::Fmadd(u1, v3, m13);
+
+				pUv	+= WINOGRAD_TILE;
+				pVv	+= WINOGRAD_TILE;
+			}
+
+			S::Store(pM + v + 0*WINOGRAD_TILE, m00);
+			S::Store(pM + v + 1*WINOGRAD_TILE, m01);
+			S::Store(pM + v + 2*WINOGRAD_TILE, m02);
+			S::Store(pM + v + 3*WINOGRAD_TILE, m03);
+			S::Store(pM + v + 4*WINOGRAD_TILE, m10);
+			S::Store(pM + v + 5*WINOGRAD_TILE, m11);
+			S::Store(pM + v + 6*WINOGRAD_TILE, m12);
+			S::Store(pM + v + 7*WINOGRAD_TILE, m13);
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Winograd 要素積(1出力 x 1タイル)
+	 * -累積を4本に分けて FMA の遅延を隠す
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void WinogradProductTail(T            *pM,
+							 const T      *pU,
+							 const T      *pV,
+							 unsigned int channel)
+	{
+		typedef SimdTraits<T>		S;
+		typedef typename S::Vec		Vec;
+
+		// 1タイルがベクトル 2 本(単精度 AVX2)のときはチャンネルを偶奇に分けて 4 本にする.
+		if (WINOGRAD_TILE < 4*S::Width)
+		{
+			const T			*pUv	= pU;
+			const T			*pVv	= pV;
+			Vec				m0		= S::Zero();
+			Vec				m1		= S::Zero();
+			Vec				m2		= S::Zero();
+			Vec				m3		= S::Zero();
+			unsigned int	c		= 0;
+
+			for (; c + 2 <= channel; c += 2)
+			{
+				m0	= S::Fmadd(S::Load(pUv                            ), S::Load(pVv                            ), m0);
+				m1	= S::Fmadd(S::Load(pUv +                  S::Width), S::Load(pVv +                  S::Width), m1);
+				m2	= S::Fmadd(S::Load(pUv + WINOGRAD_TILE            ), S::Load(pVv + WINOGRAD_TILE            ), m2);
+				m3	= S::Fmadd(S::Load(pUv + WINOGRAD_TILE + S::Width), S::Load(pVv + WINOGRAD_TILE + S::Width), m3);
+
+				pUv	+= 2*WINOGRAD_TILE;
+				pVv	+= 2*WINOGRAD_TILE;
+			}
+			if (c < channel)
+			{
+				m0	= S::Fmadd(S::Load(pUv           ), S::Load(pVv           ), m0);
+				m1	= S::Fmadd(S::Load(pUv + S::Width), S::Load(pVv + S::Width), m1);
+			}
+
+			S::Store(pM           , S::Add(m0, m2));
+			S::Store(pM + S::Width, S::Add(m1, m3));
+			return;
+		}
+
+		for (unsigned int v = 0; v < WINOGRAD_TILE; v += 4*S::Width)
+		{
+			const T	*pUv	= pU + v;
+			const T	*pVv	= pV + v;
+			Vec		m0		= S::Zero();
+			Vec		m1		= S::Zero();
+			Vec		m2		= S::Zero();
+			Vec		m3		= S::Zero();
+
+			for (unsigned int c = 0; c < channel; ++c)
+			{
+				m0	= S::Fmadd(S::Load(pUv            ), S::Load(pVv            ), m0);
+				m1	= S::Fmadd(S::Load(pUv +   S::Width), S::Load(pVv +   S::Width), m1);
+				m2	= S::Fmadd(S::Load(pUv + 2*S::Width), S::Load(pVv + 2*S::Width), m2);
+				m3	= S::Fmadd(S::Load(pUv + 3*S::Width), S::Load(pVv + 3*S::Width), m3);
+
+				pUv	+= WINOGRAD_TILE;
+				pVv	+= WINOGRAD_TILE;
+			}
+
+			S::Store(pM + v             , m0);
+			S::Store(pM + v +   S::Width, m1);
+			S::Store(pM + v + 2*S::Width, m2);
+			S::Store(pM + v + 3*S::Width, m3);
+		}
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * int8 内積(スカラー版)
+	 */
+	//----------------------------------------------------------------------
+	inline int QuantizedDot(const signed char *pA,
+							const signed char *pB,
+							unsigned int      k)
+	{
+		int	total	= 0;
+
+		for (unsigned int i = 0; i < k; ++i)
+			total	+= pA[i] * pB[i];
+
+		return (total);
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * int8 量子化
+	 * -inverse 倍して ±QUANTIZED_MAX に飽和させ, 0 から遠い方へ丸める
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	inline signed char QuantizeScalar(T value, T inverse)
+	{
+		const T	limit	= (T)QUANTIZED_MAX;
+		T		v		= value * inverse;
+
+		v	= (v >  limit) ?  limit : v;
+		v	= (v < -limit) ? -limit : v;
+
+		return ((signed char)(int)(v + ((v >= 0) ? (T)0.5 : (T)-0.5)));
+	}
+
+	void QuantizeImpl(signed char  *pOutput,
+					  const double *pInput,
+					  double       inverse,
+					  unsigned int num)
+	{
+		unsigned int	i	= 0;
+
+#ifdef NEURAL_NET_AVX2
+		const __m256d	inv		= _mm256_set1_pd(inverse);
+		const __m256d	limit	= _mm256_set1_pd((double)QUANTIZED_MAX);
+		const __m256d	half	= _mm256_set1_pd(0.5);
+		const __m256d	sign	= _mm256_set1_pd(-0.0);
+
+		for (; i + 8 <= num; i += 8)
+		{
+			__m256d	v0	= _mm256_mul_pd(_mm256_loadu_pd(pInput + i + 0), inv);
+			__m256d	v1	= _mm256_mul_pd(_mm256_loadu_pd(pInput + i + 4), inv);
+
+			v0	= _mm256_max_pd(_mm256_min_pd(v0, limit), _mm256_xor_pd(limit, sign));
+			v1	= _mm256_max_pd(_mm256_min_pd(v1, limit), _mm256_xor_pd(limit, sign));
+			v0	= _mm256_add_pd(v0, _mm256_or_pd(_mm256_and_pd(v0, sign), half));
+			v1	= _mm256_add_pd(v1, _mm256_or_pd(_mm256_and_pd(v1, sign), half));
+
+			const __m128i	w	= _mm_packs_epi32(_mm256_cvttpd_epi32(v0), _mm256_cvttpd_epi32(v1));
+
+			_mm_storel_epi64((__m128i *)(pOutput + i), _mm_packs_epi16(w, w));
+		}
+#endif
+		for (; i < num; ++i)
+			pOutput[i]	= QuantizeScalar(pInput[i], inverse);
+	}
+
+	void QuantizeImpl(signed char  *pOutput,
+					  const float  *pInput,
+					  float        inverse,
+					  unsigned int num)
+	{
+		unsigned int	i	= 0;
+
+#ifdef NEURAL_NET_AVX2
+		const __m256	inv		= _mm256_set1_ps(inverse);
+		const __m256	limit	= _mm256_set1_ps((float)QUANTIZED_MAX);
+		const __m256	half	= _mm256_set1_ps(0.5f);
+		const __m256	sign	= _mm256_set1_ps(-0.0f);
+
+		for (; i + 8 <= num; i += 8)
+		{
+			__m256	v	= _mm256_mul_ps(_mm256_loadu_ps(pInput + i), inv);
+
+			v	= _mm256_max_ps(_mm256_min_ps(v, limit), _mm256_xor_ps(limit, sign));
+			v	= _mm256_add_ps(v, _mm256_or_ps(_mm256_and_ps(v, sign), half));
+
+			const __m256i	d	= _mm256_cvttps_epi32(v);
+			const __m128i	w	= _mm_packs_epi32(_mm256_castsi256_si128(d),
+											  _mm256_extracti128_si256(d, 1));
+
+			_mm_storel_epi64((__m128i *)(pOutput + i), _mm_packs_epi16(w, w));
+		}
+#endif
+		for (; i < num; ++i)
+			pOutput[i]	= QuantizeScalar(pInput[i], inverse);
+	}
+
+#ifdef NEURAL_NET_AVX2
+	// B を前もって int16 に広げる A の最小行数(これより少ないと広げ直しの方が安い).
+	const unsigned int	QUANTIZED_WIDEN_ROWS	= 4;
+
+	// 16 要素を int16 で読み込む.
+	inline __m256i LoadWide(const signed char *p)
+	{
+		return (_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)p)));
+	}
+
+	inline __m256i LoadWide(const short *p)
+	{
+		return (_mm256_loadu_si256((const __m256i *)p));
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * int8 行列積の 1 行分(AVX2)
+	 * -int16 に広げた A の 1 行を B の 4 行で共有し, madd で隣接積を int32 に足す
+	 *  (int8 x int8 の 2 項和は int16 に収まらないため maddubs は使わない)
+	 */
+	//----------------------------------------------------------------------
+	template <typename B>
+	void QuantizedRowImpl(int          *pC,
+						  const short  *pRow,
+						  const B      *pB,
+						  unsigned int n,
+						  unsigned int k)
+	{
+		unsigned int	j	= 0;
+
+		for (; j + 4 <= n; j += 4)
+		{
+			const B	*pB0	= pB + (j+0)*k;
+			const B	*pB1	= pB + (j+1)*k;
+			const B	*pB2	= pB + (j+2)*k;
+			const B	*pB3	= pB + (j+3)*k;
+			__m256i	c0		= _mm256_setzero_si256();
+			__m256i	c1		= _mm256_setzero_si256();
+			__m256i	c2		= _mm256_setzero_si256();
+			__m256i	c3		= _mm256_setzero_si256();
+
+			for (unsigned int l = 0; l < k; l += QUANTIZED_ALIGN)
+			{
+				const __m256i	a	= LoadWide(pRow + l);
+
+				c0	= _mm256_add_epi32(c0, _mm256_madd_epi16(a, LoadWide(pB0 + l)));
+				c1	= _mm256_add_epi32(c1, _mm256_madd_epi16(a, LoadWide(pB1 + l)));
+				c2	= _mm256_add_epi32(c2, _mm256_madd_epi16(a, LoadWide(pB2 + l)));
+				c3	= _mm256_add_epi32(c3, _mm256_madd_epi16(a, LoadWide(pB3 + l)));
+			}
+
+			// 4 本の総和を (c0, c1, c2, c3) にまとめる.
+			const __m256i	s01	= _mm256_hadd_epi32(c0, c1);
+			const __m256i	s23	= _mm256_hadd_epi32(c2, c3);
+			const __m256i	s	= _mm256_hadd_epi32(s01, s23);
+			const __m128i	r	= _mm_add_epi32(_mm256_castsi256_si128(s),
+											_mm256_extracti128_si256(s, 1));
+
+			_mm_storeu_si128((__m128i *)(pC + j), r);
+		}
+		for (; j < n; ++j)
+		{
+			const B	*pB0	= pB + j*k;
+			__m256i	c0		= _mm256_setzero_si256();
+
+			for (unsigned int l = 0; l < k; l += QUANTIZED_ALIGN)
+				c0	= _mm256_add_epi32(c0, _mm256_madd_epi16(LoadWide(pRow + l), LoadWide(pB0 + l)));
+
+			__m128i	r	= _mm_add_epi32(_mm256_castsi256_si128(c0),
+									_mm256_extracti128_si256(c0, 1));
+
+			r	= _mm_hadd_epi32(r, r);
+			r	= _mm_hadd_epi32(r, r);
+
+			pC[j]	= _mm_cvtsi128_si32(r);
+		}
+	}
+#endif
+
+	//----------------------------------------------------------------------
+	/**
+	 * int8 行列積
+	 * -AVX2 では A の各行を一度だけ int16 に広げる.
+	 *  B も A の行数が多ければ先にまとめて広げておく
+	 */
+	//----------------------------------------------------------------------
+	void QuantizedMultiplyImpl(int               *pC,
+							   const signed char *pA,
+							   const signed char *pB,
+							   unsigned int      m,
+							   unsigned int      n,
+							   unsigned int      k)
+	{
+#ifdef NEURAL_NET_AVX2
+		static thread_local std::vector<short>	wideA;
+		static thread_local std::vector<short>	wideB;
+
+		const bool	widenB	= (m >= QUANTIZED_WIDEN_ROWS);
+
+		wideA.resize(k);
+		if (widenB)
+		{
+			wideB.resize(n * k);
+			for (unsigned int l = 0; l < n * k; l += QUANTIZED_ALIGN)
+				_mm256_storeu_si256((__m256i *)&wideB[l], LoadWide(pB + l));
+		}
+
+		for (unsigned int i = 0; i < m; ++i)
+		{
+			for (unsigned int l = 0; l < k; l += QUANTIZED_ALIGN)
+				_mm256_storeu_si256((__m256i *)&wideA[l], LoadWide(pA + i*k + l));
+
+			if (widenB)
+				QuantizedRowImpl(pC + i*n, &wideA[0], &wideB[0], n, k);
+			else
+				QuantizedRowImpl(pC + i*n, &wideA[0], pB, n, k);
+		}
+#else
+		for (unsigned int i = 0; i < m; ++i)
+		{
+			for (unsigned int j = 0; j < n; ++j)
+				pC[i*n+j]	= QuantizedDot(pA + i*k, pB + j*k, k);
+		}
+#endif
+	}
+
+	//----------------------------------------------------------------------
+	/**
+	 * Winograd F(2x2,3x3) 畳み込み(ストライド1)
+	 */
+	//----------------------------------------------------------------------
+	template <typename T>
+	void WinogradConvolutionImpl(T            *pOutput,
+								 const T      *pInput,
+								 const T      *pTransformed,
+								 unsigned int width,
+								 unsigned int height,
+								 unsigned int channel,
+								 unsigned int outWidth,
+								 unsigned int outHeight,
+								 unsigned int outChannel,
+								 int          padding)
+	{
+		static thread_local std::vector<T>	padded;
+		static thread_local std::vector<T>	input;
+
+		const unsigned int	tileW	= (outWidth  + 1) / 2;
+		const unsigned int	tileH	= (outHeight + 1) / 2;
+		const unsigned int	tiles	= tileW * tileH;
+		const unsigned int	padW	= tileW*2 + 2;
+		const unsigned int	padH	= tileH*2 + 2;
+
+		// パディング込みの入力を作り, タイルの切り出しで境界判定をしない.
+		padded.assign(channel * padW * padH, (T)0);
+
+		const int			hBegin	= (padding < 0) ? -padding : 0;
+		const int			hEnd	= ((int)height + padding > (int)padH)
+									? (int)padH - padding : (int)height;
+
+		for (unsigned int c = 0; c < channel; ++c)
+		{
+			for (unsigned int w = 0; w < width; ++w)
+			{
+				const int	pw	= (int)w + padding;
+
+				if ((pw < 0) || (pw >= (int)padW) || (hBegin >= hEnd))
+					continue;
+
+				const T	*pSrc	= pInput + (c*width+w)*height;
+				T		*pDst	= &padded[(c*padW+pw)*padH];
+
+				for (int h = hBegin; h < hEnd; ++h)
+					pDst[h+padding]	= pSrc[h];
+			}
+		}
+
+		input.resize(tiles * channel * WINOGRAD_TILE);
+
+		// 入力変換 V[t][c].
+		for (unsigned int tw = 0; tw < tileW; ++tw)
+		{
+			for (unsigned int th = 0; th < tileH; ++th)
+			{
+				const unsigned int	t	= tw*tileH + th;
+
+				for (unsigned int c = 0; c < channel; ++c)
+				{
+					WinogradInputTile(&input[(t*channel+c)*WINOGRAD_TILE],
+									  &padded[(c*padW+tw*2)*padH + th*2],
+									  padH);
+				}
+			}
+		}
+
+		// 要素積 + 出力変換.
+		// タイルのブロックを外側にし, V を L1 に置いたまま U を流す.
+		T				m[WINOGRAD_OUTS*WINOGRAD_BLOCK*WINOGRAD_TILE];
+		unsigned int	t	= 0;
+
+		for (; t + WINOGRAD_BLOCK <= tiles; t += WINOGRAD_BLOCK)
+		{
+			const T			*pV	= &input[t*channel*WINOGRAD_TILE];
+			unsigned int	o	= 0;
+
+			for (; o + WINOGRAD_OUTS <= outChannel; o += WINOGRAD_OUTS)
+			{
+				WinogradProduct(m,
+								pTransformed + o*channel*WINOGRAD_TILE,
+								pV,
+								channel);
+
+				for (unsigned int i = 0; i < WINOGRAD_OUTS; ++i)
+				{
+					for (unsigned int b = 0; b < WINOGRAD_BLOCK; ++b)
+					{
+						WinogradOutputTile(pOutput + (o+i)*outWidth*outHeight,
+										   &m[(i*WINOGRAD_BLOCK+b)*WINOGRAD_TILE],
+										   ((t+b) / tileH) * 2,
+										   ((t+b) % tileH) * 2,
+										   outWidth,
+										   outHeight);
+					}
+				}
+			}
+
+			for (; o < outChannel; ++o)
+			{
+				for (unsigned int b = 0; b < WINOGRAD_BLOCK; ++b)
+				{
+					WinogradProductTail(m,
+										pTransformed + o*channel*WINOGRAD_TILE,
+										pV + b*channel*WINOGRAD_TILE,
+										channel);
+
+					WinogradOutputTile(pOutput + o*outWidth*outHeight,
+									   m,
+									   ((t+b) / tileH) * 2,
+									   ((t+b) % tileH) * 2,
+									   outWidth,
+									   outHeight);
+				}
+			}
+		}
+
+		for (; t < tiles; ++t)
+		{
+			for (unsigned int o = 0; o < outChannel; ++o)
+			{
+				WinogradProductTail(m,
+									pTransformed + o*channel*WINOGRAD_TILE,
+									&input[t*channel*WINOGRAD_TILE],
+									channel);
+
+				WinogradOutputTile(pOutput + o*outWidth*outHeight,
+								   m,
+								   (t / tileH) * 2,
+								   (t % tileH) * 2,
+								   outWidth,
+								   outHeight);
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化
+ * -出力を置き換え, 後方出力用の微分値を activation.pMask に書く
+ *
+ * @param pOutput    活性化する値(num)
+ * @param num        要素数
+ * @param activation 活性化の種類とパラメータ
+ */
+//----------------------------------------------------------------------
+void Activate(double                   *pOutput,
+			  unsigned int             num,
+			  const Activation<double> &activation)
+{
+	Activate(pOutput, pOutput, num, activation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化(単精度)
+ */
+//----------------------------------------------------------------------
+void Activate(float                    *pOutput,
+			  unsigned int             num,
+			  const Activation<float>  &activation)
+{
+	Activate(pOutput, pOutput, num, activation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化(入力を別に取る)
+ * -入力を複製せずに 1 回の走査で出力と微分値を書く(活性化層用)
+ *
+ * @param pOutput    出力(num)
+ * @param pInput     入力(num, pOutput と同じでもよい)
+ * @param num        要素数
+ * @param activation 活性化の種類とパラメータ
+ */
+//----------------------------------------------------------------------
+void Activate(double                   *pOutput,
+			  const double             *pInput,
+			  unsigned int             num,
+			  const Activation<double> &activation)
+{
+	ActivateRangeImpl(pOutput, pInput, 0, num, activation);
+
+	if (activation.softMax)
+		SoftMaxImpl(pOutput, pOutput, num, activation.accuracy);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化(入力を別に取る, 単精度)
+ */
+//----------------------------------------------------------------------
+void Activate(float                    *pOutput,
+			  const float              *pInput,
+			  unsigned int             num,
+			  const Activation<float>  &activation)
+{
+	ActivateRangeImpl(pOutput, pInput, 0, num, activation);
+
+	if (activation.softMax)
+		SoftMaxImpl(pOutput, pOutput, num, activation.accuracy);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Soft-Max
+ *
+ * @param pOutput  出力(num)
+ * @param pInput   入力(num, pOutput と同じでもよい)
+ * @param num      要素数
+ * @param accuracy exp の計算精度
+ */
+//----------------------------------------------------------------------
+void SoftMax(double             *pOutput,
+			 const double       *pInput,
+			 unsigned int       num,
+			 ActivationAccuracy accuracy)
+{
+	SoftMaxImpl(pOutput, pInput, num, accuracy);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Soft-Max(単精度)
+ */
+//----------------------------------------------------------------------
+void SoftMax(float              *pOutput,
+			 const float        *pInput,
+			 unsigned int       num,
+			 ActivationAccuracy accuracy)
+{
+	SoftMaxImpl(pOutput, pInput, num, accuracy);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 微分値の乗算(活性化の後方出力)
+ *
+ * @param pOutput 入力差分の受取(num)
+ * @param pDelta  出力差分(num)
+ * @param pMask   前方出力時の微分値(num)
+ * @param num     要素数
+ */
+//----------------------------------------------------------------------
+void MultiplyMask(double       *pOutput,
+				  const double *pDelta,
+				  const double *pMask,
+				  unsigned int num)
+{
+	MultiplyMaskImpl(pOutput, pDelta, pMask, num);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 微分値の乗算(単精度)
+ */
+//----------------------------------------------------------------------
+void MultiplyMask(float        *pOutput,
+				  const float  *pDelta,
+				  const float  *pMask,
+				  unsigned int num)
+{
+	MultiplyMaskImpl(pOutput, pDelta, pMask, num);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化(N 行)
+ * -activation.pMask は N x num(行ごとにずらして書く)
+ *
+ * @param pOutput    活性化する値(batchNum x num)
+ * @param num        1 行の要素数
+ * @param batchNum   行数
+ * @param activation 活性化の種類とパラメータ
+ */
+//----------------------------------------------------------------------
+void ActivateBatch(double                   *pOutput,
+				   unsigned int             num,
+				   unsigned int             batchNum,
+				   const Activation<double> &activation)
+{
+	ActivateBatchImpl(pOutput, pOutput, num, batchNum, activation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化(N 行, 単精度)
+ */
+//----------------------------------------------------------------------
+void ActivateBatch(float                    *pOutput,
+				   unsigned int             num,
+				   unsigned int             batchNum,
+				   const Activation<float>  &activation)
+{
+	ActivateBatchImpl(pOutput, pOutput, num, batchNum, activation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化(N 行, 入力を別に取る)
+ *
+ * @param pOutput    出力(batchNum x num)
+ * @param pInput     入力(batchNum x num, pOutput と同じでもよい)
+ * @param num        1 行の要素数
+ * @param batchNum   行数
+ * @param activation 活性化の種類とパラメータ
+ */
+//----------------------------------------------------------------------
+void ActivateBatch(double                   *pOutput,
+				   const double             *pInput,
+				   unsigned int             num,
+				   unsigned int             batchNum,
+				   const Activation<double> &activation)
+{
+	ActivateBatchImpl(pOutput, pInput, num, batchNum, activation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 活性化(N 行, 入力を別に取る, 単精度)
+ */
+//----------------------------------------------------------------------
+void ActivateBatch(float                    *pOutput,
+				   const float              *pInput,
+				   unsigned int             num,
+				   unsigned int             batchNum,
+				   const Activation<float>  &activation)
+{
+	ActivateBatchImpl(pOutput, pInput, num, batchNum, activation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine前方出力
+ *
+ * @param pOutput     出力値(outputNum)
+ * @param pInput      入力値(inputNum)
+ * @param pWeight     重み(inputNum x outputNum)
+ * @param pBias       バイアス(outputNum)
+ * @param inputNum    入力の要素数
+ * @param outputNum   出力の要素数
+ * @param pActivation まとめて適用する活性化(なければ NULL)
+ */
+//----------------------------------------------------------------------
+void AffineForward(double                   *pOutput,
+				   const double             *pInput,
+				   const double             *pWeight,
+				   const double             *pBias,
+				   unsigned int             inputNum,
+				   unsigned int             outputNum,
+				   const Activation<double> *pActivation)
+{
+	AffineForwardImpl(pOutput, pInput, pWeight, pBias, inputNum, outputNum, pActivation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine前方出力(単精度)
+ */
+//----------------------------------------------------------------------
+void AffineForward(float                    *pOutput,
+				   const float              *pInput,
+				   const float              *pWeight,
+				   const float              *pBias,
+				   unsigned int             inputNum,
+				   unsigned int             outputNum,
+				   const Activation<float>  *pActivation)
+{
+	AffineForwardImpl(pOutput, pInput, pWeight, pBias, inputNum, outputNum, pActivation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine後方出力
+ * -重み差分・バイアス差分には加算する
+ *
+ * @param pOutput      入力差分の受取(inputNum)
+ * @param pDeltaWeight 重み差分(inputNum x outputNum)
+ * @param pDeltaBias   バイアス差分(outputNum)
+ * @param pDelta       出力差分(outputNum)
+ * @param pInput       前方出力時の入力値(inputNum)
+ * @param pWeight      重み(inputNum x outputNum)
+ * @param inputNum     入力の要素数
+ * @param outputNum    出力の要素数
+ */
+//----------------------------------------------------------------------
+void AffineBackward(double       *pOutput,
+					double       *pDeltaWeight,
+					double       *pDeltaBias,
+					const double *pDelta,
+					const double *pInput,
+					const double *pWeight,
+					unsigned int inputNum,
+					unsigned int outputNum)
+{
+	AffineBackwardImpl(pOutput,
+					   pDeltaWeight,
+					   pDeltaBias,
+					   pDelta,
+					   pInput,
+					   pWeight,
+					   inputNum,
+					   outputNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine後方出力(単精度)
+ */
+//----------------------------------------------------------------------
+void AffineBackward(float        *pOutput,
+					float        *pDeltaWeight,
+					float        *pDeltaBias,
+					const float  *pDelta,
+					const float  *pInput,
+					const float  *pWeight,
+					unsigned int inputNum,
+					unsigned int outputNum)
+{
+	AffineBackwardImpl(pOutput,
+					   pDeltaWeight,
+					   pDeltaBias,
+					   pDelta,
+					   pInput,
+					   pWeight,
+					   inputNum,
+					   outputNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine前方出力(N 行)
+ *
+ * @param pOutput     出力値(batchNum x outputNum)
+ * @param pInput      入力値(batchNum x inputNum)
+ * @param pWeight     重み(inputNum x outputNum)
+ * @param pBias       バイアス(outputNum)
+ * @param inputNum    入力の要素数
+ * @param outputNum   出力の要素数
+ * @param batchNum    行数
+ * @param pActivation まとめて適用する活性化(なければ NULL, pMask は batchNum x outputNum)
+ */
+//----------------------------------------------------------------------
+void AffineForwardBatch(double                   *pOutput,
+						const double             *pInput,
+						const double             *pWeight,
+						const double             *pBias,
+						unsigned int             inputNum,
+						unsigned int             outputNum,
+						unsigned int             batchNum,
+						const Activation<double> *pActivation)
+{
+	AffineForwardBatchImpl(pOutput, pInput, pWeight, pBias, inputNum, outputNum, batchNum, pActivation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine前方出力(N 行, 単精度)
+ */
+//----------------------------------------------------------------------
+void AffineForwardBatch(float                    *pOutput,
+						const float              *pInput,
+						const float              *pWeight,
+						const float              *pBias,
+						unsigned int             inputNum,
+						unsigned int             outputNum,
+						unsigned int             batchNum,
+						const Activation<float>  *pActivation)
+{
+	AffineForwardBatchImpl(pOutput, pInput, pWeight, pBias, inputNum, outputNum, batchNum, pActivation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine後方出力(N 行)
+ * -重み差分・バイアス差分には N 件分を加算する
+ *
+ * @param pOutput      入力差分の受取(batchNum x inputNum)
+ * @param pDeltaWeight 重み差分(inputNum x outputNum)
+ * @param pDeltaBias   バイアス差分(outputNum)
+ * @param pDelta       出力差分(batchNum x outputNum)
+ * @param pInput       前方出力時の入力値(batchNum x inputNum)
+ * @param pWeight      重み(inputNum x outputNum)
+ * @param inputNum     入力の要素数
+ * @param outputNum    出力の要素数
+ * @param batchNum     行数
+ */
+//----------------------------------------------------------------------
+void AffineBackwardBatch(double       *pOutput,
+						 double       *pDeltaWeight,
+						 double       *pDeltaBias,
+						 const double *pDelta,
+						 const double *pInput,
+						 const double *pWeight,
+						 unsigned int inputNum,
+						 unsigned int outputNum,
+						 unsigned int batchNum)
+{
+	AffineBackwardBatchImpl(pOutput,
+							pDeltaWeight,
+							pDeltaBias,
+							pDelta,
+							pInput,
+							pWeight,
+							inputNum,
+							outputNum,
+							batchNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine後方出力(N 行, 単精度)
+ */
+//----------------------------------------------------------------------
+void AffineBackwardBatch(float        *pOutput,
+						 float        *pDeltaWeight,
+						 float        *pDeltaBias,
+						 const float  *pDelta,
+						 const float  *pInput,
+						 const float  *pWeight,
+						 unsigned int inputNum,
+						 unsigned int outputNum,
+						 unsigned int batchNum)
+{
+	AffineBackwardBatchImpl(pOutput,
+							pDeltaWeight,
+							pDeltaBias,
+							pDelta,
+							pInput,
+							pWeight,
+							inputNum,
+							outputNum,
+							batchNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine前方出力(0/1 疎入力)
+ * -入力は値が 1 の要素の番号で渡す(それ以外は 0)
+ *
+ * @param pOutput     出力値の受取(outputNum)
+ * @param pActive     値が 1 の入力の番号(activeNum)
+ * @param activeNum   値が 1 の入力の数
+ * @param pWeight     重み(inputNum x outputNum)
+ * @param pBias       バイアス(outputNum)
+ * @param outputNum   出力の要素数
+ * @param pActivation まとめて適用する活性化(なければ NULL)
+ */
+//----------------------------------------------------------------------
+void AffineForwardSparse(double                   *pOutput,
+						 const unsigned int       *pActive,
+						 unsigned int             activeNum,
+						 const double             *pWeight,
+						 const double             *pBias,
+						 unsigned int             outputNum,
+						 const Activation<double> *pActivation)
+{
+	AffineForwardSparseImpl(pOutput, pActive, activeNum, pWeight, pBias, outputNum, pActivation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine前方出力(0/1 疎入力, 単精度)
+ */
+//----------------------------------------------------------------------
+void AffineForwardSparse(float                    *pOutput,
+						 const unsigned int       *pActive,
+						 unsigned int             activeNum,
+						 const float              *pWeight,
+						 const float              *pBias,
+						 unsigned int             outputNum,
+						 const Activation<float>  *pActivation)
+{
+	AffineForwardSparseImpl(pOutput, pActive, activeNum, pWeight, pBias, outputNum, pActivation);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine出力の差分更新(0/1 疎入力)
+ * -入力が変化した重み行だけを出力(活性化前)に足し引きする
+ *
+ * @param pOutput   更新する出力値(outputNum)
+ * @param pAdd      0 から 1 になった入力の番号(addNum)
+ * @param addNum    0 から 1 になった入力の数
+ * @param pRemove   1 から 0 になった入力の番号(removeNum)
+ * @param removeNum 1 から 0 になった入力の数
+ * @param pWeight   重み(inputNum x outputNum)
+ * @param outputNum 出力の要素数
+ */
+//----------------------------------------------------------------------
+void AffineUpdateSparse(double             *pOutput,
+						const unsigned int *pAdd,
+						unsigned int       addNum,
+						const unsigned int *pRemove,
+						unsigned int       removeNum,
+						const double       *pWeight,
+						unsigned int       outputNum)
+{
+	AffineUpdateSparseImpl(pOutput, pAdd, addNum, pRemove, removeNum, pWeight, outputNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine出力の差分更新(0/1 疎入力, 単精度)
+ */
+//----------------------------------------------------------------------
+void AffineUpdateSparse(float              *pOutput,
+						const unsigned int *pAdd,
+						unsigned int       addNum,
+						const unsigned int *pRemove,
+						unsigned int       removeNum,
+						const float        *pWeight,
+						unsigned int       outputNum)
+{
+	AffineUpdateSparseImpl(pOutput, pAdd, addNum, pRemove, removeNum, pWeight, outputNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine後方出力(0/1 疎入力)
+ * -重み差分・バイアス差分には加算する. 入力差分は求めない
+ *
+ * @param pDeltaWeight 重み差分(inputNum x outputNum)
+ * @param pDeltaBias   バイアス差分(outputNum)
+ * @param pDelta       出力差分(outputNum)
+ * @param pActive      前方出力時に値が 1 だった入力の番号(activeNum)
+ * @param activeNum    値が 1 の入力の数
+ * @param outputNum    出力の要素数
+ */
+//----------------------------------------------------------------------
+void AffineBackwardSparse(double             *pDeltaWeight,
+						  double             *pDeltaBias,
+						  const double       *pDelta,
+						  const unsigned int *pActive,
+						  unsigned int       activeNum,
+						  unsigned int       outputNum)
+{
+	AffineBackwardSparseImpl(pDeltaWeight, pDeltaBias, pDelta, pActive, activeNum, outputNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Affine後方出力(0/1 疎入力, 単精度)
+ */
+//----------------------------------------------------------------------
+void AffineBackwardSparse(float              *pDeltaWeight,
+						  float              *pDeltaBias,
+						  const float        *pDelta,
+						  const unsigned int *pActive,
+						  unsigned int       activeNum,
+						  unsigned int       outputNum)
+{
+	AffineBackwardSparseImpl(pDeltaWeight, pDeltaBias, pDelta, pActive, activeNum, outputNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 行列積
+ * -C に加算する(上書きする場合は呼び出し側で 0 クリアしておく)
+ *
+ * @param pC     出力行列(m x n)
+ * @param pA     左行列(m x k, transA 時 k x m)
+ * @param pB     右行列(k x n, transB 時 n x k)
+ * @param m      C の行数
+ * @param n      C の列数
+ * @param k      内積方向の要素数
+ * @param transA A を転置して使うか
+ * @param transB B を転置して使うか
+ */
+//----------------------------------------------------------------------
+void MatrixMultiply(double       *pC,
+					const double *pA,
+					const double *pB,
+					unsigned int m,
+					unsigned int n,
+					unsigned int k,
+					bool         transA,
+					bool         transB)
+{
+	MatrixMultiplyImpl(pC, pA, pB, m, n, k, transA, transB);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 行列積(単精度)
+ */
+//----------------------------------------------------------------------
+void MatrixMultiply(float        *pC,
+					const float  *pA,
+					const float  *pB,
+					unsigned int m,
+					unsigned int n,
+					unsigned int k,
+					bool         transA,
+					bool         transB)
+{
+	MatrixMultiplyImpl(pC, pA, pB, m, n, k, transA, transB);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 畳み込み展開
+ * -範囲外(パディング)は 0 になる
+ *
+ * @param pColumn    展開先(channel*filterSize^2 x wMax*hMax)
+ * @param pInput     入力値(channel x width x height)
+ * @param width      入力の横幅
+ * @param height     入力の高さ
+ * @param channel    入力のチャンネル数
+ * @param filterSize フィルタのサイズ
+ * @param stride     フィルタの移動幅
+ * @param padding    パディングの幅
+ */
+//----------------------------------------------------------------------
+void Im2Col(double       *pColumn,
+			const double *pInput,
+			unsigned int width,
+			unsigned int height,
+			unsigned int channel,
+			unsigned int filterSize,
+			unsigned int stride,
+			unsigned int padding)
+{
+	Im2ColImpl<double, false>(pColumn,
+							  const_cast<double *>(pInput),
+							  width,
+							  height,
+							  channel,
+							  filterSize,
+							  stride,
+							  padding);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 畳み込み展開(単精度)
+ */
+//----------------------------------------------------------------------
+void Im2Col(float        *pColumn,
+			const float  *pInput,
+			unsigned int width,
+			unsigned int height,
+			unsigned int channel,
+			unsigned int filterSize,
+			unsigned int stride,
+			unsigned int padding)
+{
+	Im2ColImpl<float, false>(pColumn,
+							 const_cast<float *>(pInput),
+							 width,
+							 height,
+							 channel,
+							 filterSize,
+							 stride,
+							 padding);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 畳み込み逆展開
+ * -パッチ行列の値を入力位置へ加算する
+ *
+ * @param pInput     加算先(channel x width x height)
+ * @param pColumn    パッチ行列(channel*filterSize^2 x wMax*hMax)
+ * @param width      入力の横幅
+ * @param height     入力の高さ
+ * @param channel    入力のチャンネル数
+ * @param filterSize フィルタのサイズ
+ * @param stride     フィルタの移動幅
+ * @param padding    パディングの幅
+ */
+//----------------------------------------------------------------------
+void Col2Im(double       *pInput,
+			const double *pColumn,
+			unsigned int width,
+			unsigned int height,
+			unsigned int channel,
+			unsigned int filterSize,
+			unsigned int stride,
+			unsigned int padding)
+{
+	Im2ColImpl<double, true>(const_cast<double *>(pColumn),
+							 pInput,
+							 width,
+							 height,
+							 channel,
+							 filterSize,
+							 stride,
+							 padding);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 畳み込み逆展開(単精度)
+ */
+//----------------------------------------------------------------------
+void Col2Im(float        *pInput,
+			const float  *pColumn,
+			unsigned int width,
+			unsigned int height,
+			unsigned int channel,
+			unsigned int filterSize,
+			unsigned int stride,
+			unsigned int padding)
+{
+	Im2ColImpl<float, true>(const_cast<float *>(pColumn),
+							pInput,
+							width,
+							height,
+							channel,
+							filterSize,
+							stride,
+							padding);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Winograd F(2x2,3x3) フィルタ変換
+ * -前方用は (filterNum x channel), 後方用は 180 度回転して
+ *  (channel x filterNum) の順に 4x4 の変換後フィルタを並べる
+ *
+ * @param pTransformed 変換後フィルタ(filterNum*channel*16)
+ * @param pFilter      フィルタ(filterNum x channel x 3 x 3)
+ * @param filterNum    フィルタ数
+ * @param channel      入力のチャンネル数
+ * @param backward     入力差分(後方出力)用に変換するか
+ */
+//----------------------------------------------------------------------
+void WinogradFilterTransform(double       *pTransformed,
+							 const double *pFilter,
+							 unsigned int filterNum,
+							 unsigned int channel,
+							 bool         backward)
+{
+	WinogradFilterTransformImpl(pTransformed,
+								pFilter,
+								filterNum,
+								channel,
+								backward);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Winograd F(2x2,3x3) フィルタ変換(単精度)
+ */
+//----------------------------------------------------------------------
+void WinogradFilterTransform(float        *pTransformed,
+							 const float  *pFilter,
+							 unsigned int filterNum,
+							 unsigned int channel,
+							 bool         backward)
+{
+	WinogradFilterTransformImpl(pTransformed,
+								pFilter,
+								filterNum,
+								channel,
+								backward);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Winograd F(2x2,3x3) 畳み込み(3x3, ストライド1)
+ * -出力は上書きする(バイアスは呼び出し側で加算する)
+ *
+ * @param pOutput      出力値(outChannel x outWidth x outHeight)
+ * @param pInput       入力値(channel x width x height)
+ * @param pTransformed 変換後フィルタ(outChannel x channel x 16)
+ * @param width        入力の横幅
+ * @param height       入力の高さ
+ * @param channel      入力のチャンネル数
+ * @param outWidth     出力の横幅
+ * @param outHeight    出力の高さ
+ * @param outChannel   出力のチャンネル数
+ * @param padding      パディングの幅(負の場合は内側から開始)
+ */
+//----------------------------------------------------------------------
+void WinogradConvolution(double       *pOutput,
+						 const double *pInput,
+						 const double *pTransformed,
+						 unsigned int width,
+						 unsigned int height,
+						 unsigned int channel,
+						 unsigned int outWidth,
+						 unsigned int outHeight,
+						 unsigned int outChannel,
+						 int          padding)
+{
+	WinogradConvolutionImpl(pOutput,
+							pInput,
+							pTransformed,
+							width,
+							height,
+							channel,
+							outWidth,
+							outHeight,
+							outChannel,
+							padding);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Winograd F(2x2,3x3) 畳み込み(3x3, ストライド1)(単精度)
+ */
+//----------------------------------------------------------------------
+void WinogradConvolution(float        *pOutput,
+						 const float  *pInput,
+						 const float  *pTransformed,
+						 unsigned int width,
+						 unsigned int height,
+						 unsigned int channel,
+						 unsigned int outWidth,
+						 unsigned int outHeight,
+						 unsigned int outChannel,
+						 int          padding)
+{
+	WinogradConvolutionImpl(pOutput,
+							pInput,
+							pTransformed,
+							width,
+							height,
+							channel,
+							outWidth,
+							outHeight,
+							outChannel,
+							padding);
+}
+
+//----------------------------------------------------------------------
+/**
+ * int8 行列積
+ * -結果は上書きする
+ *
+ * @param pC 出力行列(m x n)
+ * @param pA 左行列(m x k)
+ * @param pB 右行列(n x k, 転置して使う)
+ * @param m  C の行数
+ * @param n  C の列数
+ * @param k  内積方向の要素数(QUANTIZED_ALIGN の倍数)
+ */
+//----------------------------------------------------------------------
+void QuantizedMultiply(int               *pC,
+					   const signed char *pA,
+					   const signed char *pB,
+					   unsigned int      m,
+					   unsigned int      n,
+					   unsigned int      k)
+{
+	QuantizedMultiplyImpl(pC, pA, pB, m, n, k);
+}
+
+//----------------------------------------------------------------------
+/**
+ * int8 量子化
+ *
+ * @param pOutput  出力(num)
+ * @param pInput   入力(num)
+ * @param inverse  量子化スケールの逆数
+ * @param num      要素数
+ */
+//----------------------------------------------------------------------
+void Quantize(signed char  *pOutput,
+			  const double *pInput,
+			  double       inverse,
+			  unsigned int num)
+{
+	QuantizeImpl(pOutput, pInput, inverse, num);
+}
+
+void Quantize(signed char  *pOutput,
+			  const float  *pInput,
+			  float        inverse,
+			  unsigned int num)
+{
+	QuantizeImpl(pOutput, pInput, inverse, num);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 勾配降下の更新
+ * -pParam = (1 - ratio * weightDecay) * pParam + ratio * pDelta の後, 差分を 0 にする
+ * -pMoment があれば pMoment = momentum * pMoment + pDelta を pDelta の代わりに使う
+ *
+ * @param pParam       学習する値(num)
+ * @param pDelta       差分(num)
+ * @param pMoment      モーメンタム(num, 使わなければ NULL)
+ * @param ratio        学習率
+ * @param momentum     モーメンタム係数
+ * @param weightDecay  重み減衰率
+ * @param scale        差分にかける倍率
+ * @param num          要素数
+ */
+//----------------------------------------------------------------------
+void SgdUpdate(double       *pParam,
+			   double       *pDelta,
+			   double       *pMoment,
+			   double       ratio,
+			   double       momentum,
+			   double       weightDecay,
+			   double       scale,
+			   unsigned int num)
+{
+	SgdUpdateImpl(pParam, pDelta, pMoment, ratio, momentum, weightDecay, scale, num);
+}
+
+void SgdUpdate(float        *pParam,
+			   float        *pDelta,
+			   float        *pMoment,
+			   float        ratio,
+			   float        momentum,
+			   float        weightDecay,
+			   float        scale,
+			   unsigned int num)
+{
+	SgdUpdateImpl(pParam, pDelta, pMoment, ratio, momentum, weightDecay, scale, num);
+}
+
+//----------------------------------------------------------------------
+/**
+ * Adam の更新
+ * -モーメント・速度を更新して値に反映し, 差分を 0 にする
+ * -バイアス補正は 1 - beta^step, 重み減衰は値に直接かける(AdamW. 0 なら Adam)
+ *
+ * @param pParam       学習する値(num)
+ * @param pDelta       差分(num)
+ * @param pMoment      モーメント(num)
+ * @param pVelocity    速度(num)
+ * @param alpha        係数更新率
+ * @param beta1        モーメント更新率
+ * @param beta2        速度更新率
+ * @param epsilon      誤差値
+ * @param weightDecay  重み減衰率
+ * @param scale        差分にかける倍率
+ * @param step         更新回数(今回を含む, 1 から)
+ * @param num          要素数
+ */
+//----------------------------------------------------------------------
+void AdamUpdate(double       *pParam,
+				double       *pDelta,
+				double       *pMoment,
+				double       *pVelocity,
+				double       alpha,
+				double       beta1,
+				double       beta2,
+				double       epsilon,
+				double       weightDecay,
+				double       scale,
+				unsigned int step,
+				unsigned int num)
+{
+	AdamUpdateImpl(pParam, pDelta, pMoment, pVelocity,
+				   alpha, beta1, beta2, epsilon, weightDecay, scale, step, num);
+}
+
+void AdamUpdate(float        *pParam,
+				float        *pDelta,
+				float        *pMoment,
+				float        *pVelocity,
+				float        alpha,
+				float        beta1,
+				float        beta2,
+				float        epsilon,
+				float        weightDecay,
+				float        scale,
+				unsigned int step,
+				unsigned int num)
+{
+	AdamUpdateImpl(pParam, pDelta, pMoment, pVelocity,
+				   alpha, beta1, beta2, epsilon, weightDecay, scale, step, num);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 二乗和(差分のノルム用)
+ *
+ * @param pInput  配列(num)
+ * @param num     要素数
+ *
+ * @return        二乗和(倍精度で集計)
+ */
+//----------------------------------------------------------------------
+double SquareSum(const double *pInput,
+				 unsigned int num)
+{
+	return (SquareSumImpl(pInput, num));
+}
+
+double SquareSum(const float  *pInput,
+				 unsigned int num)
+{
+	return (SquareSumImpl(pInput, num));
+}
+
+//----------------------------------------------------------------------
+/**
+ * 配列の加算(pOutput += pInput)
+ *
+ * @param pOutput  加算先(num)
+ * @param pInput   加算する値(num)
+ * @param num      要素数
+ */
+//----------------------------------------------------------------------
+void AddArray(double       *pOutput,
+			  const double *pInput,
+			  unsigned int num)
+{
+	AddArrayImpl(pOutput, pInput, num);
+}
+
+void AddArray(float        *pOutput,
+			  const float  *pInput,
+			  unsigned int num)
+{
+	AddArrayImpl(pOutput, pInput, num);
+}
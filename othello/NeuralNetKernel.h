@@ -0,0 +1,435 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#ifndef NEURAL_NET_KERNEL_H_
+#define NEURAL_NET_KERNEL_H_
+
+// 各関数は倍精度(double)と単精度(float)の両方を用意する.
+
+/*======================================================================
+ * 活性化
+ * -全結合・畳み込みの出力にまとめて適用する(層の融合)
+ * -pMask には後方出力用の微分値を書く(出力差分にかける. 推論専用なら NULL)
+ * -softMax なら活性化の後に Soft-Max をかける
+ * -accuracy が AccuracyFast なら Sigmoid・Soft-Max の exp を SIMD の近似で計算する
+ *  (相対誤差は倍精度で 2e-9, 単精度で 6e-7 程度. Soft-Max は最大値と総和を 1 回の走査で求める)
+ *  ベクトル化できないビルドでは AccuracyExact と同じ計算になる
+ *======================================================================*/
+typedef enum ActivationType
+{
+	ActivationNone,			// 恒等
+	ActivationReLU,			// x < 0 で 0
+	ActivationLeaky,		// x < 0 で x * alpha(pAlpha があれば要素ごと)
+	ActivationSigmoid,		// 1 / (1 + exp(-x))
+} ActivationType;
+
+typedef enum ActivationAccuracy
+{
+	AccuracyExact,			// 標準ライブラリの exp
+	AccuracyFast,			// 多項式近似の exp(ベクトル化)
+} ActivationAccuracy;
+
+template <typename T>
+struct Activation
+{
+	ActivationType		type;
+	T					alpha;
+	const T				*pAlpha;
+	T					*pMask;
+	bool				softMax;
+	ActivationAccuracy	accuracy;
+};
+
+void Activate(double                   *pOutput,
+			  unsigned int             num,
+			  const Activation<double> &activation);
+
+void Activate(float                    *pOutput,
+			  unsigned int             num,
+			  const Activation<float>  &activation);
+
+// 入力を別に取る(入力を複製せずに 1 回の走査で出力と微分値を書く).
+void Activate(double                   *pOutput,
+			  const double             *pInput,
+			  unsigned int             num,
+			  const Activation<double> &activation);
+
+void Activate(float                    *pOutput,
+			  const float              *pInput,
+			  unsigned int             num,
+			  const Activation<float>  &activation);
+
+// Soft-Max 層用(pInput == pOutput でもよい).
+void SoftMax(double             *pOutput,
+			 const double       *pInput,
+			 unsigned int       num,
+			 ActivationAccuracy accuracy);
+
+void SoftMax(float              *pOutput,
+			 const float        *pInput,
+			 unsigned int       num,
+			 ActivationAccuracy accuracy);
+
+void MultiplyMask(double       *pOutput,
+				  const double *pDelta,
+				  const double *pMask,
+				  unsigned int num);
+
+void MultiplyMask(float        *pOutput,
+				  const float  *pDelta,
+				  const float  *pMask,
+				  unsigned int num);
+
+// N 行まとめて活性化する(pMask も行ごとにずらす).
+void ActivateBatch(double                   *pOutput,
+				   unsigned int             num,
+				   unsigned int             batchNum,
+				   const Activation<double> &activation);
+
+void ActivateBatch(float                    *pOutput,
+				   unsigned int             num,
+				   unsigned int             batchNum,
+				   const Activation<float>  &activation);
+
+void ActivateBatch(double                   *pOutput,
+				   const double             *pInput,
+				   unsigned int             num,
+				   unsigned int             batchNum,
+				   const Activation<double> &activation);
+
+void ActivateBatch(float                    *pOutput,
+				   const float              *pInput,
+				   unsigned int             num,
+				   unsigned int             batchNum,
+				   const Activation<float>  &activation);
+
+/*======================================================================
+ * Affine変換
+ * -重みは入力順(i*outputNum+o)に並んでいること
+ * -pActivation があれば出力ブロックごとに活性化まで済ませる(なければ NULL)
+ *======================================================================*/
+void AffineForward(double                   *pOutput,
+				   const double             *pInput,
+				   const double             *pWeight,
+				   const double             *pBias,
+				   unsigned int             inputNum,
+				   unsigned int             outputNum,
+				   const Activation<double> *pActivation);
+
+void AffineForward(float                    *pOutput,
+				   const float              *pInput,
+				   const float              *pWeight,
+				   const float              *pBias,
+				   unsigned int             inputNum,
+				   unsigned int             outputNum,
+				   const Activation<float>  *pActivation);
+
+void AffineBackward(double       *pOutput,
+					double       *pDeltaWeight,
+					double       *pDeltaBias,
+					const double *pDelta,
+					const double *pInput,
+					const double *pWeight,
+					unsigned int inputNum,
+					unsigned int outputNum);
+
+void AffineBackward(float        *pOutput,
+					float        *pDeltaWeight,
+					float        *pDeltaBias,
+					const float  *pDelta,
+					const float  *pInput,
+					const float  *pWeight,
+					unsigned int inputNum,
+					unsigned int outputNum);
+
+/*======================================================================
+ * Affine変換(N 行)
+ * -入力・出力・差分は 1 件を 1 行とする行列(batchNum 行)
+ * -重みを N 件で使い回す行列積で計算する
+ *======================================================================*/
+void AffineForwardBatch(double                   *pOutput,
+						const double             *pInput,
+						const double             *pWeight,
+						const double             *pBias,
+						unsigned int             inputNum,
+						unsigned int             outputNum,
+						unsigned int             batchNum,
+						const Activation<double> *pActivation);
+
+void AffineForwardBatch(float                    *pOutput,
+						const float              *pInput,
+						const float              *pWeight,
+						const float              *pBias,
+						unsigned int             inputNum,
+						unsigned int             outputNum,
+						unsigned int             batchNum,
+						const Activation<float>  *pActivation);
+
+void AffineBackwardBatch(double       *pOutput,
+						 double       *pDeltaWeight,
+						 double       *pDeltaBias,
+						 const double *pDelta,
+						 const double *pInput,
+						 const double *pWeight,
+						 unsigned int inputNum,
+						 unsigned int outputNum,
+						 unsigned int batchNum);
+
+void AffineBackwardBatch(float        *pOutput,
+						 float        *pDeltaWeight,
+						 float        *pDeltaBias,
+						 const float  *pDelta,
+						 const float  *pInput,
+						 const float  *pWeight,
+						 unsigned int inputNum,
+						 unsigned int outputNum,
+						 unsigned int batchNum);
+
+/*======================================================================
+ * Affine変換(0/1 疎入力)
+ * -入力は値が 1 の要素の番号の配列で渡す
+ * -差分更新は変化した入力の重み行を出力に足し引きする(局面の差分評価用)
+ * -後方出力は重み差分・バイアス差分だけを求める(入力差分なし)
+ *======================================================================*/
+void AffineForwardSparse(double                   *pOutput,
+						 const unsigned int       *pActive,
+						 unsigned int             activeNum,
+						 const double             *pWeight,
+						 const double             *pBias,
+						 unsigned int             outputNum,
+						 const Activation<double> *pActivation);
+
+void AffineForwardSparse(float                    *pOutput,
+						 const unsigned int       *pActive,
+						 unsigned int             activeNum,
+						 const float              *pWeight,
+						 const float              *pBias,
+						 unsigned int             outputNum,
+						 const Activation<float>  *pActivation);
+
+void AffineUpdateSparse(double             *pOutput,
+						const unsigned int *pAdd,
+						unsigned int       addNum,
+						const unsigned int *pRemove,
+						unsigned int       removeNum,
+						const double       *pWeight,
+						unsigned int       outputNum);
+
+void AffineUpdateSparse(float              *pOutput,
+						const unsigned int *pAdd,
+						unsigned int       addNum,
+						const unsigned int *pRemove,
+						unsigned int       removeNum,
+						const float        *pWeight,
+						unsigned int       outputNum);
+
+void AffineBackwardSparse(double             *pDeltaWeight,
+						  double             *pDeltaBias,
+						  const double       *pDelta,
+						  const unsigned int *pActive,
+						  unsigned int       activeNum,
+						  unsigned int       outputNum);
+
+void AffineBackwardSparse(float              *pDeltaWeight,
+						  float              *pDeltaBias,
+						  const float        *pDelta,
+						  const unsigned int *pActive,
+						  unsigned int       activeNum,
+						  unsigned int       outputNum);
+
+/*======================================================================
+ * 行列積
+ * -C(m x n) += op(A)(m x k) * op(B)(k x n) (行優先)
+ * -transA 時 A は k x m, transB 時 B は n x k で格納されていること
+ *======================================================================*/
+void MatrixMultiply(double       *pC,
+					const double *pA,
+					const double *pB,
+					unsigned int m,
+					unsigned int n,
+					unsigned int k,
+					bool         transA,
+					bool         transB);
+
+void MatrixMultiply(float        *pC,
+					const float  *pA,
+					const float  *pB,
+					unsigned int m,
+					unsigned int n,
+					unsigned int k,
+					bool         transA,
+					bool         transB);
+
+/*======================================================================
+ * 畳み込み展開
+ * -入力(c*H*W + w*H + h)をパッチ行列((c*F+i)*F+j, w*HMax+h)に展開する
+ *======================================================================*/
+void Im2Col(double       *pColumn,
+			const double *pInput,
+			unsigned int width,
+			unsigned int height,
+			unsigned int channel,
+			unsigned int filterSize,
+			unsigned int stride,
+			unsigned int padding);
+
+void Im2Col(float        *pColumn,
+			const float  *pInput,
+			unsigned int width,
+			unsigned int height,
+			unsigned int channel,
+			unsigned int filterSize,
+			unsigned int stride,
+			unsigned int padding);
+
+void Col2Im(double       *pInput,
+			const double *pColumn,
+			unsigned int width,
+			unsigned int height,
+			unsigned int channel,
+			unsigned int filterSize,
+			unsigned int stride,
+			unsigned int padding);
+
+void Col2Im(float        *pInput,
+			const float  *pColumn,
+			unsigned int width,
+			unsigned int height,
+			unsigned int channel,
+			unsigned int filterSize,
+			unsigned int stride,
+			unsigned int padding);
+
+/*======================================================================
+ * Winograd F(2x2,3x3) 畳み込み
+ * -3x3, ストライド1 専用. 前方出力と入力差分(回転フィルタ)に使う
+ *======================================================================*/
+void WinogradFilterTransform(double       *pTransformed,
+							 const double *pFilter,
+							 unsigned int filterNum,
+							 unsigned int channel,
+							 bool         backward);
+
+void WinogradFilterTransform(float        *pTransformed,
+							 const float  *pFilter,
+							 unsigned int filterNum,
+							 unsigned int channel,
+							 bool         backward);
+
+void WinogradConvolution(double       *pOutput,
+						 const double *pInput,
+						 const double *pTransformed,
+						 unsigned int width,
+						 unsigned int height,
+						 unsigned int channel,
+						 unsigned int outWidth,
+						 unsigned int outHeight,
+						 unsigned int outChannel,
+						 int          padding);
+
+void WinogradConvolution(float        *pOutput,
+						 const float  *pInput,
+						 const float  *pTransformed,
+						 unsigned int width,
+						 unsigned int height,
+						 unsigned int channel,
+						 unsigned int outWidth,
+						 unsigned int outHeight,
+						 unsigned int outChannel,
+						 int          padding);
+
+/*======================================================================
+ * int8 量子化・行列積(量子化推論用)
+ * -Quantize は inverse 倍して ±QUANTIZED_MAX に飽和・丸めする
+ * -C(m x n) = A(m x k) * B(n x k)^T を int32 で累積する(上書き)
+ * -A, B とも内積方向が連続し, k は QUANTIZED_ALIGN の倍数であること
+ *======================================================================*/
+const int			QUANTIZED_MAX	= 127;
+const unsigned int	QUANTIZED_ALIGN	= 16;
+
+void Quantize(signed char  *pOutput,
+			  const double *pInput,
+			  double       inverse,
+			  unsigned int num);
+
+void Quantize(signed char  *pOutput,
+			  const float  *pInput,
+			  float        inverse,
+			  unsigned int num);
+
+void QuantizedMultiply(int               *pC,
+					   const signed char *pA,
+					   const signed char *pB,
+					   unsigned int      m,
+					   unsigned int      n,
+					   unsigned int      k);
+
+/*======================================================================
+ * 学習する値の更新(全層の値を並べた平坦な配列をまとめて処理する)
+ * -差分は更新後に 0 にする
+ * -1 回の走査でモーメント・速度・値をまとめて更新する(SIMD)
+ * -重み減衰は勾配と切り離して値に直接かける(SGD・AdamW)
+ * -scale は差分にかける倍率(ノルムの切り詰めを更新と同じ走査で行う)
+ * -SquareSum は差分のノルム, AddArray は差分の集計(pOutput += pInput)に使う
+ *======================================================================*/
+void SgdUpdate(double       *pParam,
+			   double       *pDelta,
+			   double       *pMoment,
+			   double       ratio,
+			   double       momentum,
+			   double       weightDecay,
+			   double       scale,
+			   unsigned int num);
+
+void SgdUpdate(float        *pParam,
+			   float        *pDelta,
+			   float        *pMoment,
+			   float        ratio,
+			   float        momentum,
+			   float        weightDecay,
+			   float        scale,
+			   unsigned int num);
+
+void AdamUpdate(double       *pParam,
+				double       *pDelta,
+				double       *pMoment,
+				double       *pVelocity,
+				double       alpha,
+				double       beta1,
+				double       beta2,
+				double       epsilon,
+				double       weightDecay,
+				double       scale,
+				unsigned int step,
+				unsigned int num);
+
+void AdamUpdate(float        *pParam,
+				float        *pDelta,
+				float        *pMoment,
+				float        *pVelocity,
+				float        alpha,
+				float        beta1,
+				float        beta2,
+				float        epsilon,
+				float        weightDecay,
+				float        scale,
+				unsigned int step,
+				unsigned int num);
+
+double SquareSum(const double *pInput,
+				 unsigned int num);
+
+double SquareSum(const float  *pInput,
+				 unsigned int num);
+
+void AddArray(double       *pOutput,
+			  const double *pInput,
+			  unsigned int num);
+
+void AddArray(float        *pOutput,
+			  const float  *pInput,
+			  unsigned int num);
+
+#endif /* NEURAL_NET_KERNEL_H_ */
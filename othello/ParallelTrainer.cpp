@@ -0,0 +1,437 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#include <algorithm>
+
+#include "ParallelTrainer.h"
+#include "NeuralNetKernel.h"
+
+// 集計の分担区間の境界(64 バイト単位にしてキャッシュラインを共有しない).
+static const unsigned int	REDUCE_ALIGN	= 64 / sizeof(NeuralNet::Real);
+
+//----------------------------------------------------------------------
+/**
+ * コンストラクタ
+ */
+//----------------------------------------------------------------------
+ParallelTrainer::ParallelTrainer() :
+	m_pNet(NULL),
+	m_pInput(NULL),
+	m_pTeacher(NULL),
+	m_pSampleLoss(NULL),
+	m_Async(false),
+	m_Num(0),
+	m_BatchSize(0),
+	m_Optimizer(OptimizerAdam),
+	m_LearnRatio(0.0),
+	m_LearnStep(0),
+	m_Next(0),
+	m_Generation(0),
+	m_Running(0),
+	m_Arrived(0),
+	m_Phase(0),
+	m_Quit(false)
+{
+}
+
+//----------------------------------------------------------------------
+/**
+ * デストラクタ
+ */
+//----------------------------------------------------------------------
+ParallelTrainer::~ParallelTrainer()
+{
+	Clear();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 準備
+ * -元のネットをスレッド数だけ複製してスレッドを起動する
+ *  複製は元のネットの値と Adam のモーメント・速度を共有し, 差分だけを持つ
+ *  ネットの構成を変えたら(層の追加・読み込み・SetMode)再度呼ぶこと
+ *
+ * @param  net        学習するネット(学習用)
+ * @param  threadNum  スレッド数
+ *
+ * @return            成否
+ */
+//----------------------------------------------------------------------
+bool ParallelTrainer::Setup(NeuralNet &net, unsigned int threadNum)
+{
+	Clear();
+
+	if ((threadNum == 0)
+	||  (net.GetParamNum() == 0)
+	||  (net.GetMode() != NeuralNet::Mode::TrainingMode))
+		return (false);
+
+	for (unsigned int i = 0; i < threadNum; ++i)
+	{
+		std::unique_ptr<Worker>	pWorker(new Worker);
+
+		pWorker->net.Clone(net, NeuralNet::Mode::TrainingMode);
+		pWorker->net.Compile();
+		pWorker->net.ShareParam(net, true);
+		pWorker->loss	= 0.0;
+
+		m_Worker.push_back(std::move(pWorker));
+	}
+
+	m_pNet	= &net;
+
+	for (unsigned int i = 0; i < threadNum; ++i)
+		m_Worker[i]->thread	= std::thread(&ParallelTrainer::Run, this, i, m_Generation);
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後始末
+ * -スレッドを終了して複製を捨てる
+ */
+//----------------------------------------------------------------------
+void ParallelTrainer::Clear(void)
+{
+	{
+		std::lock_guard<std::mutex>	lock(m_Mutex);
+
+		m_Quit	= true;
+	}
+	m_Start.notify_all();
+
+	for (unsigned int i = 0; i < m_Worker.size(); ++i)
+	{
+		if (m_Worker[i]->thread.joinable())
+			m_Worker[i]->thread.join();
+	}
+
+	m_Worker.clear();
+	m_pNet	= NULL;
+	m_Quit	= false;
+}
+
+//----------------------------------------------------------------------
+/**
+ * ミニバッチの学習
+ * -前方・後方出力してミニバッチ全体の差分を元のネットの差分に加える
+ *  値の更新(Learn・LearnAdam)は呼出側で元のネットに対して行う
+ *
+ * @param  input        1 件ごとの入力値の配列
+ * @param  teacher      1 件ごとの教師信号の配列
+ * @param  pSampleLoss  1 件ごとの誤差の受取配列(不要なら NULL)
+ *
+ * @return              クロスエントロピー誤差の総和
+ */
+//----------------------------------------------------------------------
+double ParallelTrainer::Train(const std::vector<std::vector<double>> &input,
+							  const std::vector<std::vector<double>> &teacher,
+							  std::vector<double>                    *pSampleLoss)
+{
+	if ((m_pNet == NULL) || (input.size() != teacher.size()))
+		return (0.0);
+
+	if (pSampleLoss != NULL)
+		pSampleLoss->assign(input.size(), 0.0);
+
+	{
+		std::unique_lock<std::mutex>	lock(m_Mutex);
+
+		m_pInput		= &input;
+		m_pTeacher		= &teacher;
+		m_pSampleLoss	= (pSampleLoss != NULL) ? pSampleLoss->data() : NULL;
+		m_Async			= false;
+		m_Running	= m_Worker.size();
+		++m_Generation;
+
+		m_Start.notify_all();
+		m_Finish.wait(lock, [this]{return (m_Running == 0);});
+
+		m_pInput		= NULL;
+		m_pTeacher		= NULL;
+		m_pSampleLoss	= NULL;
+	}
+
+	// 誤差もスレッド番号の順に足す.
+	double	loss	= 0.0;
+
+	for (unsigned int i = 0; i < m_Worker.size(); ++i)
+		loss	+= m_Worker[i]->loss;
+
+	return (loss);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 非同期学習
+ * -各スレッドが先頭から batchSize 件ずつ取り出して前方・後方出力し,
+ *  そのまま共有の値を更新する(ロックしない. 他のスレッドの更新と競合してもよい)
+ * -元のネットの差分は使わない. Adam のモーメント・速度は元のネットのものを
+ *  全スレッドで共有して更新し, 終了時に全スレッドの更新回数を元のネットに足す
+ *
+ * @param  input       1 件ごとの入力値の配列
+ * @param  teacher     1 件ごとの教師信号の配列
+ * @param  num         使う件数(先頭から)
+ * @param  batchSize   一度に取り出す件数
+ * @param  optimizer   値の更新方法
+ * @param  learnRatio   学習率(Adam ならアルファ)
+ * @param  pSampleLoss  1 件ごとの誤差の受取配列(不要なら NULL)
+ *
+ * @return              クロスエントロピー誤差の総和(各件を計算した時点の値)
+ */
+//----------------------------------------------------------------------
+double ParallelTrainer::TrainAsync(const std::vector<std::vector<double>> &input,
+								   const std::vector<std::vector<double>> &teacher,
+								   unsigned int                           num,
+								   unsigned int                           batchSize,
+								   Optimizer                              optimizer,
+								   double                                 learnRatio,
+								   std::vector<double>                    *pSampleLoss)
+{
+	if ((m_pNet == NULL)
+	||  (batchSize == 0)
+	||  (num > input.size())
+	||  (num > teacher.size()))
+		return (0.0);
+
+	if (pSampleLoss != NULL)
+		pSampleLoss->assign(num, 0.0);
+
+	{
+		std::unique_lock<std::mutex>	lock(m_Mutex);
+
+		m_pInput		= &input;
+		m_pTeacher		= &teacher;
+		m_pSampleLoss	= (pSampleLoss != NULL) ? pSampleLoss->data() : NULL;
+		m_Async			= true;
+		m_LearnStep		= m_pNet->GetLearnStep();
+		m_Num			= num;
+		m_BatchSize		= batchSize;
+		m_Optimizer		= optimizer;
+		m_LearnRatio	= learnRatio;
+		m_Next			= 0;
+		m_Running		= m_Worker.size();
+		++m_Generation;
+
+		m_Start.notify_all();
+		m_Finish.wait(lock, [this]{return (m_Running == 0);});
+
+		m_pInput		= NULL;
+		m_pTeacher		= NULL;
+		m_pSampleLoss	= NULL;
+	}
+
+	// 値を直接書き換えたので元のネットの変換後フィルタを作り直させる.
+	m_pNet->ParamChanged();
+
+	double			loss		= 0.0;
+	unsigned int	learnStep	= m_LearnStep;
+
+	for (unsigned int i = 0; i < m_Worker.size(); ++i)
+	{
+		loss		+= m_Worker[i]->loss;
+		learnStep	+= m_Worker[i]->net.GetLearnStep() - m_LearnStep;
+	}
+
+	// 共有したモーメント・速度と合わせて保存・再開できるように.
+	m_pNet->SetLearnStep(learnStep);
+
+	return (loss);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 作業スレッドの本体
+ *
+ * @param  index       スレッド番号
+ * @param  generation  起動時のミニバッチの通番
+ */
+//----------------------------------------------------------------------
+void ParallelTrainer::Run(unsigned int index, unsigned int generation)
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex>	lock(m_Mutex);
+
+			m_Start.wait(lock, [&]{return (m_Quit || (m_Generation != generation));});
+
+			if (m_Quit)
+				return;
+
+			generation	= m_Generation;
+		}
+
+		if (m_Async)
+		{
+			StepAsync(index);
+		}
+		else
+		{
+			Step(index);
+			WaitBarrier();
+			Reduce(index);
+		}
+
+		{
+			std::lock_guard<std::mutex>	lock(m_Mutex);
+
+			if (--m_Running == 0)
+				m_Finish.notify_one();
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 担当区間の前方・後方出力
+ * -区間はミニバッチを件数で均等に分けた連続した範囲(スレッド番号の順)
+ *
+ * @param  index  スレッド番号
+ */
+//----------------------------------------------------------------------
+void ParallelTrainer::Step(unsigned int index)
+{
+	Worker				&worker	= *m_Worker[index];
+	const unsigned int	num		= m_pInput->size();
+	const unsigned int	begin	= (unsigned int)((unsigned long long)num * index       / m_Worker.size());
+	const unsigned int	end		= (unsigned int)((unsigned long long)num * (index + 1) / m_Worker.size());
+
+	worker.loss	= 0.0;
+	worker.net.CopyParam(*m_pNet);
+
+	worker.input.assign(  m_pInput->begin()   + begin, m_pInput->begin()   + end);
+	worker.teacher.assign(m_pTeacher->begin() + begin, m_pTeacher->begin() + end);
+
+	if (begin == end)
+		return;
+
+	worker.net.SetInputBatch(worker.input);
+	worker.net.ForwardBatch();
+
+	worker.loss	= worker.net.CalcCrossEntropyLossBatch(
+					worker.teacher,
+					(m_pSampleLoss != NULL) ? m_pSampleLoss + begin : NULL);
+
+	worker.net.BackwardBatch();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 非同期学習の 1 スレッド分
+ * -取り出す件がなくなるまで, 前方・後方出力と共有の値の更新を繰り返す
+ *
+ * @param  index  スレッド番号
+ */
+//----------------------------------------------------------------------
+void ParallelTrainer::StepAsync(unsigned int index)
+{
+	Worker	&worker	= *m_Worker[index];
+
+	worker.loss	= 0.0;
+
+	// 値は共有しているので RReLU のアルファだけが複写される.
+	worker.net.CopyParam(*m_pNet);
+	worker.net.SetDeltaNormLimit(m_pNet->GetDeltaNormMode(), m_pNet->GetDeltaNormLimit());
+	// バイアス補正は元のネットの更新回数に自分の更新回数を足した値で行う.
+	worker.net.SetLearnStep(m_LearnStep);
+
+	for (;;)
+	{
+		const unsigned int	begin	= m_Next.fetch_add(m_BatchSize);
+
+		if (begin >= m_Num)
+			break;
+
+		const unsigned int	end	= std::min(begin + m_BatchSize, m_Num);
+
+		worker.input.assign(  m_pInput->begin()   + begin, m_pInput->begin()   + end);
+		worker.teacher.assign(m_pTeacher->begin() + begin, m_pTeacher->begin() + end);
+
+		worker.net.SetInputBatch(worker.input);
+		worker.net.ForwardBatch();
+
+		worker.loss	+= worker.net.CalcCrossEntropyLossBatch(
+						worker.teacher,
+						(m_pSampleLoss != NULL) ? m_pSampleLoss + begin : NULL);
+
+		worker.net.BackwardBatch();
+
+		// 差分は自分の領域にあり, 更新後に 0 に戻る.
+		if (m_Optimizer == OptimizerAdam)
+			worker.net.LearnAdam(m_LearnRatio);
+		else
+			worker.net.Learn(m_LearnRatio);
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 担当区間の差分の集計
+ * -値の領域をスレッド数で分け, 区間ごとに複製の差分を二分木の順
+ *  ((0+1)+(2+3))+... に足して元のネットの差分に加える
+ *  足し終えた複製の差分は次のミニバッチのために 0 に戻す
+ *
+ * @param  index  スレッド番号
+ */
+//----------------------------------------------------------------------
+void ParallelTrainer::Reduce(unsigned int index)
+{
+	const unsigned int	paramNum	= m_pNet->GetParamNum();
+	const unsigned int	workerNum	= m_Worker.size();
+	unsigned int		begin		= (unsigned int)((unsigned long long)paramNum * index       / workerNum);
+	unsigned int		end			= (unsigned int)((unsigned long long)paramNum * (index + 1) / workerNum);
+
+	begin	= begin / REDUCE_ALIGN * REDUCE_ALIGN;
+	if (index + 1 < workerNum)
+		end	= end / REDUCE_ALIGN * REDUCE_ALIGN;
+
+	if (begin >= end)
+		return;
+
+	for (unsigned int stride = 1; stride < workerNum; stride *= 2)
+	{
+		for (unsigned int i = 0; i + stride < workerNum; i += stride * 2)
+		{
+			AddArray(m_Worker[i         ]->net.GetDeltaParam() + begin,
+					 m_Worker[i + stride]->net.GetDeltaParam() + begin,
+					 end - begin);
+		}
+	}
+
+	AddArray(m_pNet->GetDeltaParam() + begin,
+			 m_Worker[0]->net.GetDeltaParam() + begin,
+			 end - begin);
+
+	for (unsigned int i = 0; i < workerNum; ++i)
+	{
+		Real	*pDelta	= m_Worker[i]->net.GetDeltaParam();
+
+		std::fill(pDelta + begin, pDelta + end, (Real)0);
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 全スレッドが後方出力を終えるまで待つ
+ */
+//----------------------------------------------------------------------
+void ParallelTrainer::WaitBarrier(void)
+{
+	std::unique_lock<std::mutex>	lock(m_Mutex);
+	const unsigned int				phase	= m_Phase;
+
+	if (++m_Arrived == m_Worker.size())
+	{
+		m_Arrived	= 0;
+		++m_Phase;
+		m_Barrier.notify_all();
+	}
+	else
+	{
+		m_Barrier.wait(lock, [&]{return (m_Phase != phase);});
+	}
+}
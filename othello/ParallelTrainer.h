@@ -0,0 +1,105 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#ifndef PARALLEL_TRAINER_H_
+#define PARALLEL_TRAINER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NeuralNet.h"
+
+//----------------------------------------------------------------------
+/// データ並列学習
+// -ミニバッチを連続した区間に分けてスレッドごとの複製ネットで前方・後方出力し,
+//  差分を元のネットの差分に加える(学習率の適用は元のネットの Learn 系で行う)
+// -差分の集計は値の領域をスレッドで分担し, 各区間で複製の差分を
+//  固定の二分木の順に足す. スレッド数が同じなら実行順によらず結果は同じ
+// -非同期学習(TrainAsync)では各スレッドが少数件ずつ取り出して,
+//  ロックせずに共有の値を直接更新する(Hogwild. 書込みの競合は許す)
+// -複製は元のネットの値と Adam のモーメント・速度を共有する(ShareParam)
+//  非同期学習の更新回数は終了時に元のネットに足すので, 元のネットの学習状態を保存すれば再開できる
+class ParallelTrainer
+{
+  public:
+	// 非同期学習の値の更新方法.
+	typedef enum Optimizer
+	{
+		OptimizerSgd,			// Learn
+		OptimizerAdam,			// LearnAdam(モーメント・速度は元のネットのものを共有)
+	} Optimizer;
+
+  private:
+	typedef NeuralNet::Real	Real;
+
+	//----------------------------------------------------------------------
+	/// 作業スレッド
+	struct Worker
+	{
+		NeuralNet							net;		// 元のネットの複製(差分の受取先)
+		std::vector<std::vector<double>>	input;		// 担当区間の入力値
+		std::vector<std::vector<double>>	teacher;	// 担当区間の教師信号
+		double								loss;		// 担当区間の誤差の総和
+		std::thread							thread;
+	};
+
+	NeuralNet								*m_pNet;
+	std::vector<std::unique_ptr<Worker>>	m_Worker;
+
+	// 実行中のミニバッチ.
+	const std::vector<std::vector<double>>	*m_pInput;
+	const std::vector<std::vector<double>>	*m_pTeacher;
+	double									*m_pSampleLoss;	// 1 件ごとの誤差の受取先(不要なら NULL)
+	bool									m_Async;		// 非同期学習か
+	unsigned int							m_Num;			// 非同期学習で使う件数
+	unsigned int							m_BatchSize;	// 非同期学習で一度に取り出す件数
+	Optimizer								m_Optimizer;
+	double									m_LearnRatio;
+	unsigned int							m_LearnStep;	// 非同期学習の開始時の元のネットの更新回数
+	std::atomic<unsigned int>				m_Next;			// 次に取り出す件
+
+	std::mutex								m_Mutex;
+	std::condition_variable					m_Start;		// ミニバッチの開始・終了指示
+	std::condition_variable					m_Finish;		// 全スレッドの完了
+	std::condition_variable					m_Barrier;		// 後方出力と集計の区切り
+	unsigned int							m_Generation;	// 開始したミニバッチの通番
+	unsigned int							m_Running;		// 完了していないスレッド数
+	unsigned int							m_Arrived;		// 区切りに着いたスレッド数
+	unsigned int							m_Phase;		// 区切りの通番
+	bool									m_Quit;
+
+	void Run(unsigned int index, unsigned int generation);
+	void Step(unsigned int index);
+	void StepAsync(unsigned int index);
+	void Reduce(unsigned int index);
+	void WaitBarrier(void);
+
+  public:
+	ParallelTrainer();
+	~ParallelTrainer();
+
+	bool   Setup(NeuralNet &net, unsigned int threadNum);
+	void   Clear(void);
+
+	// pSampleLoss には 1 件ごとの誤差を返す(優先度付きの抽出用).
+	double Train(const std::vector<std::vector<double>> &input,
+				 const std::vector<std::vector<double>> &teacher,
+				 std::vector<double>                    *pSampleLoss = NULL);
+	double TrainAsync(const std::vector<std::vector<double>> &input,
+					  const std::vector<std::vector<double>> &teacher,
+					  unsigned int                           num,
+					  unsigned int                           batchSize,
+					  Optimizer                              optimizer,
+					  double                                 learnRatio,
+					  std::vector<double>                    *pSampleLoss = NULL);
+
+	unsigned int GetThreadNum(void) const {return (m_Worker.size());}
+};
+
+#endif /* PARALLEL_TRAINER_H_ */
@@ -0,0 +1,549 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#include <algorithm>
+
+#include "QuantizedNet.h"
+#include "NeuralNetKernel.h"
+
+//----------------------------------------------------------------------
+/**
+ * int8 への変換(四捨五入 + 飽和)
+ *
+ * @param  value  量子化スケールで割った値
+ *
+ * @return        int8 値
+ */
+//----------------------------------------------------------------------
+static signed char QuantizeValue(double value)
+{
+	int	q	= (value >= 0.0) ? (int)(value + 0.5) : (int)(value - 0.5);
+
+	if (q >  QUANTIZED_MAX)
+		q	=  QUANTIZED_MAX;
+	if (q < -QUANTIZED_MAX)
+		q	= -QUANTIZED_MAX;
+
+	return ((signed char)q);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 要素数を QUANTIZED_ALIGN の倍数に切り上げる
+ *
+ * @param  num  要素数
+ *
+ * @return      整列後の要素数
+ */
+//----------------------------------------------------------------------
+static unsigned int QuantizedAlign(unsigned int num)
+{
+	return ((num + QUANTIZED_ALIGN - 1) / QUANTIZED_ALIGN * QUANTIZED_ALIGN);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 作業領域の要素数
+ * -先頭に int32 の累積, その後ろに int8 の値を置く
+ *
+ * @param  accumulatorNum  累積の要素数
+ * @param  byteNum         int8 の要素数
+ *
+ * @return                 作業領域の要素数(実数)
+ */
+//----------------------------------------------------------------------
+unsigned int QuantizedNet::QuantizedLayer::CalcWorkNum(unsigned int accumulatorNum,
+													   unsigned int byteNum)
+{
+	const unsigned int	size	= accumulatorNum * sizeof(int) + byteNum;
+
+	return ((size + sizeof(Real) - 1) / sizeof(Real));
+}
+
+//----------------------------------------------------------------------
+/**
+ * 入力の量子化
+ *
+ * @param  pQuantized  int8 の受取配列(入力数)
+ * @param  pInput      入力値配列
+ */
+//----------------------------------------------------------------------
+void QuantizedNet::QuantizedLayer::QuantizeInput(signed char *pQuantized,
+												 const Real  *pInput) const
+{
+	Quantize(pQuantized, pInput, 1 / m_InputScale, m_InputNum);
+}
+
+//----------------------------------------------------------------------
+/**
+ * コンストラクタ
+ * -重みは出力ごとに最大絶対値を 127 に合わせて量子化する
+ *
+ * @param layer       量子化する全結合層
+ * @param inputScale  入力の量子化スケール
+ */
+//----------------------------------------------------------------------
+QuantizedNet::AffineLayer::AffineLayer(const NeuralNet::AffineLayer &layer,
+									   Real                         inputScale) :
+QuantizedLayer(layer.GetInputNum(),
+			   layer.GetOutputNum(),
+			   layer.GetType(),
+			   inputScale)
+{
+	m_Stride	= QuantizedAlign(m_InputNum);
+
+	m_Work.resize(GetWorkNum());
+
+	m_Weight.assign(m_OutputNum * m_Stride, 0);
+	m_Scale.resize(m_OutputNum);
+	m_Bias.resize( m_OutputNum);
+
+	for (unsigned int o = 0; o < m_OutputNum; ++o)
+	{
+		double	maxValue	= 0.0;
+
+		for (unsigned int i = 0; i < m_InputNum; ++i)
+			maxValue	= std::max(maxValue, fabs((double)layer.GetWeight(i, o)));
+
+		const double	scale	= (maxValue > 0.0) ? maxValue / QUANTIZED_MAX : 1.0;
+
+		for (unsigned int i = 0; i < m_InputNum; ++i)
+			m_Weight[o*m_Stride+i]	= QuantizeValue(layer.GetWeight(i, o) / scale);
+
+		m_Scale[o]	= (Real)(scale * m_InputScale);
+		m_Bias[o]	= layer.GetBias(o);
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後方出力
+ * -量子化を恒等とみなし, 逆量子化した重みで入力側の差分を求める
+ *
+ * @param  pDelta  出力側の差分
+ * @param  pOutput 入力側の差分受取配列
+ */
+//----------------------------------------------------------------------
+void QuantizedNet::AffineLayer::Backward(const Real *pDelta,
+										 Real       *pOutput)
+{
+	for (unsigned int i = 0; i < m_InputNum; ++i)
+		pOutput[i]	= 0;
+
+	for (unsigned int o = 0; o < m_OutputNum; ++o)
+	{
+		const signed char	*pWeight	= &m_Weight[o*m_Stride];
+		const Real			delta		= pDelta[o] * m_Scale[o] / m_InputScale;
+
+		for (unsigned int i = 0; i < m_InputNum; ++i)
+			pOutput[i]	+= delta * pWeight[i];
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 推論用の前方出力
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pWork   作業領域(GetWorkNum() 要素)
+ */
+//----------------------------------------------------------------------
+void QuantizedNet::AffineLayer::Evaluate(const Real *pInput,
+										 Real       *pOutput,
+										 Real       *pWork) const
+{
+	int			*pAccumulator	= (int *)pWork;
+	signed char	*pQuantized		= (signed char *)(pAccumulator + m_OutputNum);
+
+	// 入力数より後ろ(整列用)は 0.
+	QuantizeInput(pQuantized, pInput);
+	for (unsigned int i = m_InputNum; i < m_Stride; ++i)
+		pQuantized[i]	= 0;
+
+	// 入力(1 x 入力数) * 重み^T として出力方向に 4 本ずつ求める.
+	QuantizedMultiply(pAccumulator,
+					  pQuantized,
+					  &m_Weight[0],
+					  1,
+					  m_OutputNum,
+					  m_Stride);
+
+	for (unsigned int o = 0; o < m_OutputNum; ++o)
+		pOutput[o]	= pAccumulator[o] * m_Scale[o] + m_Bias[o];
+}
+
+//----------------------------------------------------------------------
+/**
+ * コンストラクタ
+ * -フィルタはフィルタごとに最大絶対値を 127 に合わせて量子化する
+ *
+ * @param layer       量子化する畳み込み層
+ * @param inputScale  入力の量子化スケール
+ */
+//----------------------------------------------------------------------
+QuantizedNet::ConvolutionLayer::ConvolutionLayer(
+	const NeuralNet::ConvolutionLayer &layer,
+	Real                              inputScale) :
+QuantizedLayer(layer.GetInputNum(),
+			   layer.GetOutputNum(),
+			   layer.GetType(),
+			   inputScale),
+m_Width(     layer.GetWidth()),
+m_Height(    layer.GetHeight()),
+m_Channel(   layer.GetChannel()),
+m_FilterSize(layer.GetFilterSize()),
+m_FilterNum( layer.GetFilterNum()),
+m_Stride(    layer.GetStride()),
+m_Padding(   layer.GetPadding())
+{
+	const unsigned int	k	= m_Channel*m_FilterSize*m_FilterSize;
+
+	m_WMax	= ( m_Width+2*m_Padding-m_FilterSize)/m_Stride + 1;
+	m_HMax	= (m_Height+2*m_Padding-m_FilterSize)/m_Stride + 1;
+	m_Row	= QuantizedAlign(k);
+
+	m_Work.resize(GetWorkNum());
+	m_PatchIndex.assign(m_WMax*m_HMax*m_Row, m_InputNum);
+
+	// パッチの各要素が参照する入力位置.
+	// 横幅.
+	for (unsigned int w = 0; w < m_WMax; ++w)
+	{
+		// 高さ
+		for (unsigned int h = 0; h < m_HMax; ++h)
+		{
+			unsigned int	*pIndex	= &m_PatchIndex[(w*m_HMax+h)*m_Row];
+
+			// チャンネル数ループ
+			for (unsigned int c = 0; c < m_Channel; ++c)
+			{
+				for (unsigned int i = 0; i < m_FilterSize; ++i)
+				{
+					int	iW	= w*m_Stride+i-m_Padding;
+
+					for (unsigned int j = 0; j < m_FilterSize; ++j)
+					{
+						int	iH	= h*m_Stride+j-m_Padding;
+
+						if ((iW >= 0) && (iW < (int)m_Width)
+						&&  (iH >= 0) && (iH < (int)m_Height))
+						{
+							*pIndex	= c*(m_Height*m_Width)+iW*m_Height+iH;
+						}
+						++pIndex;
+					}
+				}
+			}
+		}
+	}
+
+	m_Filter.assign(m_FilterNum*m_Row, 0);
+	m_Scale.resize(m_FilterNum);
+	m_Bias.resize( m_FilterNum);
+
+	for (unsigned int f = 0; f < m_FilterNum; ++f)
+	{
+		double	maxValue	= 0.0;
+		double	bias		= 0.0;
+
+		for (unsigned int c = 0; c < m_Channel; ++c)
+		{
+			for (unsigned int x = 0; x < m_FilterSize; ++x)
+			{
+				for (unsigned int y = 0; y < m_FilterSize; ++y)
+				{
+					maxValue	= std::max(maxValue,
+										   fabs((double)layer.GetFilter(x, y, f, c)));
+				}
+			}
+			bias	+= layer.GetBias(f, c);
+		}
+
+		const double	scale	= (maxValue > 0.0) ? maxValue / QUANTIZED_MAX : 1.0;
+
+		for (unsigned int c = 0; c < m_Channel; ++c)
+		{
+			for (unsigned int x = 0; x < m_FilterSize; ++x)
+			{
+				for (unsigned int y = 0; y < m_FilterSize; ++y)
+				{
+					m_Filter[f*m_Row+(c*m_FilterSize+x)*m_FilterSize+y]	=
+						QuantizeValue(layer.GetFilter(x, y, f, c) / scale);
+				}
+			}
+		}
+
+		m_Scale[f]	= (Real)(scale * m_InputScale);
+		m_Bias[f]	= (Real)bias;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後方出力
+ * -量子化を恒等とみなし, 逆量子化したフィルタの差分をパッチの参照表で入力へ戻す
+ *
+ * @param  pDelta  出力側の差分
+ * @param  pOutput 入力側の差分受取配列
+ */
+//----------------------------------------------------------------------
+void QuantizedNet::ConvolutionLayer::Backward(const Real *pDelta,
+											  Real       *pOutput)
+{
+	const unsigned int	n	= m_WMax*m_HMax;
+
+	for (unsigned int i = 0; i < m_InputNum; ++i)
+		pOutput[i]	= 0;
+
+	for (unsigned int f = 0; f < m_FilterNum; ++f)
+	{
+		const signed char	*pFilter	= &m_Filter[f*m_Row];
+		const Real			scale		= m_Scale[f] / m_InputScale;
+
+		for (unsigned int i = 0; i < n; ++i)
+		{
+			const unsigned int	*pIndex	= &m_PatchIndex[i*m_Row];
+			const Real			delta	= pDelta[f*n+i] * scale;
+
+			for (unsigned int k = 0; k < m_Row; ++k)
+			{
+				// 範囲外(パディング)は入力数.
+				if (pIndex[k] < m_InputNum)
+					pOutput[pIndex[k]]	+= delta * pFilter[k];
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 推論用の前方出力
+ * -出力位置ごとのパッチ(int8)を参照表で集め, フィルタとの内積を行列積で求める
+ *
+ * @param  pInput  入力値配列
+ * @param  pOutput 出力値受取配列
+ * @param  pWork   作業領域(GetWorkNum() 要素)
+ */
+//----------------------------------------------------------------------
+void QuantizedNet::ConvolutionLayer::Evaluate(const Real *pInput,
+											  Real       *pOutput,
+											  Real       *pWork) const
+{
+	const unsigned int	n				= m_WMax*m_HMax;
+	int					*pAccumulator	= (int *)pWork;
+	signed char			*pQuantized		= (signed char *)(pAccumulator + m_OutputNum);
+	signed char			*pPatch			= pQuantized + m_InputNum + 1;
+
+	// 末尾に範囲外(パディング)用の 0 を置く.
+	QuantizeInput(pQuantized, pInput);
+	pQuantized[m_InputNum]	= 0;
+
+	for (unsigned int i = 0; i < m_PatchIndex.size(); ++i)
+		pPatch[i]	= pQuantized[m_PatchIndex[i]];
+
+	QuantizedMultiply(pAccumulator,
+					  &m_Filter[0],
+					  pPatch,
+					  m_FilterNum,
+					  n,
+					  m_Row);
+
+	for (unsigned int f = 0; f < m_FilterNum; ++f)
+	{
+		for (unsigned int i = 0; i < n; ++i)
+			pOutput[f*n+i]	= pAccumulator[f*n+i] * m_Scale[f] + m_Bias[f];
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * コンストラクタ
+ */
+//----------------------------------------------------------------------
+QuantizedNet::QuantizedNet()
+{
+}
+
+//----------------------------------------------------------------------
+/**
+ * デストラクタ
+ */
+//----------------------------------------------------------------------
+QuantizedNet::~QuantizedNet()
+{
+}
+
+//----------------------------------------------------------------------
+/**
+ * 量子化しない層の複製
+ *
+ * @param  pLayer  複製元の層
+ *
+ * @return         複製した層(未対応の層は空)
+ */
+//----------------------------------------------------------------------
+std::shared_ptr<NeuralNet::Layer> QuantizedNet::CopyLayer(
+	const std::shared_ptr<NeuralNet::Layer> &pLayer) const
+{
+	switch (pLayer->GetType())
+	{
+	  case NeuralNet::ReLU:
+		return (std::make_shared<NeuralNet::ReLULayer>(
+					*std::dynamic_pointer_cast<NeuralNet::ReLULayer>(pLayer)));
+
+	  case NeuralNet::RReLU:
+		return (std::make_shared<NeuralNet::RReLULayer>(
+					*std::dynamic_pointer_cast<NeuralNet::RReLULayer>(pLayer)));
+
+	  case NeuralNet::LReLU:
+		return (std::make_shared<NeuralNet::LReLULayer>(
+					*std::dynamic_pointer_cast<NeuralNet::LReLULayer>(pLayer)));
+
+	  case NeuralNet::Sigmoid:
+		return (std::make_shared<NeuralNet::SigmoidLayer>(
+					*std::dynamic_pointer_cast<NeuralNet::SigmoidLayer>(pLayer)));
+
+	  case NeuralNet::SoftMax:
+		return (std::make_shared<NeuralNet::SoftMaxLayer>(
+					*std::dynamic_pointer_cast<NeuralNet::SoftMaxLayer>(pLayer)));
+
+	  case NeuralNet::MaxPooling:
+		return (std::make_shared<NeuralNet::MaxPoolingLayer>(
+					*std::dynamic_pointer_cast<NeuralNet::MaxPoolingLayer>(pLayer)));
+	}
+
+	return (std::shared_ptr<NeuralNet::Layer>());
+}
+
+//----------------------------------------------------------------------
+/**
+ * 入力の量子化スケールの計算
+ * -代表入力の最大絶対値を 127 に合わせる
+ *
+ * @param  samples  層への代表入力
+ *
+ * @return          量子化スケール
+ */
+//----------------------------------------------------------------------
+QuantizedNet::Real QuantizedNet::CalcInputScale(
+	const std::vector<std::vector<Real>> &samples)
+{
+	double	maxValue	= 0.0;
+
+	for (unsigned int s = 0; s < samples.size(); ++s)
+	{
+		for (unsigned int i = 0; i < samples[s].size(); ++i)
+			maxValue	= std::max(maxValue, fabs((double)samples[s][i]));
+	}
+
+	return ((Real)((maxValue > 0.0) ? maxValue / QUANTIZED_MAX : 1.0));
+}
+
+//----------------------------------------------------------------------
+/**
+ * 量子化ネットの構築
+ * -代表入力を先頭の層から順に流し, 各量子化層の入力スケールを求める
+ *  (手前の層の量子化誤差を含んだ値でスケールを決める)
+ *
+ * @param  net      学習済みのニューラルネット
+ * @param  samples  代表入力(教師データの盤面など. CALIBRATION_NUM 件程度まで)
+ *
+ * @return          成否
+ */
+//----------------------------------------------------------------------
+bool QuantizedNet::Build(const NeuralNet                        &net,
+						 const std::vector<std::vector<double>> &samples)
+{
+	std::vector<std::vector<Real>>	activation(samples.size());
+	std::vector<Real>				tmp;
+	unsigned int					bufferNum	= net.GetInputNum();
+
+	m_Layer.clear();
+
+	if ((net.m_Layer.size() == 0) || (samples.size() == 0))
+		return (false);
+
+	for (unsigned int s = 0; s < samples.size(); ++s)
+	{
+		if (samples[s].size() != net.GetInputNum())
+			return (false);
+
+		activation[s].assign(samples[s].begin(), samples[s].end());
+	}
+
+	for (unsigned int i = 0; i < net.m_Layer.size(); ++i)
+	{
+		std::shared_ptr<NeuralNet::Layer>	pLayer;
+
+		switch (net.m_Layer[i]->GetType())
+		{
+		  case NeuralNet::Affine:
+			pLayer	= std::make_shared<AffineLayer>(
+						*std::dynamic_pointer_cast<NeuralNet::AffineLayer>(net.m_Layer[i]),
+						CalcInputScale(activation));
+			break;
+
+		  case NeuralNet::Convolution:
+			pLayer	= std::make_shared<ConvolutionLayer>(
+						*std::dynamic_pointer_cast<NeuralNet::ConvolutionLayer>(net.m_Layer[i]),
+						CalcInputScale(activation));
+			break;
+
+		  default:
+			pLayer	= CopyLayer(net.m_Layer[i]);
+			break;
+		}
+
+		if (!pLayer)
+		{
+			m_Layer.clear();
+			return (false);
+		}
+
+		// 複製した層も後方出力用の値は持たない.
+		pLayer->SetMode(NeuralNet::Mode::InferenceMode);
+		m_Layer.push_back(pLayer);
+		bufferNum	= std::max(bufferNum, pLayer->GetOutputNum());
+
+		// 次の層の代表入力.
+		for (unsigned int s = 0; s < activation.size(); ++s)
+		{
+			tmp.resize(pLayer->GetOutputNum());
+			pLayer->Forward(&activation[s][0], &tmp[0]);
+			activation[s].swap(tmp);
+		}
+	}
+
+	m_Buffer[0].assign(bufferNum, 0);
+	m_Buffer[1].assign(bufferNum, 0);
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 前方出力
+ * -層間の値は Build で確保した領域を交互に使う(呼び出しごとに確保しない)
+ *
+ * @param  input   入力値の配列
+ * @param  output  出力値の配列
+ */
+//----------------------------------------------------------------------
+void QuantizedNet::Forward(const std::vector<double> &input,
+						   std::vector<double>       &output)
+{
+	if ((m_Layer.size() == 0)
+	||  (input.size() != GetInputNum()))
+		return;
+
+	std::copy(input.begin(), input.end(), m_Buffer[0].begin());
+	for (unsigned int i = 0; i < m_Layer.size(); ++i)
+		m_Layer[i]->Forward(&m_Buffer[i&1][0], &m_Buffer[(i+1)&1][0]);
+
+	const Real	*pOutput	= &m_Buffer[m_Layer.size()&1][0];
+
+	output.assign(pOutput, pOutput + GetOutputNum());
+}
@@ -0,0 +1,177 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#ifndef QUANTIZED_NET_H_
+#define QUANTIZED_NET_H_
+
+#include <memory>
+#include <vector>
+
+#include "NeuralNet.h"
+
+//----------------------------------------------------------------------
+/// int8 量子化推論ネット
+// -学習済みの NeuralNet と代表入力から層ごとのスケールを求め,
+//  全結合層・畳み込み層を int8 重み + int32 累積で計算する
+// -活性化層などはそのまま複製して実数で計算する
+// -推論(前方出力)専用
+class QuantizedNet
+{
+  private:
+	typedef NeuralNet::Real	Real;
+
+	//----------------------------------------------------------------------
+	/// 量子化層基底クラス
+	// -入力を入力スケールで int8 に変換し, 出力は実数に戻す
+	// -int8 の入力・int32 の累積は Evaluate の作業領域に置き, Forward は層の作業領域を渡す
+	// -後方出力は逆量子化した重みで入力側の差分だけを求める(重みは学習しない)
+	class QuantizedLayer : public NeuralNet::Layer
+	{
+	  public:
+		QuantizedLayer(unsigned int inputNum,
+					   unsigned int outputNum,
+					   unsigned int type,
+					   Real         inputScale) :
+		NeuralNet::Layer(inputNum, outputNum, type),
+		m_InputScale(inputScale)
+		{}
+		virtual ~QuantizedLayer() {}
+
+		void Forward(const Real *pInput,
+					 Real       *pOutput)
+		{
+			Evaluate(pInput, pOutput, &m_Work[0]);
+		}
+		void ForwardBatch( const Real   *pInput,
+						   Real         *pOutput,
+						   unsigned int batchNum)
+		{
+			for (unsigned int b = 0; b < batchNum; ++b)
+				Forward(pInput + b*m_InputNum, pOutput + b*m_OutputNum);
+		}
+		void BackwardBatch(const Real   *pDelta,
+						   Real         *pOutput,
+						   unsigned int batchNum)
+		{
+			for (unsigned int b = 0; b < batchNum; ++b)
+				Backward(pDelta + b*m_OutputNum, pOutput + b*m_InputNum);
+		}
+
+	  protected:
+		Real						m_InputScale;
+		std::vector<Real>			m_Work;			// Forward 用の作業領域(GetWorkNum() 要素)
+
+		static unsigned int CalcWorkNum(unsigned int accumulatorNum,
+										unsigned int byteNum);
+		void QuantizeInput(signed char *pQuantized,
+						   const Real  *pInput) const;
+	};
+
+	//----------------------------------------------------------------------
+	/// 量子化全結合層
+	class AffineLayer : public QuantizedLayer
+	{
+	  public:
+		AffineLayer(const NeuralNet::AffineLayer &layer,
+					Real                         inputScale);
+		~AffineLayer() {}
+
+		void Backward(const Real *pDelta,
+					  Real       *pOutput);
+		void Evaluate(const Real *pInput,
+					  Real       *pOutput,
+					  Real       *pWork) const;
+		// 累積(出力数) + int8 の入力(m_Stride).
+		unsigned int GetWorkNum(void) const
+		{
+			return (CalcWorkNum(m_OutputNum, m_Stride));
+		}
+
+	  private:
+		unsigned int				m_Stride;		// 重み 1 行の要素数(整列済み)
+		std::vector<signed char>	m_Weight;		// 出力順(o*m_Stride+i)
+		std::vector<Real>			m_Scale;		// 出力ごとの逆量子化係数
+		std::vector<Real>			m_Bias;
+	};
+
+	//----------------------------------------------------------------------
+	/// 量子化畳み込み層
+	class ConvolutionLayer : public QuantizedLayer
+	{
+	  public:
+		ConvolutionLayer(const NeuralNet::ConvolutionLayer &layer,
+						 Real                              inputScale);
+		~ConvolutionLayer() {}
+
+		void Backward(const Real *pDelta,
+					  Real       *pOutput);
+		void Evaluate(const Real *pInput,
+					  Real       *pOutput,
+					  Real       *pWork) const;
+		// 累積(出力数) + int8 の入力(範囲外用の 0 を含む) + パッチ.
+		unsigned int GetWorkNum(void) const
+		{
+			return (CalcWorkNum(m_OutputNum, m_InputNum + 1 + m_WMax*m_HMax*m_Row));
+		}
+
+	  private:
+		unsigned int				m_Width;
+		unsigned int				m_Height;
+		unsigned int				m_Channel;
+		unsigned int				m_FilterSize;
+		unsigned int				m_FilterNum;
+		unsigned int				m_Stride;
+		unsigned int				m_Padding;
+		unsigned int				m_WMax;
+		unsigned int				m_HMax;
+		unsigned int				m_Row;			// パッチ 1 行の要素数(整列済み)
+		std::vector<signed char>	m_Filter;		// フィルタ順(f*m_Row+(c*F+x)*F+y)
+		std::vector<unsigned int>	m_PatchIndex;	// パッチ要素の入力位置(範囲外は入力数)
+		std::vector<Real>			m_Scale;		// フィルタごとの逆量子化係数
+		std::vector<Real>			m_Bias;			// チャンネル分の総和
+	};
+
+	// レイヤー配列
+	std::vector<std::shared_ptr<NeuralNet::Layer>>	m_Layer;
+	// 層間の値(交互に使う. Build で最大の入出力数分を確保する)
+	std::vector<Real>								m_Buffer[2];
+
+	std::shared_ptr<NeuralNet::Layer> CopyLayer(
+		const std::shared_ptr<NeuralNet::Layer> &pLayer) const;
+	static Real CalcInputScale(const std::vector<std::vector<Real>> &samples);
+
+  public:
+	// 較正に使う局面数の上限(Build は層ごとの値を局面数分持つので, 教師データは間引いて渡す).
+	static const unsigned int	CALIBRATION_NUM	= 1024;
+
+	QuantizedNet();
+	~QuantizedNet();
+
+	bool   Build(const NeuralNet                        &net,
+				 const std::vector<std::vector<double>> &samples);
+	void   Clear(void) {m_Layer.clear();}
+	bool   IsValid(void) const {return (m_Layer.size() > 0);}
+
+	void   Forward(const std::vector<double> &input,
+				   std::vector<double>       &output);
+
+	unsigned int GetInputNum(void) const
+	{
+		if (m_Layer.size() == 0)
+			return (0);
+
+		return (m_Layer[0]->GetInputNum());
+	}
+
+	unsigned int GetOutputNum(void) const
+	{
+		if (m_Layer.size() == 0)
+			return (0);
+
+		return (m_Layer[m_Layer.size()-1]->GetOutputNum());
+	}
+};
+
+#endif /* QUANTIZED_NET_H_ */
@@ -0,0 +1,413 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "ReplaySampler.h"
+
+namespace
+{
+	// 保存データの先頭(NeuralNet の学習状態の次の番号).
+	const unsigned int	SAMPLER_STATE	= 0x80000001UL;
+
+	template <typename T>
+	void WriteData(std::vector<char> &data, const T &value)
+	{
+		const char	*pChar	= (const char *)&value;
+
+		data.insert(data.end(), pChar, pChar + sizeof(value));
+	}
+
+	template <typename T>
+	void WriteArray(std::vector<char> &data, const std::vector<T> &value)
+	{
+		if (!value.empty())
+			data.insert(data.end(), (const char *)&value[0], (const char *)(&value[0] + value.size()));
+	}
+
+	template <typename T>
+	bool ReadData(const std::vector<char> &data, unsigned int &index, T &value)
+	{
+		if (index + sizeof(value) > data.size())
+			return (false);
+
+		memcpy(&value, &data[index], sizeof(value));
+		index	+= sizeof(value);
+
+		return (true);
+	}
+
+	template <typename T>
+	bool ReadArray(const std::vector<char> &data, unsigned int &index, std::vector<T> &value)
+	{
+		if (index + sizeof(T) * value.size() > data.size())
+			return (false);
+
+		if (!value.empty())
+			memcpy(&value[0], &data[index], sizeof(T) * value.size());
+		index	+= sizeof(T) * value.size();
+
+		return (true);
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * コンストラクタ
+ */
+//----------------------------------------------------------------------
+ReplaySampler::ReplaySampler() :
+	m_Mode(UniformMode),
+	m_Num(0),
+	m_Drawn(0),
+	m_Step(0),
+	m_Cursor(0),
+	m_Leaf(0),
+	m_Alpha(0.6),
+	m_MaxPriority(1.0),
+	m_StaleLimit(1000),
+	m_StaleCursor(0),
+	m_LossSum(0.0),
+	m_LossNum(0)
+{
+}
+
+//----------------------------------------------------------------------
+/**
+ * 準備
+ * -誤差はすべて未知から始める
+ *
+ * @param  num   局面数
+ * @param  mode  抽出方法
+ * @param  seed  乱数の種
+ */
+//----------------------------------------------------------------------
+void ReplaySampler::Setup(unsigned int num, Mode mode, unsigned int seed)
+{
+	m_Mode			= mode;
+	m_Num			= num;
+	m_Drawn			= 0;
+	m_Step			= 0;
+	m_MaxPriority	= 1.0;
+	m_StaleCursor	= 0;
+	m_LossSum		= 0.0;
+	m_LossNum		= 0;
+
+	m_Random.seed(seed);
+	m_Loss.assign(num, -1.0);
+
+	m_Order.resize(num);
+	for (unsigned int i = 0; i < num; ++i)
+		m_Order[i]	= i;
+	std::shuffle(m_Order.begin(), m_Order.end(), m_Random);
+	m_Cursor	= 0;
+
+	m_Leaf	= 1;
+	while (m_Leaf < num)
+		m_Leaf	*= 2;
+
+	m_Tree.assign(m_Leaf * 2, 0.0);
+	m_LastStep.assign(num, 0);
+
+	if (mode == PriorityMode)
+	{
+		for (unsigned int i = 0; i < num; ++i)
+			m_Tree[m_Leaf + i]	= m_MaxPriority;
+
+		for (unsigned int n = m_Leaf - 1; n > 0; --n)
+			m_Tree[n]	= m_Tree[n * 2] + m_Tree[n * 2 + 1];
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * ミニバッチの局面の取り出し
+ * -優先度なら同じ局面を重ねて選ぶこともある
+ *
+ * @param  batchSize  局面数
+ * @param  index      選んだ局面番号の受取配列
+ */
+//----------------------------------------------------------------------
+void ReplaySampler::Sample(unsigned int batchSize, std::vector<unsigned int> &index)
+{
+	index.clear();
+
+	if (m_Num == 0)
+		return;
+
+	++m_Step;
+	m_Drawn	+= batchSize;
+
+	if (m_Mode == UniformMode)
+	{
+		for (unsigned int b = 0; b < batchSize; ++b)
+		{
+			if (m_Cursor >= m_Num)
+			{
+				std::shuffle(m_Order.begin(), m_Order.end(), m_Random);
+				m_Cursor	= 0;
+			}
+
+			index.push_back(m_Order[m_Cursor++]);
+		}
+
+		return;
+	}
+
+	Refresh();
+
+	// 総和を batchSize 等分した区間から 1 つずつ選ぶ(偏りを抑える).
+	const double	segment	= m_Tree[1] / batchSize;
+
+	std::uniform_real_distribution<double>	dist(0.0, segment);
+
+	for (unsigned int b = 0; b < batchSize; ++b)
+		index.push_back(FindPriority(segment * b + dist(m_Random)));
+}
+
+//----------------------------------------------------------------------
+/**
+ * 誤差の登録
+ * -Sample で選んだ局面の誤差を伝え, 優先度を更新する
+ *
+ * @param  index  局面番号の配列
+ * @param  loss   局面ごとの誤差(index と同じ順)
+ */
+//----------------------------------------------------------------------
+void ReplaySampler::Update(const std::vector<unsigned int> &index,
+						   const std::vector<double>       &loss)
+{
+	for (unsigned int b = 0; (b < index.size()) && (b < loss.size()); ++b)
+	{
+		const unsigned int	i	= index[b];
+
+		if (i >= m_Num)
+			continue;
+
+		if (m_Loss[i] < 0.0)
+			++m_LossNum;
+		else
+			m_LossSum	-= m_Loss[i];
+
+		m_Loss[i]	=  std::max(loss[b], 0.0);
+		m_LossSum	+= m_Loss[i];
+
+		if (m_Mode == PriorityMode)
+		{
+			// 誤差 0 でも選ばれる余地を残す.
+			const double	priority	= pow(m_Loss[i] + 1.0e-6, m_Alpha);
+
+			m_MaxPriority	= std::max(m_MaxPriority, priority);
+			m_LastStep[i]	= m_Step;
+			SetPriority(i, priority);
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 優先度の設定(根までの和を更新する)
+ *
+ * @param  index     局面番号
+ * @param  priority  優先度
+ */
+//----------------------------------------------------------------------
+void ReplaySampler::SetPriority(unsigned int index, double priority)
+{
+	unsigned int	n	= m_Leaf + index;
+
+	m_Tree[n]	= priority;
+
+	for (n /= 2; n > 0; n /= 2)
+		m_Tree[n]	= m_Tree[n * 2] + m_Tree[n * 2 + 1];
+}
+
+//----------------------------------------------------------------------
+/**
+ * 優先度の累積が value になる局面の検索
+ *
+ * @param  value  0 以上, 総和未満の値
+ *
+ * @return        局面番号
+ */
+//----------------------------------------------------------------------
+unsigned int ReplaySampler::FindPriority(double value) const
+{
+	unsigned int	n	= 1;
+
+	while (n < m_Leaf)
+	{
+		if ((value < m_Tree[n * 2]) || (m_Tree[n * 2 + 1] <= 0.0))
+		{
+			n	= n * 2;
+		}
+		else
+		{
+			value	-= m_Tree[n * 2];
+			n		=  n * 2 + 1;
+		}
+	}
+
+	// 丸め誤差で局面のない葉に来たら最後の局面にする.
+	return (std::min(n - m_Leaf, m_Num - 1));
+}
+
+//----------------------------------------------------------------------
+/**
+ * 古い優先度の更新
+ * -1 回に局面数 / staleLimit 件ずつ順に調べ, staleLimit 回以上誤差を
+ *  求めていない局面を最大の優先度にする(一巡に staleLimit 回かかるので,
+ *  見直しまでは最長で staleLimit の 2 倍)
+ */
+//----------------------------------------------------------------------
+void ReplaySampler::Refresh(void)
+{
+	if (m_StaleLimit == 0)
+		return;
+
+	const unsigned int	checkNum	= (m_Num + m_StaleLimit - 1) / m_StaleLimit;
+
+	for (unsigned int c = 0; c < checkNum; ++c)
+	{
+		const unsigned int	i	= m_StaleCursor;
+
+		if (++m_StaleCursor >= m_Num)
+			m_StaleCursor	= 0;
+
+		if ((m_Loss[i] >= 0.0)
+		&&  (m_Step - m_LastStep[i] >= m_StaleLimit))
+		{
+			m_LastStep[i]	= m_Step;
+			SetPriority(i, m_MaxPriority);
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 状態の保存
+ * -配列の後ろに付け足す
+ *
+ * @param  data  バイナリ配列
+ */
+//----------------------------------------------------------------------
+void ReplaySampler::Save(std::vector<char> &data) const
+{
+	std::ostringstream	stream;
+
+	stream << m_Random;
+
+	const std::string	random	= stream.str();
+
+	WriteData(data, SAMPLER_STATE);
+	WriteData(data, (unsigned int)m_Mode);
+	WriteData(data, m_Num);
+	WriteData(data, (unsigned int)random.size());
+	data.insert(data.end(), random.begin(), random.end());
+	WriteData(data, m_Drawn);
+	WriteData(data, m_Step);
+	WriteData(data, m_Cursor);
+	WriteData(data, m_MaxPriority);
+	WriteData(data, m_StaleCursor);
+	WriteData(data, m_LossSum);
+	WriteData(data, m_LossNum);
+	WriteArray(data, m_Order);
+	WriteArray(data, m_Loss);
+	WriteArray(data, m_LastStep);
+
+	// 優先度は葉だけ(節は読み込み時に足し直す).
+	WriteArray(data, std::vector<double>(m_Tree.begin() + m_Leaf, m_Tree.begin() + m_Leaf + m_Num));
+}
+
+//----------------------------------------------------------------------
+/**
+ * 状態の読み込み
+ * -alpha・staleLimit は読み込まない(Set 系の設定のまま)
+ *
+ * @param  data   バイナリ配列
+ * @param  index  読む位置(状態が付いていれば後ろに進める)
+ *
+ * @return        戻したか
+ */
+//----------------------------------------------------------------------
+bool ReplaySampler::Load(const std::vector<char> &data, unsigned int &index)
+{
+	unsigned int	position	= index;
+	unsigned int	tag			= 0;
+	unsigned int	mode		= 0;
+	unsigned int	num			= 0;
+	unsigned int	size		= 0;
+
+	if (!ReadData(data, position, tag)
+	||  (tag != SAMPLER_STATE)
+	||  !ReadData(data, position, mode)
+	||  !ReadData(data, position, num)
+	||  !ReadData(data, position, size)
+	||  (position + size > data.size()))
+		return (false);
+
+	const std::string	random(data.begin() + position, data.begin() + position + size);
+
+	unsigned long long			drawn;
+	unsigned int				step;
+	unsigned int				cursor;
+	double						maxPriority;
+	unsigned int				staleCursor;
+	double						lossSum;
+	unsigned int				lossNum;
+	std::vector<unsigned int>	order(num);
+	std::vector<double>			loss(num);
+	std::vector<unsigned int>	lastStep(num);
+	std::vector<double>			priority(num);
+
+	position	+= size;
+
+	if (!ReadData( data, position, drawn)
+	||  !ReadData( data, position, step)
+	||  !ReadData( data, position, cursor)
+	||  !ReadData( data, position, maxPriority)
+	||  !ReadData( data, position, staleCursor)
+	||  !ReadData( data, position, lossSum)
+	||  !ReadData( data, position, lossNum)
+	||  !ReadArray(data, position, order)
+	||  !ReadArray(data, position, loss)
+	||  !ReadArray(data, position, lastStep)
+	||  !ReadArray(data, position, priority))
+		return (false);
+
+	index	= position;
+
+	// 教師データが増えた・抽出方法を変えたときは初めから.
+	if ((num  != m_Num)
+	||  (mode != (unsigned int)m_Mode))
+		return (false);
+
+	std::istringstream	stream(random);
+
+	stream >> m_Random;
+
+	m_Drawn			= drawn;
+	m_Step			= step;
+	m_Cursor		= cursor;
+	m_MaxPriority	= maxPriority;
+	m_StaleCursor	= staleCursor;
+	m_Order.swap(order);
+	m_Loss.swap(loss);
+	m_LastStep.swap(lastStep);
+	m_LossSum		= lossSum;
+	m_LossNum		= lossNum;
+
+	for (unsigned int i = 0; i < m_Num; ++i)
+		m_Tree[m_Leaf + i]	= priority[i];
+
+	for (unsigned int n = m_Leaf - 1; n > 0; --n)
+		m_Tree[n]	= m_Tree[n * 2] + m_Tree[n * 2 + 1];
+
+	return (true);
+}
@@ -0,0 +1,84 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#ifndef REPLAY_SAMPLER_H_
+#define REPLAY_SAMPLER_H_
+
+#include <random>
+#include <vector>
+
+//----------------------------------------------------------------------
+/// 学習局面の抽出
+// -ミニバッチに使う局面の番号を選ぶ. 1 回の更新の計算量は局面数によらない
+// -一様: 局面を並べ替えた順に取り出し, 一巡したら並べ替え直す
+// -優先度: 最後に求めた誤差の大きい局面ほど多く選ぶ(誤差^alpha に比例).
+//  誤差が未知の局面は最大の優先度とし, staleLimit 回以上誤差を求めていない
+//  局面も最大の優先度に戻して求め直させる(遅くとも staleLimit の 2 倍程度で選ばれる)
+class ReplaySampler
+{
+  public:
+	typedef enum Mode
+	{
+		UniformMode,			// 並べ替えた順(1 巡ごとに並べ替え直す)
+		PriorityMode,			// 誤差に応じた確率
+	} Mode;
+
+  private:
+	Mode						m_Mode;
+	unsigned int				m_Num;			// 局面数
+	std::mt19937				m_Random;
+	unsigned long long			m_Drawn;		// 取り出した局面数の累計
+	unsigned int				m_Step;			// 取り出した回数
+
+	// 一様.
+	std::vector<unsigned int>	m_Order;
+	unsigned int				m_Cursor;
+
+	// 優先度(葉が局面ごとの優先度, 節が子の和の二分木).
+	std::vector<double>			m_Tree;
+	unsigned int				m_Leaf;			// 葉の先頭(2 のべき乗)
+	double						m_Alpha;
+	double						m_MaxPriority;
+	unsigned int				m_StaleLimit;
+	unsigned int				m_StaleCursor;
+	std::vector<unsigned int>	m_LastStep;		// 最後に誤差を求めた回
+
+	// 局面ごとの最後の誤差(未知なら負).
+	std::vector<double>			m_Loss;
+	double						m_LossSum;
+	unsigned int				m_LossNum;
+
+	void         SetPriority(unsigned int index, double priority);
+	unsigned int FindPriority(double value) const;
+	void         Refresh(void);
+
+  public:
+	ReplaySampler();
+	~ReplaySampler() {}
+
+	void   Setup(unsigned int num, Mode mode, unsigned int seed);
+	void   SetAlpha(double alpha) {m_Alpha = alpha;}
+	void   SetStaleLimit(unsigned int staleLimit) {m_StaleLimit = staleLimit;}
+
+	void   Sample(unsigned int batchSize, std::vector<unsigned int> &index);
+	void   Update(const std::vector<unsigned int> &index,
+				  const std::vector<double>       &loss);
+
+	// 取り出しの位置・乱数・誤差の表を保存する(学習を途中から続ける用).
+	// Load は Setup の後に呼び, 局面数と抽出方法が同じときだけ戻す(違えば読み飛ばす).
+	void   Save(std::vector<char> &data) const;
+	bool   Load(const std::vector<char> &data, unsigned int &index);
+
+	// 局面数を単位にした取り出し済みの量(一様なら並べ替えた回数).
+	unsigned int GetEpoch(void) const
+	{
+		return ((m_Num > 0) ? (unsigned int)(m_Drawn / m_Num) : 0);
+	}
+	// 最後に求めた誤差の総和と, 誤差を求めた局面数.
+	double       GetLossSum(void) const {return (m_LossSum);}
+	unsigned int GetLossNum(void) const {return (m_LossNum);}
+};
+
+#endif /* REPLAY_SAMPLER_H_ */
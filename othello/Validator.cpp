@@ -0,0 +1,290 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#include <math.h>
+
+#include "Validator.h"
+
+//----------------------------------------------------------------------
+/**
+ * コンストラクタ
+ */
+//----------------------------------------------------------------------
+Validator::Validator() :
+	m_pData(NULL),
+	m_Generation(0),
+	m_Running(0),
+	m_Quit(false),
+	m_Ready(false),
+	m_Loss(0.0),
+	m_Accuracy(0.0),
+	m_BestLoss(HUGE_VAL),
+	m_BadCount(0),
+	m_PassCount(0)
+{
+}
+
+//----------------------------------------------------------------------
+/**
+ * デストラクタ
+ */
+//----------------------------------------------------------------------
+Validator::~Validator()
+{
+	Clear();
+}
+
+//----------------------------------------------------------------------
+/**
+ * 準備
+ * -評価用の複製を作り, スレッドを起こす
+ *
+ * @param  net        評価するネット
+ * @param  data       教師データ
+ * @param  index      検証用の局面番号
+ * @param  threadNum  スレッド数
+ *
+ * @return            成否
+ */
+//----------------------------------------------------------------------
+bool Validator::Setup(NeuralNet                       &net,
+					  const teacherData               &data,
+					  const std::vector<unsigned int> &index,
+					  unsigned int                    threadNum)
+{
+	Clear();
+
+	if ((threadNum == 0)
+	||  (net.GetParamNum() == 0)
+	||  index.empty())
+		return (false);
+
+	m_Snapshot.Clone(net, NeuralNet::Mode::InferenceMode);
+	m_Snapshot.Compile();
+	m_Best.Clone(net, NeuralNet::Mode::InferenceMode);
+
+	m_pData		= &data;
+	m_Index		= index;
+	m_Running	= 0;
+	m_Ready		= false;
+	m_BestLoss	= HUGE_VAL;
+	m_BadCount	= 0;
+	m_PassCount	= 0;
+
+	for (unsigned int i = 0; i < threadNum; ++i)
+	{
+		std::unique_ptr<Worker>	pWorker(new Worker);
+
+		pWorker->loss		= 0.0;
+		pWorker->correct	= 0;
+
+		m_Worker.push_back(std::move(pWorker));
+	}
+
+	for (unsigned int i = 0; i < threadNum; ++i)
+		m_Worker[i]->thread	= std::thread(&Validator::Run, this, i, m_Generation);
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 後始末
+ * -評価中なら担当区間を終えてから止まる
+ */
+//----------------------------------------------------------------------
+void Validator::Clear(void)
+{
+	{
+		std::lock_guard<std::mutex>	lock(m_Mutex);
+
+		m_Quit	= true;
+	}
+	m_Start.notify_all();
+
+	for (unsigned int i = 0; i < m_Worker.size(); ++i)
+	{
+		if (m_Worker[i]->thread.joinable())
+			m_Worker[i]->thread.join();
+	}
+
+	m_Worker.clear();
+	m_pData		= NULL;
+	m_Running	= 0;
+	m_Quit		= false;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 評価の開始
+ * -値を複製に写したら戻る
+ *
+ * @param  net  評価するネット(Setup と同じ構成)
+ *
+ * @return      始めたか(評価中・構成が違えば false)
+ */
+//----------------------------------------------------------------------
+bool Validator::Start(const NeuralNet &net)
+{
+	{
+		std::lock_guard<std::mutex>	lock(m_Mutex);
+
+		if (m_Worker.empty()
+		||  (m_Running > 0)
+		||  !m_Snapshot.CopyParam(net))
+			return (false);
+
+		// Winograd 変換後フィルタを作り直す.
+		m_Snapshot.Compile();
+
+		m_Running	= m_Worker.size();
+		++m_Generation;
+	}
+	m_Start.notify_all();
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 評価結果の受け取り
+ *
+ * @param  loss      誤差(1 局面あたりの交差エントロピー)の受取先
+ * @param  accuracy  最善手の一致率の受取先
+ * @param  wait      評価中なら終わるのを待つ
+ *
+ * @return           受け取ったか(まだ受け取っていない評価がなければ false)
+ */
+//----------------------------------------------------------------------
+bool Validator::GetResult(double &loss, double &accuracy, bool wait)
+{
+	std::unique_lock<std::mutex>	lock(m_Mutex);
+
+	if (wait)
+		m_Finish.wait(lock, [this] {return (m_Running == 0);});
+
+	if (!m_Ready)
+		return (false);
+
+	m_Ready		= false;
+	loss		= m_Loss;
+	accuracy	= m_Accuracy;
+
+	return (true);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 評価中か
+ *
+ * @return  評価中なら true
+ */
+//----------------------------------------------------------------------
+bool Validator::IsBusy(void)
+{
+	std::lock_guard<std::mutex>	lock(m_Mutex);
+
+	return (m_Running > 0);
+}
+
+//----------------------------------------------------------------------
+/**
+ * 作業スレッド
+ * -検証用局面を等分した区間を担当する
+ *
+ * @param  index       スレッド番号
+ * @param  generation  起動時の評価の通番
+ */
+//----------------------------------------------------------------------
+void Validator::Run(unsigned int index, unsigned int generation)
+{
+	Worker	&worker	= *m_Worker[index];
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex>	lock(m_Mutex);
+
+			m_Start.wait(lock, [&]{return (m_Quit || (m_Generation != generation));});
+
+			if (m_Quit)
+				return;
+
+			generation	= m_Generation;
+		}
+
+		const unsigned int	num		= m_Index.size();
+		const unsigned int	begin	= (unsigned int)((unsigned long long)num * index       / m_Worker.size());
+		const unsigned int	end		= (unsigned int)((unsigned long long)num * (index + 1) / m_Worker.size());
+
+		worker.loss		= 0.0;
+		worker.correct	= 0;
+
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			const std::vector<double>	&teacher	= m_pData->GetTeacher(m_Index[i]);
+			unsigned int				best		= 0;
+			unsigned int				answer		= 0;
+
+			m_Snapshot.Evaluate(m_pData->GetInput(m_Index[i]), worker.output, worker.context);
+
+			for (unsigned int o = 0; o < worker.output.size(); ++o)
+			{
+				worker.loss	+= -teacher[o] * log(worker.output[o] + 1.0e-7);
+
+				if (worker.output[o] > worker.output[best])
+					best	= o;
+				if (teacher[o] > teacher[answer])
+					answer	= o;
+			}
+
+			if (best == answer)
+				++worker.correct;
+		}
+
+		{
+			std::lock_guard<std::mutex>	lock(m_Mutex);
+
+			if (--m_Running == 0)
+				Finish();
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 評価の完了(最後に終えたスレッドがロック中に呼ぶ)
+ * -スレッド順に足すので, スレッド数が同じなら結果は毎回同じ
+ */
+//----------------------------------------------------------------------
+void Validator::Finish(void)
+{
+	double			lossSum	= 0.0;
+	unsigned int	correct	= 0;
+
+	for (unsigned int i = 0; i < m_Worker.size(); ++i)
+	{
+		lossSum	+= m_Worker[i]->loss;
+		correct	+= m_Worker[i]->correct;
+	}
+
+	m_Loss		= lossSum / m_Index.size();
+	m_Accuracy	= (double)correct / m_Index.size();
+	m_Ready		= true;
+	++m_PassCount;
+
+	if (m_Loss < m_BestLoss)
+	{
+		m_BestLoss	= m_Loss;
+		m_BadCount	= 0;
+		m_Best.CopyParam(m_Snapshot);
+	}
+	else
+	{
+		++m_BadCount;
+	}
+
+	m_Finish.notify_all();
+}
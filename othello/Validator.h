@@ -0,0 +1,87 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#ifndef VALIDATOR_H_
+#define VALIDATOR_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NeuralNet.h"
+#include "teacherData.h"
+
+//----------------------------------------------------------------------
+/// 検証用局面の評価
+// -Start で値を推論専用の複製に写して戻り, 専用のスレッドで検証用局面を評価する
+//  (学習はその間も続けられる). 複製は Evaluate で共有し, 実行状態だけスレッドごとに持つ
+// -誤差(交差エントロピーの平均)と最善手の一致率を求め, 最小の誤差だった値を残す
+// -誤差が下がらなかった回数を数えるので, 早期終了の判断に使う
+class Validator
+{
+  private:
+	//----------------------------------------------------------------------
+	/// 作業スレッド
+	struct Worker
+	{
+		NeuralNet::ExecutionContext	context;
+		std::vector<double>			output;
+		double						loss;		// 担当区間の誤差の総和
+		unsigned int				correct;	// 担当区間の最善手の一致数
+		std::thread					thread;
+	};
+
+	NeuralNet								m_Snapshot;		// 評価する値の複製
+	NeuralNet								m_Best;			// 誤差が最小だった値
+	const teacherData						*m_pData;
+	std::vector<unsigned int>				m_Index;		// 検証用の局面番号
+	std::vector<std::unique_ptr<Worker>>	m_Worker;
+
+	std::mutex								m_Mutex;
+	std::condition_variable					m_Start;		// 評価の開始・終了指示
+	std::condition_variable					m_Finish;		// 評価の完了
+	unsigned int							m_Generation;	// 開始した評価の通番
+	unsigned int							m_Running;		// 完了していないスレッド数
+	bool									m_Quit;
+
+	// 最後に完了した評価.
+	bool									m_Ready;		// GetResult で受け取っていない
+	double									m_Loss;
+	double									m_Accuracy;
+	double									m_BestLoss;
+	unsigned int							m_BadCount;		// 最小の誤差を下回らなかった回数
+	unsigned int							m_PassCount;
+
+	void Run(unsigned int index, unsigned int generation);
+	void Finish(void);
+
+  public:
+	Validator();
+	~Validator();
+
+	bool   Setup(NeuralNet                       &net,
+				 const teacherData               &data,
+				 const std::vector<unsigned int> &index,
+				 unsigned int                    threadNum);
+	void   Clear(void);
+
+	// 評価中なら何もせず false.
+	bool   Start(const NeuralNet &net);
+	// 完了した評価があれば受け取る(なければ false). wait なら評価中のものを待つ.
+	bool   GetResult(double &loss, double &accuracy, bool wait = false);
+
+	bool         IsBusy(void);
+	unsigned int GetValidationNum(void) const {return (m_Index.size());}
+	// 以下は GetResult で受け取った後に読むこと.
+	double       GetBestLoss(void) const {return (m_BestLoss);}
+	unsigned int GetBadCount(void) const {return (m_BadCount);}
+	unsigned int GetPassCount(void) const {return (m_PassCount);}
+	// 誤差が最小だった値(推論専用. CopyParam で学習中のネットに戻せる).
+	const NeuralNet &GetBest(void) const {return (m_Best);}
+};
+
+#endif /* VALIDATOR_H_ */
@@ -0,0 +1,274 @@
+﻿/* -*- mode:c++; coding:utf-8-ws-dos; tab-width:4 -*- ==================== */
+/* -----------------------------------------------------------------------
+ * $Id$
+ * ======================================================================= */
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "../NeuralNet.h"
+#include "../QuantizedNet.h"
+
+/*======================================================================
+ * 学習・推論のヒープ確保数の確認
+ * -一度通した後(作業領域の確保後)は, 同じ件数の Forward/Backward/Learn 系・
+ *  Evaluate・まとめた計算でヒープを確保しないこと
+ *======================================================================*/
+
+// operator new の呼び出し回数.
+static unsigned long	AllocCount	= 0;
+
+void *operator new(size_t size)
+{
+	void	*p	= malloc((size > 0) ? size : 1);
+
+	if (p == NULL)
+		throw std::bad_alloc();
+
+	++AllocCount;
+
+	return (p);
+}
+
+void *operator new[](size_t size)
+{
+	return (operator new(size));
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t size) noexcept
+{
+	free(p);
+}
+
+// 確認するネットの構成.
+typedef enum NetKind
+{
+	AffineNet,			// 全結合層
+	ConvolutionNet,		// 畳み込み層
+	PoolingNet,			// 畳み込み層 + 最大プーリング層
+} NetKind;
+
+const unsigned int	BOARD_NUM	= 64;
+const unsigned int	INPUT_NUM	= BOARD_NUM * 2;
+const unsigned int	BATCH_NUM	= 16;
+const unsigned int	LOOP_NUM	= 100;
+
+//----------------------------------------------------------------------
+/**
+ * ネットの構築
+ *
+ * @param  net   構築するネット
+ * @param  kind  構成
+ */
+//----------------------------------------------------------------------
+static void BuildNet(NeuralNet &net, NetKind kind)
+{
+	switch (kind)
+	{
+	  case AffineNet:
+		net.AddAffineLayer(INPUT_NUM, 256);
+		net.AddReLULayer(256);
+		net.AddAffineLayer(256, BOARD_NUM);
+		net.AddSoftMaxLayer(BOARD_NUM);
+		break;
+
+	  case ConvolutionNet:
+		net.AddConvolutionLayer(8, 8, 2, 3, 16, 1, 1);
+		net.AddRReLULayer(1024);
+		net.AddAffineLayer(1024, BOARD_NUM);
+		net.AddSoftMaxLayer(BOARD_NUM);
+		break;
+
+	  case PoolingNet:
+		net.AddConvolutionLayer(8, 8, 2, 3, 16, 1, 1);
+		net.AddReLULayer(1024);
+		net.AddMaxPoolingLayer(8, 8, 16, 2, 2, 0);
+		net.AddAffineLayer(256, BOARD_NUM);
+		net.AddSigmoidLayer(BOARD_NUM);
+		break;
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 盤面(自石・相手石の 0/1)と着手の教師データを作る
+ *
+ * @param  input    入力の受取配列
+ * @param  teacher  教師データの受取配列
+ * @param  engine   乱数
+ */
+//----------------------------------------------------------------------
+static void MakeSample(std::vector<double> &input,
+					   std::vector<double> &teacher,
+					   std::mt19937        &engine)
+{
+	std::uniform_int_distribution<int>	stone(0, 2);
+	std::uniform_int_distribution<int>	move(0, BOARD_NUM - 1);
+
+	input.assign(INPUT_NUM, 0.0);
+	teacher.assign(BOARD_NUM, 0.0);
+
+	for (unsigned int i = 0; i < BOARD_NUM; ++i)
+	{
+		const int	s	= stone(engine);
+
+		if (s > 0)
+			input[(s - 1) * BOARD_NUM + i]	= 1.0;
+	}
+	teacher[move(engine)]	= 1.0;
+}
+
+//----------------------------------------------------------------------
+/**
+ * 学習・推論を 1 回ずつ通す
+ *
+ * @param  net          確認するネット
+ * @param  quantized    net から作った量子化ネット
+ * @param  context      Evaluate の実行状態
+ * @param  input        入力
+ * @param  teacher      教師データ
+ * @param  output       出力の受取配列
+ * @param  batchOutput  まとめた出力の受取配列
+ * @param  pInput       入力(BATCH_NUM 件)
+ * @param  pOutput      出力の受取配列(BATCH_NUM 件)
+ */
+//----------------------------------------------------------------------
+static void RunOnce(NeuralNet                              &net,
+					QuantizedNet                           &quantized,
+					NeuralNet::ExecutionContext            &context,
+					const std::vector<std::vector<double>> &input,
+					const std::vector<std::vector<double>> &teacher,
+					std::vector<double>                    &output,
+					std::vector<std::vector<double>>       &batchOutput,
+					const NeuralNet::Real                  *pInput,
+					NeuralNet::Real                        *pOutput)
+{
+	// 1 件ずつ.
+	for (unsigned int i = 0; i < input.size(); ++i)
+	{
+		net.SetInput(input[i]);
+		net.Forward();
+		net.GetOutput(output);
+		net.CalcCrossEntropyLoss(teacher[i]);
+		net.Backward();
+	}
+	net.Learn(0.001, 0.9);
+	net.LearnAdam();
+
+	// まとめて.
+	net.SetInputBatch(input);
+	net.ForwardBatch();
+	net.GetOutputBatch(batchOutput);
+	net.CalcCrossEntropyLossBatch(teacher);
+	net.BackwardBatch();
+	net.LearnAdam();
+
+	// 推論.
+	net.ForwardBatch(pInput, pOutput, BATCH_NUM);
+	for (unsigned int i = 0; i < input.size(); ++i)
+	{
+		net.Forward(pInput + i*INPUT_NUM, pOutput + i*BOARD_NUM);
+		net.Evaluate(pInput + i*INPUT_NUM, pOutput + i*BOARD_NUM, context);
+		net.Evaluate(input[i], output, context);
+		quantized.Forward(input[i], output);
+	}
+}
+
+//----------------------------------------------------------------------
+/**
+ * 1 構成分の確認
+ *
+ * @param  kind     構成
+ * @param  compile  活性化層を融合するか
+ *
+ * @return          確保がなければ true
+ */
+//----------------------------------------------------------------------
+static bool CheckNet(NetKind kind, bool compile)
+{
+	static const char	*NAME[]	= {"affine", "convolution", "pooling"};
+
+	NeuralNet							net;
+	QuantizedNet						quantized;
+	NeuralNet::ExecutionContext			context;
+	std::vector<std::vector<double>>	input(BATCH_NUM);
+	std::vector<std::vector<double>>	teacher(BATCH_NUM);
+	std::vector<double>					output;
+	std::vector<std::vector<double>>	batchOutput;
+	std::vector<NeuralNet::Real>		realInput(BATCH_NUM * INPUT_NUM);
+	std::vector<NeuralNet::Real>		realOutput(BATCH_NUM * BOARD_NUM);
+	std::mt19937						engine(kind);
+
+	BuildNet(net, kind);
+	net.SetRandomSeed(kind);
+	if (compile)
+		net.Compile();
+
+	for (unsigned int i = 0; i < BATCH_NUM; ++i)
+	{
+		MakeSample(input[i], teacher[i], engine);
+		for (unsigned int j = 0; j < INPUT_NUM; ++j)
+			realInput[i*INPUT_NUM+j]	= (NeuralNet::Real)input[i][j];
+	}
+
+	if (!quantized.Build(net, input))
+	{
+		printf("%-12s compile %d: quantize failed\n", NAME[kind], compile);
+		return (false);
+	}
+
+	// 作業領域を確保させる.
+	RunOnce(net, quantized, context, input, teacher,
+			output, batchOutput, &realInput[0], &realOutput[0]);
+
+	const unsigned long	before	= AllocCount;
+
+	for (unsigned int loop = 0; loop < LOOP_NUM; ++loop)
+	{
+		RunOnce(net, quantized, context, input, teacher,
+				output, batchOutput, &realInput[0], &realOutput[0]);
+	}
+
+	const unsigned long	count	= AllocCount - before;
+
+	printf("%-12s compile %d: %lu allocations %s\n",
+		   NAME[kind], compile, count, (count == 0) ? "OK" : "NG");
+
+	return (count == 0);
+}
+
+/*======================================================================
+ * メイン
+ *======================================================================*/
+int main(int argc, char *argv[])
+{
+	bool	success	= true;
+
+	for (int kind = AffineNet; kind <= PoolingNet; ++kind)
+	{
+		success	&= CheckNet((NetKind)kind, false);
+		success	&= CheckNet((NetKind)kind, true);
+	}
+
+	return (success ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -6,12 +6,111 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <random>
+#include <thread>
 #include <vector>
 
+#include "../CheckpointWriter.h"
+#include "../LearnRateScheduler.h"
 #include "../NeuralNet.h"
+#include "../ParallelTrainer.h"
+#include "../QuantizedNet.h"
+#include "../ReplaySampler.h"
+#include "../Validator.h"
 #include "../teacherData.h"
 
+/*======================================================================
+ * 量子化ネットの精度確認
+ * -教師データから等間隔に取った局面(CALIBRATION_NUM まで)で較正し,
+ *  同じ局面で倍精度ネットと int8 ネットの着手(空きマスの最大出力)を比べる
+ *======================================================================*/
+static void QuantizeReport(NeuralNet &othelloNet, const teacherData &log)
+{
+	typedef std::chrono::steady_clock	clock;
+
+	QuantizedNet						quantizedNet;
+	std::vector<std::vector<double>>	samples;
+	std::vector<double>					output;
+	std::vector<double>					quantizedOutput;
+	const unsigned int					boardNum	= othelloNet.GetOutputNum();
+	unsigned int						agree		= 0;
+	double								maxDiff		= 0.0;
+
+	log.SampleInput(QuantizedNet::CALIBRATION_NUM, samples);
+
+	if (!quantizedNet.Build(othelloNet, samples))
+	{
+		std::cout << "quantize failed" << std::endl;
+		return;
+	}
+
+	for (unsigned int i = 0; i < samples.size(); ++i)
+	{
+		int		best			= -1;
+		int		quantizedBest	= -1;
+
+		othelloNet.SetInput(samples[i]);
+		othelloNet.Forward();
+		othelloNet.GetOutput(output);
+
+		quantizedNet.Forward(samples[i], quantizedOutput);
+
+		for (unsigned int j = 0; j < boardNum; ++j)
+		{
+			maxDiff	= std::max(maxDiff, fabs(output[j] - quantizedOutput[j]));
+
+			// 石のあるマスには打てない.
+			if ((samples[i][j] != 0.0) || (samples[i][j + boardNum] != 0.0))
+				continue;
+
+			if ((best < 0) || (output[j] > output[best]))
+				best	= j;
+			if ((quantizedBest < 0) || (quantizedOutput[j] > quantizedOutput[quantizedBest]))
+				quantizedBest	= j;
+		}
+
+		if (best == quantizedBest)
+			++agree;
+	}
+
+	// 推論時間(1 局面あたり).
+	const unsigned int	repeat	= 1000;
+	clock::time_point	start	= clock::now();
+
+	for (unsigned int r = 0; r < repeat; ++r)
+	{
+		for (unsigned int i = 0; i < samples.size(); ++i)
+		{
+			othelloNet.SetInput(samples[i]);
+			othelloNet.Forward();
+			othelloNet.GetOutput(output);
+		}
+	}
+
+	clock::time_point	middle	= clock::now();
+
+	for (unsigned int r = 0; r < repeat; ++r)
+	{
+		for (unsigned int i = 0; i < samples.size(); ++i)
+			quantizedNet.Forward(samples[i], quantizedOutput);
+	}
+
+	clock::time_point	end		= clock::now();
+	const double		count	= (double)repeat * samples.size();
+
+	std::cout << "agree = " << agree << "/" << samples.size();
+	std::cout << " (" << 100.0 * agree / samples.size() << "%)";
+	std::cout << " max output diff = " << maxDiff << std::endl;
+	std::cout << "double = " << std::chrono::duration<double, std::micro>(middle - start).count() / count << "us";
+	std::cout << " int8 = " << std::chrono::duration<double, std::micro>(end - middle).count() / count << "us" << std::endl;
+}
+
 /*======================================================================
  *
  *======================================================================*/
@@ -93,14 +192,29 @@ int main(int argc, char **argv)
 	othelloNet.AddSoftMaxLayer(64);
 #endif
 
+	// ニューラルネット保存
+	{
+		std::vector<char> data;
+		othelloNet.Save(data);
+
+		CheckpointWriter::WriteData("../othello.net", data, 1);
+	}
 #else
-	// ニューラルネット読み込み
+	// ニューラルネット読み込み(学習状態が付いていればモーメントなども戻す).
+	// 後ろに付いている抽出・学習率の調整の状態は準備の後に戻す.
+	std::vector<char>	savedData;
+	unsigned int		savedIndex;
 	{
 		FILE	*pFile;
 		char	buf[4];
-		std::vector<char> data;
+		std::vector<char> &data	= savedData;
 
 		pFile	= fopen("../othello.net", "rb");
+		if (pFile == NULL)
+		{
+			std::cout << "../othello.net not found" << std::endl;
+			return (1);
+		}
 
 		while (fread(buf, 1, sizeof(buf), pFile) > 0)
 		{
@@ -110,99 +224,272 @@ int main(int argc, char **argv)
 
 		fclose(pFile);
 
-		othelloNet.Load(data);
+		savedIndex	= othelloNet.Load(data);
+		othelloNet.Compile();
 	}
 	// 教師データ読み込み
 	teacherData	log(othelloNet.GetInputNum(), othelloNet.GetOutputNum());
 
 	log.Load("teacher.log");
+
+	// 量子化推論の精度確認のみ.
+	if ((argc > 1) && (strcmp(argv[1], "quantize") == 0))
+	{
+		QuantizeReport(othelloNet, log);
+
+		return (0);
+	}
+
+	// -t スレッド数(既定はコア数), -s 乱数の種(指定すると結果が毎回同じになる),
+	// -a 非同期学習(スレッドごとに少数件ずつ共有の重みを直接更新する),
+	// -p 誤差の大きい局面を多く選ぶ(既定は並べ替えた順に一様に選ぶ),
+	// -c 上限 差分(勾配)の L2 ノルムを上限で切る,
+	// -l 学習率の調整(step / cosine / plateau, 既定は一定),
+	// -w 回数 最初の更新回数だけ学習率を上げていく, -e 回数 cosine で下げきるまでの局面数分の回数,
+	// -k 個数 残すチェックポイントの数(../othello.net, ../othello.net.1 ...),
+	// -v 割合 検証用にする局面の割合(0 で検証しない), -i 回数 検証する更新回数の間隔
+	// (既定は学習用の局面数分ごと), -n 回数 検証の誤差が続けて下がらなければ止める回数.
+	// 学習状態付きで保存するので, 再実行すると続きから学習する(教師データの局面数が
+	// 変わっていれば抽出だけ初めから. -s は続きからでなければ RReLU の乱数にも使う).
+	unsigned int			threadNum	= std::max(std::thread::hardware_concurrency(), 1U);
+	unsigned int			seed		= std::random_device()();
+	bool					seeded		= false;
+	bool					async		= false;
+	ReplaySampler::Mode		samplerMode	= ReplaySampler::UniformMode;
+	LearnRateScheduler		scheduler;
+	LearnRateScheduler::Schedule	schedule	= LearnRateScheduler::ConstantSchedule;
+	unsigned int			cosineEpoch	= 100;
+	unsigned int			keep		= 3;
+	double					validRatio	= 0.1;
+	unsigned int			validStep	= 0;
+	unsigned int			patience	= 5;
+
+	for (int a = 1; a < argc; ++a)
+	{
+		if ((strcmp(argv[a], "-t") == 0) && (a + 1 < argc))
+		{
+			threadNum	= std::max(atoi(argv[++a]), 1);
+		}
+		else if ((strcmp(argv[a], "-s") == 0) && (a + 1 < argc))
+		{
+			seed	= atoi(argv[++a]);
+			seeded	= true;
+		}
+		else if (strcmp(argv[a], "-a") == 0)
+		{
+			async	= true;
+		}
+		else if (strcmp(argv[a], "-p") == 0)
+		{
+			samplerMode	= ReplaySampler::PriorityMode;
+		}
+		else if ((strcmp(argv[a], "-c") == 0) && (a + 1 < argc))
+		{
+			othelloNet.SetDeltaNormLimit(NeuralNet::ClipNorm, atof(argv[++a]));
+		}
+		else if ((strcmp(argv[a], "-l") == 0) && (a + 1 < argc))
+		{
+			++a;
+			if (strcmp(argv[a], "step") == 0)
+				schedule	= LearnRateScheduler::StepSchedule;
+			else if (strcmp(argv[a], "cosine") == 0)
+				schedule	= LearnRateScheduler::CosineSchedule;
+			else if (strcmp(argv[a], "plateau") == 0)
+				schedule	= LearnRateScheduler::PlateauSchedule;
+		}
+		else if ((strcmp(argv[a], "-w") == 0) && (a + 1 < argc))
+		{
+			scheduler.SetWarmup(atoi(argv[++a]));
+		}
+		else if ((strcmp(argv[a], "-e") == 0) && (a + 1 < argc))
+		{
+			cosineEpoch	= std::max(atoi(argv[++a]), 1);
+		}
+		else if ((strcmp(argv[a], "-k") == 0) && (a + 1 < argc))
+		{
+			keep	= std::max(atoi(argv[++a]), 1);
+		}
+		else if ((strcmp(argv[a], "-v") == 0) && (a + 1 < argc))
+		{
+			validRatio	= atof(argv[++a]);
+		}
+		else if ((strcmp(argv[a], "-i") == 0) && (a + 1 < argc))
+		{
+			validStep	= std::max(atoi(argv[++a]), 1);
+		}
+		else if ((strcmp(argv[a], "-n") == 0) && (a + 1 < argc))
+		{
+			patience	= std::max(atoi(argv[++a]), 1);
+		}
+	}
+
+	// 抽出・学習率の調整の状態が付いているか, 更新回数が残っていれば続きから.
+	const bool	resume	= (savedIndex < savedData.size()) || (othelloNet.GetLearnStep() > 0);
+
+	if (seeded && !resume)
+		othelloNet.SetRandomSeed(seed);
+
+	// 検証用の局面は学習に使わない(局面の内容で分けるので, 再実行しても同じ側になる).
+	std::vector<unsigned int>	trainIndex;
+	std::vector<unsigned int>	validIndex;
+
+	log.Split(validRatio, trainIndex, validIndex);
+
+	ParallelTrainer	trainer;
+	ReplaySampler	sampler;
+	CheckpointWriter	checkpoint;
+	Validator		validator;
+
+	trainer.Setup(othelloNet, threadNum);
+	sampler.Setup(trainIndex.size(), samplerMode, seed);
+	checkpoint.Setup(othelloNet, "../othello.net", keep, true);
+
+	// 検証は学習と並行に少数のスレッドで行う.
+	const bool	validate	= validator.Setup(othelloNet, log, validIndex, std::max(threadNum / 4, 1U));
 	
-	unsigned int learnEnd = log.GetDataCount();// 1;
 	int learnCount = 0;
 	double learnRatio = 0.001;
 	double threshold = 1.0e-3;
-	while (learnCount < 1000000)
-	{
-		double	totalError = 0.0;
-		std::vector<double> output;
 
-		output.resize(othelloNet.GetOutputNum());
+	// 1 回の更新で前方・後方出力する局面数(スレッドで分けて並列に計算する).
+	// 非同期学習ではスレッドごとに asyncBatchSize 件ずつ取り出して更新する.
+	const unsigned int					batchSize		= 256;
+	const unsigned int					asyncBatchSize	= 16;
+	const unsigned int					stepSize		= async ? batchSize * threadNum : batchSize;
+	std::vector<unsigned int>			batchIndex;
+	std::vector<double>					batchLoss;
+	std::vector<std::vector<double>>	batchInput;
+	std::vector<std::vector<double>>	batchTeacher;
 
-		++learnCount;
+	typedef std::chrono::steady_clock	clock;
 
-		std::cout << "learn count = " << learnCount << " learnEnd = (" << learnEnd;
-		std::cout << "/" << log.GetDataCount() << ")";
-		std::cout << " learn ratio = " << learnRatio;
+	const unsigned int					epochStep		= (trainIndex.size() + stepSize - 1) / stepSize;
 
-		for (unsigned int i = 0; i < learnEnd; ++i)
-		{
-			othelloNet.SetInput(log.GetInput(i));
-			othelloNet.Forward();
-			othelloNet.GetOutput(output);
+	if (validStep == 0)
+		validStep	= std::max(epochStep, 1U);
 
-#if 0
-			std::cout << "teacher data " << i << std::endl;
+	// 学習率は更新ごとに調整する(cosine は局面数分の回数で更新回数を決める).
+	scheduler.SetCosine(cosineEpoch * epochStep);
+	scheduler.Setup(schedule, learnRatio);
 
-			for (unsigned int j = 0; j < output.size(); ++j)
-				std::cout << output[j] << " " << log.GetTeacher(i)[j] << std::endl;
-#endif
-			totalError += othelloNet.CalcCrossEntropyLoss(log.GetTeacher(i));
+	if (resume)
+	{
+		const bool	samplerResume	= sampler.Load(savedData, savedIndex);
 
-			othelloNet.Backward();
-		}
+		scheduler.Load(savedData, savedIndex);
+		learnCount	= scheduler.GetEpoch();
 
-		std::cout << " error = " << totalError << std::endl;
+		std::cout << "resume learn step = " << othelloNet.GetLearnStep();
+		std::cout << " learn count = " << learnCount;
+		std::cout << (samplerResume ? "" : " (sampler restart)") << std::endl;
+	}
+	savedData.clear();
 
-		if (totalError < threshold)
-		{
-			othelloNet.LearnAdamReset();
+	clock::time_point	start	= clock::now();
+	unsigned int		epoch	= sampler.GetEpoch();
 
-			// ニューラルネット保存
-			{
-				FILE	*pFile;
+	// 局面数分を取り出すごとに誤差を表示して保存する.
+	while (learnCount < 1000000)
+	{
+		sampler.Sample(stepSize, batchIndex);
+		learnRatio	= scheduler.Step();
+
+		batchInput.resize(batchIndex.size());
+		batchTeacher.resize(batchIndex.size());
+		for (unsigned int b = 0; b < batchIndex.size(); ++b)
+		{
+			batchInput[b]	= log.GetInput(  trainIndex[batchIndex[b]]);
+			batchTeacher[b]	= log.GetTeacher(trainIndex[batchIndex[b]]);
+		}
 
-				std::vector<char> data;
-				othelloNet.Save(data);
+		if (async)
+		{
+			trainer.TrainAsync(batchInput,
+							   batchTeacher,
+							   batchIndex.size(),
+							   asyncBatchSize,
+							   ParallelTrainer::OptimizerAdam,
+							   learnRatio,
+							   &batchLoss);
+		}
+		else
+		{
+			trainer.Train(batchInput, batchTeacher, &batchLoss);
+			//othelloNet.Learn(learnRatio);
+			othelloNet.LearnAdam(learnRatio);
+		}
 
-				pFile = fopen("../othello.net", "wb");
+		sampler.Update(batchIndex, batchLoss);
 
-				fwrite(&data[0], 1, data.size(), pFile);
+		// 検証の結果は終わっていれば受け取る(評価中も学習は止めない).
+		double	validLoss;
+		double	validAccuracy;
 
-				fclose(pFile);
-			}
+		if (validate
+		&&  validator.GetResult(validLoss, validAccuracy))
+		{
+			std::cout << "validation loss = " << validLoss;
+			std::cout << " accuracy = " << validAccuracy;
+			std::cout << " best = " << validator.GetBestLoss();
+			std::cout << " (" << validator.GetValidationNum() << " samples)" << std::endl;
 
-			if (++learnEnd >= log.GetDataCount())
+			// 誤差が最小だった値に戻して止める.
+			if (validator.GetBadCount() >= patience)
 			{
-				std::cout << "learn end" << std::endl;
+				std::cout << "early stop" << std::endl;
+				othelloNet.CopyParam(validator.GetBest());
 				break;
 			}
-#if 0
-			if ((learnEnd % 80) == 0)
-			{
-				learnRatio *= 0.1;
-				othelloNet.SetLearnRatio(learnRatio);
+		}
+		if (validate
+		&&  (scheduler.GetStep() % validStep == 0))
+			validator.Start(othelloNet);
 
-			}
-#endif
+		if (sampler.GetEpoch() == epoch)
+			continue;
+
+		const double	second	= std::chrono::duration<double>(clock::now() - start).count();
+
+		epoch	= sampler.GetEpoch();
+		start	= clock::now();
+		++learnCount;
+
+		// 停滞は局面ごとの平均で比べる(誤差を求めた局面数が増えていく間も同じ尺度にする).
+		scheduler.EndEpoch(sampler.GetLossSum() / std::max(sampler.GetLossNum(), 1U));
+
+		// 誤差は局面ごとに最後に求めた値の総和.
+		std::cout << "learn count = " << learnCount;
+		std::cout << " learn ratio = " << learnRatio;
+		std::cout << " error = " << sampler.GetLossSum();
+		std::cout << " (" << sampler.GetLossNum() << "/" << trainIndex.size() << ")";
+		if (!async)
+			std::cout << " norm = " << othelloNet.GetDeltaNorm();
+		std::cout << (async ? " async " : " sync ") << trainIndex.size() / second << " samples/s" << std::endl;
+
+		// ニューラルネット保存(値を写すだけで, 書き込みは別スレッド. 書き込み中なら次の回にする).
+		std::vector<char>	state;
+
+		sampler.Save(state);
+		scheduler.Save(state);
+		checkpoint.Write(othelloNet, state);
+
+		if ((sampler.GetLossNum() == trainIndex.size())
+		&&  (sampler.GetLossSum() < threshold))
+		{
+			std::cout << "learn end" << std::endl;
+			break;
 		}
-		//othelloNet.DeltaNormalize();
-		//othelloNet.Learn(learnRatio / learnEnd);
-		othelloNet.LearnAdam();// learnRatio / learnEnd);
 	}
-#endif
-	// ニューラルネット保存
-	{
-		FILE	*pFile;
 
-		std::vector<char> data;
-		othelloNet.Save(data);
-		
-		pFile	= fopen("../othello.net", "wb");
-		
-		fwrite(&data[0], 1, data.size(), pFile);
-		
-		fclose(pFile);
-	}
+	// 最後の値は書き込み中のものを待ってから必ず保存する.
+	std::vector<char>	state;
+
+	sampler.Save(state);
+	scheduler.Save(state);
+	checkpoint.Write(othelloNet, state, true);
+	if (!checkpoint.Flush())
+		std::cout << "save error" << std::endl;
+#endif
 	
 	return (0);
 }
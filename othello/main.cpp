@@ -14,6 +14,7 @@
 #include "resource.h"
 
 #include "NeuralNet.h"
+#include "QuantizedNet.h"
 #include "teacherData.h"
 
 #define APP_NAME TEXT("Othello")
@@ -54,7 +55,9 @@ static const int gridSize	= 70;
 
 static bool learn	= false;
 
-NeuralNet	Net;
+NeuralNet						Net;
+NeuralNet::ExecutionContext		NetContext;	// 思考スレッドの実行状態(重みは Net と共有)
+QuantizedNet					QNet;		// 対局用(int8 推論. 引数 quantize のときだけ作る)
 
 typedef struct teacherLog_tag
 {
@@ -287,9 +290,14 @@ static int Cpu(int bw)
 			}
 		}
 		
-		Net.SetInput(input);
-		Net.Forward();
-		Net.GetOutput(output);
+		if (!learn && QNet.IsValid())
+		{
+			QNet.Forward(input, output);
+		}
+		else
+		{
+			Net.Evaluate(input, output, NetContext);
+		}
 
 		for (int x = 0; x < BOARD_SIZE; ++x)
 		{
@@ -879,7 +887,11 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrev, LPSTR lpCmd,int nShow)
 
 		fclose(pFile);
 
-		Net.Load(data);
+		// 対局では学習しないので勾配や Adam の値は持たない.
+		// exp も近似で十分なので高速版を使う.
+		Net.Load(data, NeuralNet::Mode::InferenceMode);
+		Net.SetAccuracy(AccuracyFast);
+		Net.Compile();
 	}
 
 	if (strcmp(lpCmd, "learn") == 0)
@@ -927,6 +939,22 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrev, LPSTR lpCmd,int nShow)
 		}
 		return (0);
 	}
+
+	// 引数 quantize なら対局用の量子化ネットを棋譜の局面で較正して作る
+	// (既定は倍精度のネットで打つ. 量子化すると着手の選び方が変わる).
+	if (strcmp(lpCmd, "quantize") == 0)
+	{
+		teacherData							log(BOARD_SIZE*BOARD_SIZE*2,
+												BOARD_SIZE*BOARD_SIZE);
+		std::vector<std::vector<double>>	samples;
+
+		// 棋譜は自己対局で増え続けるので, 較正には等間隔に間引いた局面だけを使う.
+		log.Load("learning\\teacher.log");
+		log.SampleInput(QuantizedNet::CALIBRATION_NUM, samples);
+
+		// 失敗時は倍精度のネットで打つ.
+		QNet.Build(Net, samples);
+	}
 	
 	wc.style			= CS_HREDRAW | CS_VREDRAW;
 	wc.lpfnWndProc		= WindowProc;
@@ -1,4 +1,4 @@
-#pragma once
+﻿#pragma once
 
 #define _CRT_SECURE_NO_WARNINGS
 
@@ -144,6 +144,51 @@ public:
 		m_Data.push_back(temp);
 	}
 
+	// 学習用と検証用の局面番号に分ける(validationRatio の割合を検証用にする).
+	// 入力の内容のハッシュで決めるので, 教師データが増えても同じ局面はいつも同じ側になる.
+	void Split(double validationRatio,
+			   std::vector<unsigned int> &train,
+			   std::vector<unsigned int> &validation) const
+	{
+		train.clear();
+		validation.clear();
+
+		for (unsigned int i = 0; i < m_Data.size(); ++i)
+		{
+			const unsigned char	*pByte	= (const unsigned char *)m_Data[i].input.data();
+			unsigned long long	hash	= 14695981039346656037ULL;
+
+			// FNV-1a の後に上位ビットまで混ぜる.
+			for (unsigned int b = 0; b < sizeof(double) * m_Data[i].input.size(); ++b)
+			{
+				hash	^= pByte[b];
+				hash	*= 1099511628211ULL;
+			}
+			hash	^= hash >> 33;
+			hash	*= 0xff51afd7ed558ccdULL;
+			hash	^= hash >> 33;
+
+			if ((hash >> 11) * (1.0 / 9007199254740992.0) < validationRatio)
+				validation.push_back(i);
+			else
+				train.push_back(i);
+		}
+	}
+
+	// 全体から等間隔に最大 maxNum 局面の入力を取り出す(量子化の較正用).
+	void SampleInput(unsigned int maxNum, std::vector<std::vector<double>> &input) const
+	{
+		input.clear();
+
+		if (maxNum == 0)
+			return;
+
+		const unsigned int	step	= (m_Data.size() + maxNum - 1) / maxNum;
+
+		for (unsigned int i = 0; i < m_Data.size(); i += step)
+			input.push_back(m_Data[i].input);
+	}
+
 	unsigned int	GetDataCount(void) const { return (m_Data.size()); }
 	const std::vector<double> &GetInput(  int index)	const { return (m_Data[index].input); }
 	const std::vector<double> &GetTeacher(int index)	const { return (m_Data[index].teacher); }